@@ -20,6 +20,71 @@ cat <<EOF >main/secrets.h
 #define SENSOR_1_KEY "$SENSOR_1_KEY"
 #define SENSOR_1 $SENSOR_1
 
+#define SENSOR_RESOLUTION_KEY "$SENSOR_RESOLUTION_KEY"
+#define SENSOR_RESOLUTION $SENSOR_RESOLUTION
+
+#define SENSOR_ROMS_KEY "$SENSOR_ROMS_KEY"
+
+#define PREDICTION_HORIZON_KEY "$PREDICTION_HORIZON_KEY"
+#define PREDICTION_HORIZON $PREDICTION_HORIZON
+
+#define FAN_MODE_KEY "$FAN_MODE_KEY"
+#define FAN_MODE $FAN_MODE
+
+#define FAN_WEIGHT_KEY "$FAN_WEIGHT_KEY"
+#define DRIVE_MIN_TEMP_KEY "$DRIVE_MIN_TEMP_KEY"
+#define DRIVE_MAX_TEMP_KEY "$DRIVE_MAX_TEMP_KEY"
+
+#define FAN_CONTROL_KEY "$FAN_CONTROL_KEY"
+#define FAN_CONTROL $FAN_CONTROL
+
+#define PID_TARGET_KEY "$PID_TARGET_KEY"
+#define PID_TARGET $PID_TARGET
+
+#define PID_KP_KEY "$PID_KP_KEY"
+#define PID_KP $PID_KP
+
+#define PID_KI_KEY "$PID_KI_KEY"
+#define PID_KI $PID_KI
+
+#define PID_KD_KEY "$PID_KD_KEY"
+#define PID_KD $PID_KD
+
+#define FAN_CURVE_KEY "$FAN_CURVE_KEY"
+#define FAN_CURVE "$FAN_CURVE"
+
+#define HYSTERESIS_RISE_KEY "$HYSTERESIS_RISE_KEY"
+#define HYSTERESIS_RISE $HYSTERESIS_RISE
+
+#define HYSTERESIS_FALL_KEY "$HYSTERESIS_FALL_KEY"
+#define HYSTERESIS_FALL $HYSTERESIS_FALL
+
+#define DUTY_STEP_KEY "$DUTY_STEP_KEY"
+#define DUTY_STEP $DUTY_STEP
+
+#define FAN_PULSES_KEY "$FAN_PULSES_KEY"
+#define FAN_PULSES $FAN_PULSES
+
+#define STALL_RPM_KEY "$STALL_RPM_KEY"
+#define STALL_RPM $STALL_RPM
+
+#define MAX_RPM_KEY "$MAX_RPM_KEY"
+#define MAX_RPM $MAX_RPM
+
+#define STALE_AFTER_KEY "$STALE_AFTER_KEY"
+#define STALE_AFTER $STALE_AFTER
+
+#define FAILSAFE_DUTY_KEY "$FAILSAFE_DUTY_KEY"
+#define FAILSAFE_DUTY $FAILSAFE_DUTY
+
+#define ZONE_COUNT_KEY "$ZONE_COUNT_KEY"
+#define ZONE_COUNT $ZONE_COUNT
+
+#define ZONE_GPIO_KEY "$ZONE_GPIO_KEY"
+#define ZONE_SENSORS_KEY "$ZONE_SENSORS_KEY"
+#define ZONE_MODE_KEY "$ZONE_MODE_KEY"
+#define ZONE_CURVE_KEY "$ZONE_CURVE_KEY"
+
 #define WIFI_SSID_KEY "$WIFI_SSID_KEY"
 #define WIFI_SSID "$WIFI_SSID"
 
@@ -41,13 +106,35 @@ cat <<EOF >main/secrets.h
 EOF
 
 printf "Updated secret.h:
-%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n" \
+%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n%s ==> %s\n" \
     "NVS storage" "${STORAGE_SPACE}" \
     "${MIN_HDD_TEMP_KEY}" "${MIN_HDD_TEMP}" \
     "${MAX_HDD_TEMP_KEY}" "${MAX_HDD_TEMP}" \
     "${FREQUENCY_KEY}" "${FREQUENCY}" \
     "${SENSOR_0_KEY}" "${SENSOR_0}" \
     "${SENSOR_1_KEY}" "${SENSOR_1}" \
+    "${SENSOR_RESOLUTION_KEY}" "${SENSOR_RESOLUTION}" \
+    "Sensor ROM cache" "${SENSOR_ROMS_KEY}" \
+    "${PREDICTION_HORIZON_KEY}" "${PREDICTION_HORIZON}" \
+    "${FAN_MODE_KEY}" "${FAN_MODE}" \
+    "Drive weights" "${FAN_WEIGHT_KEY}<N>" \
+    "Drive curves" "${DRIVE_MIN_TEMP_KEY}<N> .. ${DRIVE_MAX_TEMP_KEY}<N>" \
+    "${FAN_CONTROL_KEY}" "${FAN_CONTROL}" \
+    "${PID_TARGET_KEY}" "${PID_TARGET}" \
+    "${PID_KP_KEY}" "${PID_KP}" \
+    "${PID_KI_KEY}" "${PID_KI}" \
+    "${PID_KD_KEY}" "${PID_KD}" \
+    "${FAN_CURVE_KEY}" "${FAN_CURVE}" \
+    "${HYSTERESIS_RISE_KEY}" "${HYSTERESIS_RISE}" \
+    "${HYSTERESIS_FALL_KEY}" "${HYSTERESIS_FALL}" \
+    "${DUTY_STEP_KEY}" "${DUTY_STEP}" \
+    "${FAN_PULSES_KEY}" "${FAN_PULSES}" \
+    "${STALL_RPM_KEY}" "${STALL_RPM}" \
+    "${MAX_RPM_KEY}" "${MAX_RPM}" \
+    "${STALE_AFTER_KEY}" "${STALE_AFTER}" \
+    "${FAILSAFE_DUTY_KEY}" "${FAILSAFE_DUTY}" \
+    "${ZONE_COUNT_KEY}" "${ZONE_COUNT}" \
+    "Zone map" "${ZONE_GPIO_KEY}<N>, ${ZONE_SENSORS_KEY}<N>, ${ZONE_MODE_KEY}<N>, ${ZONE_CURVE_KEY}<N>" \
     "${WIFI_SSID_KEY}" "${WIFI_SSID}" \
     "${WIFI_PASSWORD_KEY}" "${WIFI_PASSWORD}" \
     "${MQTT_HOST_KEY}" "${MQTT_HOST}" \
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Single producer / multiple consumer broadcast of values. The producer
+// overwrites the oldest slot and never waits. Every consumer has its own
+// cursor, a consumer that fell behind by more than N values skips to the
+// oldest one still kept.
+namespace Broadcast_NS {
+
+// Read position of one consumer
+struct Cursor {
+    uint32_t next { 0 }; // Sequence number of the next value to read
+    uint32_t skipped { 0 }; // Values overwritten before they were read
+};
+
+template <typename T, size_t N>
+class Channel {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Channel length must be a power of two");
+
+protected:
+    struct Slot {
+        // Sequence number of the value + 1, 0 - the slot is being written
+        std::atomic<uint32_t> seq { 0 };
+        T value {};
+    };
+    Slot _slots[N];
+    std::atomic<uint32_t> _head { 0 }; // Sequence number of the next value
+
+public:
+    static constexpr size_t capacity(void) { return N; }
+
+    // Producer side, may be called only from one task
+    void publish(const T& value)
+    {
+        const uint32_t seq = _head.load(std::memory_order_relaxed);
+        Slot& slot = _slots[seq & (N - 1)];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.value = value;
+        slot.seq.store(seq + 1, std::memory_order_release);
+        _head.store(seq + 1, std::memory_order_release);
+    }
+
+    // Cursor which reads only values published after this call
+    Cursor subscribe(void) const
+    {
+        Cursor cursor;
+        cursor.next = _head.load(std::memory_order_acquire);
+        return cursor;
+    }
+
+    bool empty(const Cursor& cursor) const
+    {
+        return cursor.next == _head.load(std::memory_order_acquire);
+    }
+
+    // Consumer side. Returns false if there is no new value.
+    bool read(Cursor& cursor, T& value) const
+    {
+        for (;;) {
+            const uint32_t head = _head.load(std::memory_order_acquire);
+            if (cursor.next == head) {
+                return false;
+            }
+            // Sequence numbers wrap, so distances are unsigned differences
+            if (head - cursor.next > N) {
+                cursor.skipped += head - cursor.next - N;
+                cursor.next = head - N;
+            }
+
+            // The producer may overwrite the slot meanwhile, then the value
+            // is lost and the next one is tried
+            const Slot& slot = _slots[cursor.next & (N - 1)];
+            bool valid = slot.seq.load(std::memory_order_acquire) == cursor.next + 1;
+            if (valid) {
+                value = slot.value;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                valid = slot.seq.load(std::memory_order_relaxed) == cursor.next + 1;
+            }
+            ++cursor.next;
+            if (valid) {
+                return true;
+            }
+            ++cursor.skipped;
+        }
+    }
+};
+
+} // namespace Broadcast_NS
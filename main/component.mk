@@ -1,3 +1,21 @@
 #
 # Main Makefile. This is basically the same as a component makefile.
 #
+
+# 1-Wire bus backend: ONEWIRE_BACKEND_GPIO (default), ONEWIRE_BACKEND_UART or
+# ONEWIRE_BACKEND_SIM (virtual sensors, no hardware needed). UART backend
+# needs the console on UART1 in menuconfig (Component config -> ESP8266-
+# specific -> UART for console output -> Custom, UART1), it takes GPIO2.
+# CPPFLAGS += -DONEWIRE_BACKEND=ONEWIRE_BACKEND_UART
+
+# GPIO backend: ONEWIRE_FAST_GPIO=0 falls back to the gpio driver calls,
+# ONEWIRE_SLOT_STATS=1 records slot pulse widths in CPU cycles
+# CPPFLAGS += -DONEWIRE_SLOT_STATS=1
+
+# Parallel 1-Wire buses with one sensor each on ONEWIRE_BUS_PINS (GPIO and
+# SIM backends), 1 - single bus with sensor search
+# CPPFLAGS += -DONEWIRE_BUS_COUNT=2
+
+# Fan tach input, GPIO14 is taken by ONEWIRE_BUS_COUNT=4 and GPIO2 by the
+# UART1 console of the UART backend
+# CPPFLAGS += -DFAN_TACH_GPIO=2
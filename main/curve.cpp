@@ -0,0 +1,102 @@
+#include "curve.h"
+#include <cstdlib>
+
+namespace Control_NS {
+
+ActuationStats actuation_stats {};
+LoopStats loop_stats {};
+
+bool actuate(uint32_t duty, uint32_t last, uint32_t step, uint32_t max_duty)
+{
+    if (duty == last) {
+        ++actuation_stats.unchanged;
+        return false;
+    }
+    const uint32_t delta = duty > last ? duty - last : last - duty;
+    if (delta < step && duty != 0 && duty != max_duty) {
+        ++actuation_stats.coalesced;
+        return false;
+    }
+    return true;
+}
+
+esp_err_t Curve::set_points(const uint8_t* temperatures, const uint8_t* duties, uint8_t count)
+{
+    if (count == 0 || count > CURVE_MAX_POINTS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (duties[i] > 100 || (i > 0 && temperatures[i] <= temperatures[i - 1])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    const Temp_NS::q4_t start = Temp_NS::from_degrees(temperatures[0]);
+    const int32_t span = (Temp_NS::from_degrees(temperatures[count - 1]) - start) >> CURVE_STEP_SHIFT;
+    if (span >= CURVE_TABLE_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    _start = start;
+    _size = span + 1;
+    uint8_t point = 0;
+    for (uint16_t i = 0; i < _size; i++) {
+        const int32_t temperature = start + (i << CURVE_STEP_SHIFT);
+        while (point + 1 < count && temperature > Temp_NS::from_degrees(temperatures[point + 1])) {
+            ++point;
+        }
+        if (point + 1 >= count) {
+            _table[i] = duties[point] * 100;
+            continue;
+        }
+        const int32_t low = Temp_NS::from_degrees(temperatures[point]);
+        const int32_t high = Temp_NS::from_degrees(temperatures[point + 1]);
+        const int32_t from = duties[point] * 100;
+        const int32_t to = duties[point + 1] * 100;
+        _table[i] = static_cast<uint16_t>(from + (to - from) * (temperature - low) / (high - low));
+    }
+    return ESP_OK;
+}
+
+esp_err_t Curve::parse(const char* text)
+{
+    uint8_t temperatures[CURVE_MAX_POINTS];
+    uint8_t duties[CURVE_MAX_POINTS];
+    uint8_t count = 0;
+
+    const char* position = text;
+    while (*position != '\0') {
+        if (count == CURVE_MAX_POINTS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        char* end = nullptr;
+        const long temperature = strtol(position, &end, 10);
+        if (end == position || *end != ':' || temperature < 0 || temperature > 125) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        position = end + 1;
+        const long duty = strtol(position, &end, 10);
+        if (end == position || (*end != ',' && *end != '\0') || (*end == ',' && end[1] == '\0')
+            || duty < 0 || duty > 100) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        temperatures[count] = static_cast<uint8_t>(temperature);
+        duties[count] = static_cast<uint8_t>(duty);
+        ++count;
+        position = *end == ',' ? end + 1 : end;
+    }
+    return set_points(temperatures, duties, count);
+}
+
+uint16_t Curve::duty(Temp_NS::q4_t temperature) const
+{
+    if (_size == 0) {
+        return 0;
+    }
+    if (temperature <= _start) {
+        return _table[0];
+    }
+    const int32_t index = (temperature - _start) >> CURVE_STEP_SHIFT;
+    return _table[index < _size ? index : _size - 1];
+}
+
+} // namespace Control_NS
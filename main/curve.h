@@ -0,0 +1,91 @@
+#pragma once
+
+#include "esp_err.h"
+#include "temperature.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Control_NS {
+
+constexpr uint8_t CURVE_MAX_POINTS = 8;
+constexpr uint8_t CURVE_STEP_SHIFT = 2; // Table step 1/4 C
+constexpr uint16_t CURVE_TABLE_SIZE = 256; // 64 C from the first point
+constexpr uint16_t CURVE_DUTY_MAX = 10000; // 100 %
+
+// Fan curve of up to CURVE_MAX_POINTS (temperature, duty) points compiled
+// into a table, so the control pass is one lookup. Between points the duty
+// is linear, outside them it's the duty of the nearest point.
+class Curve {
+protected:
+    Temp_NS::q4_t _start { 0 }; // Temperature of the first entry
+    uint16_t _size { 0 };
+    uint16_t _table[CURVE_TABLE_SIZE] {}; // Duty in 1/100 %
+
+public:
+    // Temperatures in C rising, duty in % 0..100
+    esp_err_t set_points(const uint8_t* temperatures, const uint8_t* duties, uint8_t count);
+    // "30:0,35:30,40:60,45:100" - "temperature:duty" pairs
+    esp_err_t parse(const char* text);
+
+    bool empty(void) const { return _size == 0; }
+    void clear(void) { _size = 0; }
+    // Duty in 1/100 %
+    uint16_t duty(Temp_NS::q4_t temperature) const;
+};
+
+// Temperature that follows the input only when it leaves the band around
+// the held value, so noise at a curve point doesn't move the fan
+class Hysteresis {
+protected:
+    Temp_NS::q4_t _rise;
+    Temp_NS::q4_t _fall;
+    Temp_NS::q4_t _held { 0 };
+    bool _initialized { false };
+
+public:
+    Hysteresis(Temp_NS::q4_t rise = 0, Temp_NS::q4_t fall = 0)
+        : _rise(rise)
+        , _fall(fall)
+    {
+    }
+    void set_bands(Temp_NS::q4_t rise, Temp_NS::q4_t fall)
+    {
+        _rise = rise;
+        _fall = fall;
+    }
+    void reset(void) { _initialized = false; }
+
+    Temp_NS::q4_t update(Temp_NS::q4_t temperature)
+    {
+        if (!_initialized || temperature > _held + _rise || temperature < _held - _fall) {
+            _held = temperature;
+            _initialized = true;
+        }
+        return _held;
+    }
+    Temp_NS::q4_t value(void) const { return _held; }
+};
+
+// Fan duty updates, written by the fan task only
+struct ActuationStats {
+    uint32_t actuations; // Duty written to LEDC
+    uint32_t unchanged; // Skipped, the same duty
+    uint32_t coalesced; // Skipped, the change is below the duty step
+};
+extern ActuationStats actuation_stats;
+
+// Whether "duty" is written: it differs from "last" by "step" or more. Off and
+// full duty are always reached. A skipped duty is counted in actuation_stats.
+bool actuate(uint32_t duty, uint32_t last, uint32_t step, uint32_t max_duty);
+
+// Periodic control passes, written by the fan task only
+struct LoopStats {
+    uint32_t passes;
+    uint32_t deadline_misses; // Finished after the deadline or skipped
+    uint32_t max_pass_us; // From the due time to the end of the pass
+    uint32_t stale; // Drives whose data went stale
+    uint32_t failsafe_passes; // Passes with stale data
+};
+extern LoopStats loop_stats;
+
+} // namespace Control_NS
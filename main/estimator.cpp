@@ -0,0 +1,72 @@
+#include "estimator.h"
+
+namespace Filter_NS {
+
+// Riccati recursion until the gains settle. Runs once, so float is fine.
+TrendKalman::TrendKalman(uint32_t interval, float process_noise,
+    float measurement_noise)
+{
+    const float dt = interval / 1000.0f;
+    const float q = process_noise;
+    const float r = measurement_noise;
+    float p00 = r;
+    float p01 = 0.0f;
+    float p11 = 1e-3f; // Rate is not known, (C/s)^2
+    float k0 = 0.0f;
+    float k1 = 0.0f;
+
+    for (uint16_t i = 0; i < 1000; i++) {
+        // Predict: covariance F*P*F' + Q
+        p00 += dt * (2.0f * p01 + dt * p11) + q * dt * dt * dt / 3.0f;
+        p01 += dt * p11 + q * dt * dt / 2.0f;
+        p11 += q * dt;
+        // Correct
+        const float s = p00 + r;
+        k0 = p00 / s;
+        k1 = p01 / s;
+        p11 -= k1 * p01;
+        p01 -= k0 * p01;
+        p00 -= k0 * p00;
+    }
+
+    _k0 = static_cast<int32_t>(k0 * (1L << 16));
+    _k1 = static_cast<int32_t>(k1 * (1L << 16));
+}
+
+Temp_NS::q4_t TrendKalman::update(Temp_NS::q4_t measurement, uint32_t interval)
+{
+    const int32_t measured = static_cast<int32_t>(measurement)
+        << (TEMPERATURE_SHIFT - Temp_NS::Q4_SHIFT);
+
+    if (!_initialized || interval > KALMAN_MAX_INTERVAL) {
+        _temperature = measured;
+        _rate = 0;
+        _initialized = true;
+        return measurement;
+    }
+
+    // Predict: T += rate * dt
+    _temperature += static_cast<int32_t>((static_cast<int64_t>(_rate) * interval / 1000)
+        >> (RATE_SHIFT - TEMPERATURE_SHIFT));
+
+    // Correct: gains are 1/65536, rate gain is per second
+    const int64_t innovation = measured - _temperature;
+    _temperature += static_cast<int32_t>((innovation * _k0) >> 16);
+    _rate += static_cast<int32_t>((innovation * _k1) >> TEMPERATURE_SHIFT);
+
+    return temperature();
+}
+
+Temp_NS::q4_t TrendKalman::temperature(void) const
+{
+    return static_cast<Temp_NS::q4_t>(_temperature >> (TEMPERATURE_SHIFT - Temp_NS::Q4_SHIFT));
+}
+
+Temp_NS::q4_t TrendKalman::predict(uint32_t horizon) const
+{
+    const int64_t ahead = _temperature
+        + ((static_cast<int64_t>(_rate) * horizon) >> (RATE_SHIFT - TEMPERATURE_SHIFT));
+    return static_cast<Temp_NS::q4_t>(ahead >> (TEMPERATURE_SHIFT - Temp_NS::Q4_SHIFT));
+}
+
+} // namespace Filter_NS
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "temperature.h"
+#include <cstdint>
+
+// ======================== Noise parameters ==================================
+// Rate of heating changes as random walk, C^2/s^3. Bigger value follows
+// changes faster, but the rate is noisier.
+#define KALMAN_PROCESS_NOISE 1e-6f
+// Variance of filtered DS18B20 reading, C^2 (0.25 C step at 10 bit)
+#define KALMAN_MEASUREMENT_NOISE 0.02f
+// Interval the gains are computed for, ms (sweep period + conversion)
+#define KALMAN_NOMINAL_INTERVAL 2200
+// Longer pause between measurements restarts the filter, ms
+#define KALMAN_MAX_INTERVAL 300000
+
+namespace Filter_NS {
+
+// 1-D Kalman filter with temperature and its rate as the state (constant
+// rate model). Predicts temperature some seconds ahead, so the fan reacts
+// to heating before the averaged temperature rises.
+// Measurements come with nearly constant interval, so the covariance
+// converges to the steady state. Its gains are found once in the
+// constructor, updates are integer only.
+class TrendKalman {
+protected:
+    int32_t _temperature { 0 }; // 1/256 C
+    int32_t _rate { 0 }; // 1/65536 C/s
+    int32_t _k0 { 0 }; // Temperature gain, 1/65536
+    int32_t _k1 { 0 }; // Rate gain, 1/65536 1/s
+    bool _initialized { false };
+
+public:
+    static constexpr uint8_t TEMPERATURE_SHIFT = 8;
+    static constexpr uint8_t RATE_SHIFT = 16;
+
+    TrendKalman(uint32_t interval = KALMAN_NOMINAL_INTERVAL,
+        float process_noise = KALMAN_PROCESS_NOISE,
+        float measurement_noise = KALMAN_MEASUREMENT_NOISE);
+
+    bool initialized(void) const { return _initialized; }
+    void reset(void) { _initialized = false; }
+    // Measurement taken "interval" ms after the previous one.
+    // Returns filtered temperature.
+    Temp_NS::q4_t update(Temp_NS::q4_t measurement, uint32_t interval);
+
+    Temp_NS::q4_t temperature(void) const;
+    // 1/65536 C/s
+    int32_t rate(void) const { return _rate; }
+    // Temperature "horizon" seconds ahead
+    Temp_NS::q4_t predict(uint32_t horizon) const;
+};
+
+} // namespace Filter_NS
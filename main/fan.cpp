@@ -2,98 +2,345 @@
 
 namespace Fan_NS {
 // =================== FanPWM constructor ==================
-FanPWM::FanPWM(uint8_t& gpio_num, QueueHandle_t* sensor_queue,
-    QueueHandle_t* duty_percent_queue, uint32_t* freq_hz,
-    uint32_t* min_hdd_temp, uint32_t* max_hdd_temp)
-    : _min_temp_hdd(min_hdd_temp)
+FanPWM::FanPWM(Output& output, uint8_t gpio_num, uint8_t zone,
+    QueueHandle_t* duty_percent_queue, uint32_t min_hdd_temp, uint32_t max_hdd_temp)
+    : _zone(zone)
+    , _min_temp_hdd(min_hdd_temp)
     , _max_temp_hdd(max_hdd_temp)
-    , _freq_hz(freq_hz)
-    , _gpio_num { gpio_num }
-    , _max_duty((LOW_SPEED_MODE_TIMER / *_freq_hz) * (2 << (_duty_resolution - 1)))
-    , _sensor_queue { sensor_queue }
+    , _output(output)
     , _duty_percent_queue { duty_percent_queue }
 {
-    // Set timer configuration
-    _timer_conf.duty_resolution = _duty_resolution;
-    _timer_conf.freq_hz = *_freq_hz;
-    _timer_conf.speed_mode = _speed_mode;
-    _timer_conf.timer_num = _timer_num;
-    // Apply timer configuration
-    ledc_timer_config(&_timer_conf);
-
-    // Set channel configuration
-    _led_chanal_conf.channel = _channel;
-    _led_chanal_conf.duty = _duty;
-    _led_chanal_conf.gpio_num = _gpio_num;
-    _led_chanal_conf.speed_mode = _speed_mode;
-    _led_chanal_conf.hpoint = _hpoint;
-    _led_chanal_conf.timer_sel = _timer_num;
-    // Apply channel configuration
-    ledc_channel_config(&_led_chanal_conf);
-    // Initialize service.
-    ledc_fade_func_install(0);
-
-    _duty = _max_duty;
-    ledc_set_duty(_speed_mode, _channel, _duty);
-    ledc_update_duty(_speed_mode, _channel);
+    const esp_err_t err = _output.init(gpio_num);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "LEDC on GPIO%d failed: %s", gpio_num, esp_err_to_name(err));
+    }
+    _duty = _output.max_duty();
+    _last_duty = _duty;
+
+    set_fan_curve("");
 }
 
 // =================== FanPWM member functions ==================
 esp_err_t FanPWM::set_duty(uint32_t duty)
 {
-    ledc_set_fade_with_time(_speed_mode, _channel, duty,
-        5000); // Slow fade for 5 seconds
-    ledc_fade_start(_speed_mode, _channel, LEDC_FADE_NO_WAIT);
+    _output.write(duty); // Slow fade
     _last_duty = duty;
+    ++Control_NS::actuation_stats.actuations;
+    _tach_monitor.commanded(_output.to_percent(duty),
+        static_cast<uint32_t>(esp_timer_get_time() / 1000));
     return ESP_OK;
 };
 
-void FanPWM::start(void)
+void FanPWM::full_power(void)
+{
+    set_duty(_output.max_duty());
+    ESP_LOGI(TAG, "Zone %u: fan is turned on for full power", _zone);
+    _report_duty();
+}
+
+bool FanPWM::_update_duty(uint32_t duty)
+{
+    // A stalled or slow fan gets all it can
+    if (_tach_monitor.health() != Tach_NS::Health::OK) {
+        duty = _output.max_duty();
+    }
+    if (!Control_NS::actuate(duty, _last_duty, _duty_step, _output.max_duty())) {
+        return false;
+    }
+    set_duty(duty);
+    return true;
+}
+
+esp_err_t FanPWM::set_weight(uint8_t sensor_id, uint32_t weight)
+{
+    if (sensor_id >= SENSOR_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _channels[sensor_id].weight = weight;
+    return ESP_OK;
+}
+
+esp_err_t FanPWM::set_curve(uint8_t sensor_id, uint32_t min_temp, uint32_t max_temp)
+{
+    if (sensor_id >= SENSOR_COUNT || min_temp >= max_temp) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _channels[sensor_id].min_temp = min_temp;
+    _channels[sensor_id].max_temp = max_temp;
+    return ESP_OK;
+}
+
+esp_err_t FanPWM::set_fan_curve(const char* points)
+{
+    esp_err_t err = ESP_OK;
+    if (points[0] != '\0') {
+        err = _curve.parse(points);
+        if (err == ESP_OK) {
+            return ESP_OK;
+        }
+        ESP_LOGE(TAG, "Wrong fan curve \"%s\", using %u .. %u C", points,
+            _min_temp_hdd, _max_temp_hdd);
+    }
+    // Linear from min to max temperature, the table is 64 C at most
+    const uint8_t temperatures[] = { static_cast<uint8_t>(_min_temp_hdd),
+        static_cast<uint8_t>(_max_temp_hdd) };
+    const uint8_t duties[] = { 0, 100 };
+    if (_max_temp_hdd > 125 || _curve.set_points(temperatures, duties, 2) != ESP_OK) {
+        _curve.clear(); // Output::linear() is used instead
+    }
+    return err;
+}
+
+void FanPWM::set_hysteresis(uint32_t rise, uint32_t fall)
+{
+    // 1/10 C -> 1/16 C
+    const Temp_NS::q4_t rise_q4 = static_cast<Temp_NS::q4_t>(rise * Temp_NS::Q4_ONE / 10);
+    const Temp_NS::q4_t fall_q4 = static_cast<Temp_NS::q4_t>(fall * Temp_NS::Q4_ONE / 10);
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        _channels[i].hysteresis.set_bands(rise_q4, fall_q4);
+    }
+}
+
+void FanPWM::set_control(control_mode control)
+{
+    // The curves don't follow the temperature under PID, start them again
+    if (control != _control) {
+        for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+            _channels[i].hysteresis.reset();
+        }
+        _pid.reset();
+        _rpm_loop.reset();
+    }
+    _control = control;
+}
+
+esp_err_t FanPWM::set_tach(gpio_num_t gpio_num, uint8_t pulses, uint32_t stall_rpm, uint32_t max_rpm)
+{
+    _tach_counter.stop();
+    _tach_enabled = false;
+    if (pulses == 0) {
+        return ESP_OK;
+    }
+    const esp_err_t err = _tach_counter.start(gpio_num);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Tach on GPIO%d failed: %s", gpio_num, esp_err_to_name(err));
+        return err;
+    }
+    _tach_meter.set_pulses(pulses);
+    _tach_meter.reset();
+    _tach_monitor.set_limits(stall_rpm, max_rpm);
+    _max_rpm = max_rpm;
+    _rpm_loop.set_max_rpm(max_rpm);
+    _tach_enabled = true;
+    return ESP_OK;
+}
+
+void FanPWM::tach(void)
 {
-    // initial value
-    float min = FLT_MAX;
-    float max = -FLT_MAX;
-    float sum = 0.0f;
-    float result = 0.0f;
+    if (!_tach_enabled
+        || !_tach_meter.update(_tach_counter.edges(), Latency_NS::now_us())) {
+        return;
+    }
+    const uint32_t rpm = _tach_meter.rpm();
+    const Tach_NS::Health health_before = _tach_monitor.health();
+    const Tach_NS::Health health = _tach_monitor.update(rpm,
+        static_cast<uint32_t>(esp_timer_get_time() / 1000));
+    Tach_NS::status.rpm = rpm;
+    Tach_NS::status.health = health;
+    Tach_NS::status.windows = Tach_NS::status.windows + 1;
 
-    // Push to buffer
-    for (uint8_t i = 0; i < size; i++) {
-        if (xQueueReceive(*_sensor_queue, &sensor_data, 0) == pdTRUE) {
-            buffer_sensor[i] = sensor_data.temperature;
-            ESP_LOGI(TAG, "Sensor %d temperature %f", sensor_data.sensor_id,
-                sensor_data.temperature);
+    if (health != health_before) {
+        if (health == Tach_NS::Health::OK) {
+            ESP_LOGI(TAG, "Fan recovered, %u rpm", rpm);
+            // The next pass sets the duty again
+            _rpm_loop.reset();
         } else {
-            ESP_LOGE(TAG, "Failed to receive sensor data.");
+            ESP_LOGE(TAG, "Fan %s: %u rpm at %u %% duty, full duty",
+                Tach_NS::health_name(health), rpm, _output.to_percent(_last_duty));
+            Tach_NS::status.alerts = Tach_NS::status.alerts + 1;
+            if (_update_duty(_output.max_duty())) {
+                _report_duty();
+            }
         }
+        return;
     }
-    // Find min, max and sum
-    for (uint8_t i = 0; i < size; i++) {
-        sum += buffer_sensor[i];
-        if (buffer_sensor[i] < min)
-            min = buffer_sensor[i];
-        if (buffer_sensor[i] > max)
-            max = buffer_sensor[i];
+
+    if (health == Tach_NS::Health::OK && _control == control_mode::RPM && _max_rpm && !_failsafe) {
+        const int32_t output = _rpm_loop.update(_rpm_target, rpm, Tach_NS::WINDOW_MS);
+        if (_update_duty(_output.from_pid(output))) {
+            _report_duty();
+        }
+    }
+}
+
+esp_err_t FanPWM::set_failsafe(uint32_t stale_after, uint32_t percent)
+{
+    if (percent > 100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _stale_after = stale_after * 1000000LL;
+    _failsafe_duty = _output.from_percent(percent);
+    return ESP_OK;
+}
+
+void FanPWM::set_pid(uint32_t target, int32_t kp, int32_t ki, int32_t kd)
+{
+    _target = Temp_NS::from_degrees(target);
+    _pid.set_gains(kp, ki, kd);
+    _pid.reset();
+}
+
+uint32_t FanPWM::_common_duty(Temp_NS::q4_t temperature)
+{
+    if (_curve.empty()) {
+        return _output.linear(temperature, _min_temp_hdd, _max_temp_hdd);
+    }
+    return _output.from_curve(_curve.duty(temperature));
+}
+
+bool FanPWM::push(const SensorData_t& sample)
+{
+    if (sample.sensor_id >= SENSOR_COUNT || !(_sensors & (1U << sample.sensor_id))) {
+        return false;
+    }
+    Channel& channel = _channels[sample.sensor_id];
+    channel.average.push(sample.temperature);
+    channel.valid = true;
+    // A kept value is an old conversion
+    if (!(sample.flags & SENSOR_KEPT)) {
+        channel.updated = esp_timer_get_time()
+            - static_cast<uint32_t>(Latency_NS::now_us() - sample.conversion_end);
+    }
+    _pushed = true;
+    return true;
+}
+
+bool FanPWM::control(void)
+{
+    const bool pushed = _pushed;
+    _pushed = false;
+
+    // Aggregate the drives with fresh data
+    const int64_t now = esp_timer_get_time();
+    bool measured = false;
+    bool stale = false;
+    Temp_NS::q4_t hottest = 0;
+    int64_t weighted_sum = 0;
+    uint32_t weights = 0;
+    uint32_t duty = 0;
+    for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
+        Channel& channel = _channels[i];
+        if (!channel.valid) {
+            continue;
+        }
+        if (now - channel.updated > _stale_after) {
+            if (!channel.stale) {
+                ESP_LOGE(TAG, "Zone %u, sensor %d: no data for %u s", _zone, i,
+                    static_cast<uint32_t>((now - channel.updated) / 1000000));
+                ++Control_NS::loop_stats.stale;
+            }
+            channel.stale = true;
+            stale = true;
+            continue;
+        }
+        if (channel.stale) {
+            ESP_LOGI(TAG, "Zone %u, sensor %d: data again", _zone, i);
+            channel.stale = false;
+        }
+        // Curves see the temperature through the hysteresis, PID has its
+        // own dynamics
+        const Temp_NS::q4_t temperature = _control == control_mode::PID
+            ? channel.average.value()
+            : channel.hysteresis.update(channel.average.value());
+        if (!measured || temperature > hottest) {
+            hottest = temperature;
+        }
+        measured = true;
+        weighted_sum += static_cast<int64_t>(temperature) * channel.weight;
+        weights += channel.weight;
+        const uint32_t channel_duty = _output.linear(temperature,
+            channel.min_temp ? channel.min_temp : _min_temp_hdd,
+            channel.max_temp ? channel.max_temp : _max_temp_hdd);
+        if (channel_duty > duty) {
+            duty = channel_duty;
+        }
+    }
+    if (!measured && !stale) {
+        return false;
+    }
+    if (stale != _failsafe) {
+        ESP_LOGW(TAG, "Zone %u: %s", _zone,
+            stale ? "stale data, failsafe duty" : "fresh data, failsafe is off");
+        _failsafe = stale;
+        _rpm_loop.reset();
     }
-    // Subtract min and max from sum
-    sum = sum - min - max;
 
-    // Calculate average
-    result = sum / (size - 2);
     // calculate duty
-    if (result <= *_min_temp_hdd) {
-        _duty = 0;
-    } else if (result >= *_max_temp_hdd) {
-        _duty = _max_duty;
-    } else if (result >= *_min_temp_hdd) {
-        _duty = static_cast<uint32_t>(_max_duty / (*_max_temp_hdd - *_min_temp_hdd)) * (result - *_min_temp_hdd);
+    if (!measured) {
+        _duty = 0; // Only the failsafe
+    } else if (_control == control_mode::RPM && _tach_enabled && _max_rpm) {
+        // The curve's share of the full speed, tach() follows it
+        const uint32_t curve_duty = _mode == aggregation_mode::CURVES ? duty
+            : _common_duty(_mode == aggregation_mode::WEIGHTED && weights
+                      ? static_cast<Temp_NS::q4_t>(weighted_sum / weights)
+                      : hottest);
+        _rpm_target = static_cast<uint32_t>(static_cast<uint64_t>(_max_rpm) * curve_duty / _output.max_duty());
+        Tach_NS::status.target = _rpm_target;
+        if (!_failsafe) {
+            return false;
+        }
+        _duty = curve_duty; // The RPM loop waits for fresh data
+    } else if (_control == control_mode::PID && !pushed) {
+        // Periodic pass, the loop runs on new measurements only
+        _duty = _output.from_pid(_pid.output());
+    } else if (_control == control_mode::PID) {
+        const Temp_NS::q4_t temperature = (_mode == aggregation_mode::WEIGHTED && weights)
+            ? static_cast<Temp_NS::q4_t>(weighted_sum / weights)
+            : hottest;
+        const int32_t output = _pid.update(_target, temperature,
+            static_cast<uint32_t>((now - _last_control) / 1000));
+        _last_control = now;
+        _duty = _output.from_pid(output);
+    } else {
+        switch (_mode) {
+        case aggregation_mode::WEIGHTED:
+            // All weights zero - nothing to weight, use the hottest drive
+            _duty = _common_duty(weights ? static_cast<Temp_NS::q4_t>(weighted_sum / weights) : hottest);
+            break;
+        case aggregation_mode::CURVES:
+            _duty = duty;
+            break;
+        case aggregation_mode::MAX:
+        default:
+            _duty = _common_duty(hottest);
+            break;
+        }
+    }
+
+    if (_failsafe) {
+        ++Control_NS::loop_stats.failsafe_passes;
+        if (_duty < _failsafe_duty) {
+            _duty = _failsafe_duty;
+        }
     }
 
-    // Set duty
-    set_duty(_duty);
+    // Set duty, a small change isn't worth another fade
+    if (!_update_duty(_duty)) {
+        return false;
+    }
+    _report_duty();
+    return true;
+}
 
-    // Send % speed
-    uint8_t persent = (uint8_t)((_duty * 100) / _max_duty);
-    if (xQueueSend(*_duty_percent_queue, &persent, 0) != pdPASS) {
+void FanPWM::_report_duty(void)
+{
+    // Send % speed, the history has one duty series
+    const FanDuty_t duty { _zone, _output.to_percent(_last_duty) };
+    if (_zone == 0) {
+        History_NS::history.append(History_NS::SERIES_DUTY, History_NS::now_s(), duty.percent);
+        Telemetry_NS::record(History_NS::SERIES_DUTY, History_NS::now_s(), duty.percent);
+    }
+    if (xQueueSend(*_duty_percent_queue, &duty, 0) != pdPASS) {
         ESP_LOGE(TAG, "Failed to send duty percent.");
     }
 }
@@ -1,59 +1,157 @@
 #pragma once
 
-#include "driver/ledc.h"
+#include "curve.h"
 #include "esp_event.h"
 #include "esp_log.h" // IWYU pragma: keep
+#include "filters.h"
+#include "history.h"
+#include "telemetry_log.h"
 #include "mqtt.h"
-#include <cfloat> // IWYU pragma: keep
+#include "pid.h"
+#include "pwm.h"
+#include "tach.h"
 #include <cstdint>
 
 namespace Fan_NS {
 
 // Constants
-constexpr uint32_t LOW_SPEED_MODE_TIMER = 8000;
-static constexpr uint8_t NUM_MEAS = 6; // Number of measurements
+static constexpr uint8_t NUM_MEAS = 3; // Averaged measurements of every drive
+static constexpr uint8_t SENSOR_COUNT = 8; // Drives tracked by the controller
+static_assert(SENSOR_COUNT == History_NS::TEMPERATURE_SERIES, "Every drive has a history series");
+static constexpr int32_t RPM_LOOP_KI = 256; // 1 % duty per 100 rpm per second
+// Fixed-period control pass, one tach window long. It must end within the
+// deadline after its due time.
+constexpr uint32_t CONTROL_PERIOD_MS = Tach_NS::WINDOW_MS;
+constexpr uint32_t CONTROL_DEADLINE_MS = 50;
+
+// How temperatures of drives give one duty
+enum class aggregation_mode : uint8_t {
+    MAX = 0, // The hottest drive on the common curve
+    WEIGHTED = 1, // Weighted mean of drives on the common curve
+    CURVES = 2 // Every drive on its own curve, the highest duty wins
+};
+
+// How the duty follows the temperature
+enum class control_mode : uint8_t {
+    CURVE = 0, // Fan curve, by default linear from min to max temperature
+    PID = 1, // Closed loop to the target temperature
+    RPM = 2 // The curve gives a share of the full speed, held by the tach
+};
+
+// Control channel of one drive
+struct Channel {
+    Filter_NS::TrimmedMean<NUM_MEAS, 0, Temp_NS::q4_t, int32_t> average; // Own filtered value
+    bool valid { false }; // Has at least one measurement
+    uint32_t weight { 1 }; // For WEIGHTED mode
+    Control_NS::Hysteresis hysteresis {}; // Temperature on the curves
+    int64_t updated { 0 }; // esp_timer_get_time() of the newest conversion
+    bool stale { false }; // No conversion for the stale time
+    // Curve for CURVES mode, 0 - the common one (min/max HDD temperature)
+    uint32_t min_temp { 0 };
+    uint32_t max_temp { 0 };
+};
 
 class FanPWM {
 
 protected:
-    uint32_t* _min_temp_hdd = nullptr;
-    uint32_t* _max_temp_hdd = nullptr;
-    uint32_t* _freq_hz = nullptr; // LOW MODE - 100 HZ - 1000 HZ
-
-    ledc_mode_t _speed_mode { LEDC_LOW_SPEED_MODE };
-    ledc_timer_bit_t _duty_resolution { LEDC_TIMER_10_BIT };
-    ledc_timer_t _timer_num { LEDC_TIMER_0 };
-    int _gpio_num {}; // GPIO_NUM_13:  gpio_num = 13
-    ledc_channel_t _channel { LEDC_CHANNEL_0 }; // LEDC channel (0 - 7)
-    int _hpoint { 0 };
-    uint32_t _duty { 0 }; // range of duty setting is [0, (2**duty_resolution)]
-    const uint32_t _max_duty;
-
-    ledc_timer_config_t _timer_conf; // timer configuration variable
-    ledc_channel_config_t _led_chanal_conf; // channel configuration variable
+    const uint8_t _zone; // Zone::id, zone 0 has the duty history
+    // Common curve range, C
+    const uint32_t _min_temp_hdd;
+    const uint32_t _max_temp_hdd;
+
+    Output& _output; // LEDC channel and its duty math
+    uint32_t _duty { 0 }; // range of duty setting is [0, _output.max_duty()]
 
     uint32_t _last_duty { 0 }; // last set duty
     bool _fan_is_on { false }; // Was the fan turned on
+    uint32_t _duty_step { 0 }; // Smaller changes of the duty are skipped
 
-    QueueHandle_t* _sensor_queue { nullptr }; // sensor queue
     QueueHandle_t* _duty_percent_queue { nullptr }; // current duty queue
 
-    SensorData_t sensor_data {};
-    // Buffer for average data
-    float buffer_sensor[NUM_MEAS] {};
-    size_t size = sizeof(buffer_sensor) / sizeof(float);
+    uint8_t _sensors { 0xFF }; // Drives of the zone, bit N - sensor N
+    bool _pushed { false }; // Samples since the last pass
+    // Every drive keeps its own value, so a cool drive doesn't hide a hot one
+    Channel _channels[SENSOR_COUNT] {};
+    aggregation_mode _mode { aggregation_mode::MAX };
+
+    // PID follows the hottest drive or the weighted mean in WEIGHTED mode
+    control_mode _control { control_mode::CURVE };
+    Control_NS::Pid _pid { 0, 0, 0 };
+    Temp_NS::q4_t _target { 0 };
+    int64_t _last_control { 0 }; // esp_timer_get_time() of the last PID update
+
+    // Common curve of MAX and WEIGHTED modes
+    Control_NS::Curve _curve {};
+
+    // Tachometer, RPM mode and stall detection
+    bool _tach_enabled { false };
+    Tach_NS::Counter _tach_counter {};
+    Tach_NS::Meter _tach_meter {};
+    Tach_NS::Monitor _tach_monitor {};
+    uint32_t _max_rpm { 0 };
+    uint32_t _rpm_target { 0 };
+    Control_NS::RpmLoop _rpm_loop { 0, RPM_LOOP_KI };
+
+    // Stale data of any drive holds the fan at least at the failsafe duty
+    int64_t _stale_after { 60000000 }; // us
+    uint32_t _failsafe_duty { 0 };
+    bool _failsafe { false };
+
+    // Duty for temperature on the common curve
+    uint32_t _common_duty(Temp_NS::q4_t temperature);
+    // Set the duty unless it's the same or closer than the duty step to the
+    // last one. Returns true if LEDC was updated.
+    bool _update_duty(uint32_t duty);
+    // History, telemetry and MQTT of the applied duty
+    void _report_duty(void);
 
 public:
-    // Constructor
-    FanPWM(uint8_t& gpio_num, QueueHandle_t* sensor_queue,
-        QueueHandle_t* duty_percent_queue, uint32_t* freq_hz,
-        uint32_t* min_temp_hdd, uint32_t* max_temp_hdd);
+    // Constructor, the fan of "zone" starts at full duty on "gpio_num"
+    FanPWM(Output& output, uint8_t gpio_num, uint8_t zone,
+        QueueHandle_t* duty_percent_queue, uint32_t min_temp_hdd, uint32_t max_temp_hdd);
 
     // Setting duty and frequency
     esp_err_t set_duty(uint32_t duty);
+    void set_duty_step(uint8_t percent) { _duty_step = _output.from_percent(percent); }
     esp_err_t set_freq(uint32_t freq_hz); // NOTE:ESP8266 does not support
-    uint32_t get_max_duty(void) { return _max_duty; }
-    void start(void);
+    uint32_t get_max_duty(void) { return _output.max_duty(); }
+    // Full duty, reported at once
+    void full_power(void);
+
+    // Aggregation of drives and its parameters
+    void set_sensors(uint8_t sensors) { _sensors = sensors; }
+    void set_mode(aggregation_mode mode) { _mode = mode; }
+    esp_err_t set_weight(uint8_t sensor_id, uint32_t weight);
+    esp_err_t set_curve(uint8_t sensor_id, uint32_t min_temp, uint32_t max_temp);
+    // Common curve "temperature:duty,..." (see Control_NS::Curve), empty or
+    // wrong - linear from min to max temperature
+    esp_err_t set_fan_curve(const char* points);
+    // Hysteresis of the curves in 1/10 C
+    void set_hysteresis(uint32_t rise, uint32_t fall);
+
+    // Closed loop: target in C, gains in 1/100 (see Control_NS::Pid)
+    void set_control(control_mode control);
+    void set_pid(uint32_t target, int32_t kp, int32_t ki, int32_t kd);
+
+    // Tach on "gpio_num" with "pulses" per revolution, 0 - no tach. Below
+    // "stall_rpm" the fan is stalled, "max_rpm" is the speed at 100 % duty.
+    esp_err_t set_tach(gpio_num_t gpio_num, uint8_t pulses, uint32_t stall_rpm, uint32_t max_rpm);
+    bool tach_enabled(void) const { return _tach_enabled; }
+    // Once a Tach_NS::WINDOW_MS: measure the speed, check the fan health and
+    // run the RPM loop. A stalled or slow fan is held at full duty.
+    void tach(void);
+
+    // A drive without a new conversion for "stale_after" seconds is left
+    // out and the duty is at least "percent", over 100 is an error
+    esp_err_t set_failsafe(uint32_t stale_after, uint32_t percent);
+
+    // Estimate of a drive, returns false if it isn't one of the zone
+    bool push(const SensorData_t& sample);
+    // Set the duty from the pushed measurements. Nothing is changed until
+    // at least one drive is measured. Runs on every sample and every
+    // CONTROL_PERIOD_MS, so stale data is found without new samples.
+    // Returns true if LEDC was updated.
+    bool control(void);
     constexpr static const char* TAG = "FanPWM";
 };
 
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Streaming filters for sensor values. Sizes are template parameters, so
+// all storage is inside the object and nothing is allocated.
+namespace Filter_NS {
+
+// ========================= Ring buffer ======================================
+// Last N values, index 0 is the oldest one
+template <typename T, size_t N>
+class RingBuffer {
+    static_assert(N > 0, "RingBuffer needs at least one element");
+
+protected:
+    T _data[N] {};
+    size_t _head { 0 }; // Position of the next write
+    size_t _size { 0 };
+
+public:
+    static constexpr size_t capacity(void) { return N; }
+    size_t size(void) const { return _size; }
+    bool full(void) const { return _size == N; }
+    void clear(void)
+    {
+        _head = 0;
+        _size = 0;
+    }
+
+    // Returns value pushed out of the full buffer
+    T push(const T& value)
+    {
+        T removed = _data[_head];
+        _data[_head] = value;
+        _head = (_head + 1) % N;
+        if (_size < N) {
+            ++_size;
+            removed = T();
+        }
+        return removed;
+    }
+
+    const T& operator[](size_t index) const
+    {
+        return _data[(_head + N - _size + index) % N];
+    }
+    const T& oldest(void) const { return (*this)[0]; }
+    const T& newest(void) const { return (*this)[_size - 1]; }
+};
+
+// ======================== Sorted window =====================================
+// Last N values kept in order of arrival and sorted. Position in the sorted
+// array is found with binary search. The new value takes the slot of the one
+// leaving the window and moves only past the values between them, so a push
+// is O(log N) plus that distance, O(N) at worst. The windows here are a few
+// values long, a tree or a skip list would cost more than it saves.
+template <typename T, size_t N>
+class SortedWindow {
+protected:
+    RingBuffer<T, N> _ring;
+    T _sorted[N] {};
+
+    // First position among "count" sorted values not less than "value"
+    size_t _lower_bound(const T& value, size_t count) const
+    {
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            if (_sorted[middle] < value) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+public:
+    size_t size(void) const { return _ring.size(); }
+    bool full(void) const { return _ring.full(); }
+    void clear(void) { _ring.clear(); }
+    const RingBuffer<T, N>& ring(void) const { return _ring; }
+    // "index" 0 is the smallest value
+    const T& sorted(size_t index) const { return _sorted[index]; }
+
+    void push(const T& value)
+    {
+        size_t size = _ring.size();
+        if (!_ring.full()) {
+            _ring.push(value);
+            size_t position = _lower_bound(value, size);
+            for (size_t i = size; i > position; i--) {
+                _sorted[i] = _sorted[i - 1];
+            }
+            _sorted[position] = value;
+            return;
+        }
+
+        // Replace the value leaving the window
+        size_t position = _lower_bound(_ring.oldest(), size);
+        _ring.push(value);
+        while (position > 0 && value < _sorted[position - 1]) {
+            _sorted[position] = _sorted[position - 1];
+            --position;
+        }
+        while (position + 1 < size && _sorted[position + 1] < value) {
+            _sorted[position] = _sorted[position + 1];
+            ++position;
+        }
+        _sorted[position] = value;
+    }
+};
+
+// ======================== Median filter =====================================
+// Median of the last N values. For even count it's the mean of two middle
+// values.
+template <size_t N, typename T = float>
+class MedianFilter {
+protected:
+    SortedWindow<T, N> _window;
+
+public:
+    size_t size(void) const { return _window.size(); }
+    bool full(void) const { return _window.full(); }
+    void clear(void) { _window.clear(); }
+
+    // Returns median after the new value
+    T push(const T& value)
+    {
+        _window.push(value);
+        return this->value();
+    }
+
+    T value(void) const
+    {
+        size_t size = _window.size();
+        if (size == 0) {
+            return T();
+        }
+        if (size % 2) {
+            return _window.sorted(size / 2);
+        }
+        return (_window.sorted(size / 2 - 1) + _window.sorted(size / 2)) / 2;
+    }
+};
+
+// ======================== Trimmed mean ======================================
+// Mean of the last N values without K smallest and K largest ones. Sum is
+// updated on every push, only 2*K values are subtracted on read. It's
+// recounted once per N pushes, so float rounding doesn't accumulate.
+template <size_t N, size_t K, typename T = float, typename Sum = T>
+class TrimmedMean {
+    static_assert(N > 2 * K, "TrimmedMean drops more values than it keeps");
+
+protected:
+    SortedWindow<T, N> _window;
+    Sum _sum {};
+    size_t _pushes { 0 }; // Since the last recount
+
+public:
+    size_t size(void) const { return _window.size(); }
+    bool full(void) const { return _window.full(); }
+    void clear(void)
+    {
+        _window.clear();
+        _sum = Sum();
+        _pushes = 0;
+    }
+
+    void push(const T& value)
+    {
+        if (_window.full()) {
+            _sum -= _window.ring().oldest();
+        }
+        _window.push(value);
+        _sum += value;
+
+        if (++_pushes == N) {
+            _pushes = 0;
+            _sum = Sum();
+            for (size_t i = 0; i < _window.size(); i++) {
+                _sum += _window.ring()[i];
+            }
+        }
+    }
+
+    // Until the window is full, values are trimmed only if enough of them
+    T value(void) const
+    {
+        size_t size = _window.size();
+        if (size == 0) {
+            return T();
+        }
+        if (size <= 2 * K) {
+            return static_cast<T>(_sum / static_cast<Sum>(size));
+        }
+        Sum sum = _sum;
+        for (size_t i = 0; i < K; i++) {
+            sum -= _window.sorted(i);
+            sum -= _window.sorted(size - 1 - i);
+        }
+        return static_cast<T>(sum / static_cast<Sum>(size - 2 * K));
+    }
+};
+
+// ================ Exponential moving average ================================
+// y += alpha * (x - y), alpha = Num / Den. Template arguments can't be float
+// in C++11, so alpha is a ratio. The first value initializes the average.
+// Integer values are averaged with EMA_FRACTION_BITS more bits: whole units
+// would truncate every step below Den / Num to zero, and the average would
+// stop that far from a steady input.
+#define EMA_FRACTION_BITS 16
+template <uint16_t Num, uint16_t Den, typename T = float>
+class Ema {
+    static_assert(Num > 0 && Num <= Den, "Ema alpha must be in (0, 1]");
+    typedef typename std::is_integral<T>::type fixed_point;
+    static_assert(!fixed_point::value || sizeof(T) <= 2, "Ema averages integers of up to 16 bits");
+    typedef typename std::conditional<fixed_point::value, int64_t, T>::type Acc;
+
+protected:
+    Acc _average {};
+    bool _initialized { false };
+
+    static Acc _from(const T& value, std::true_type)
+    {
+        return static_cast<Acc>(value) * (1LL << EMA_FRACTION_BITS);
+    }
+    static Acc _from(const T& value, std::false_type) { return value; }
+    // Step rounded to nearest, so it's zero only within half a fraction unit
+    static Acc _step(Acc error, std::true_type)
+    {
+        const Acc scaled = error * Num;
+        return (scaled >= 0 ? scaled + Den / 2 : scaled - Den / 2) / Den;
+    }
+    static Acc _step(Acc error, std::false_type)
+    {
+        return error * static_cast<T>(Num) / static_cast<T>(Den);
+    }
+    static T _to(Acc average, std::true_type)
+    {
+        return static_cast<T>((average + (1LL << (EMA_FRACTION_BITS - 1))) >> EMA_FRACTION_BITS);
+    }
+    static T _to(Acc average, std::false_type) { return average; }
+
+public:
+    bool initialized(void) const { return _initialized; }
+    void clear(void) { _initialized = false; }
+
+    T push(const T& value)
+    {
+        const Acc input = _from(value, fixed_point());
+        if (!_initialized) {
+            _average = input;
+            _initialized = true;
+        } else {
+            _average += _step(input - _average, fixed_point());
+        }
+        return this->value();
+    }
+
+    T value(void) const { return _to(_average, fixed_point()); }
+};
+
+} // namespace Filter_NS
@@ -4,6 +4,17 @@
 #include "esp_log.h"
 #include "projdefs.h"
 #include "rom/ets_sys.h"
+#include <cstring>
+
+// Slot timing instrumentation
+#if ONEWIRE_SLOT_STATS && ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+#define ONEWIRE_SLOT_BEGIN() const uint32_t slot_start = cycle_count()
+#define ONEWIRE_SLOT_END(stats) stats.add(cycle_count() - slot_start)
+#else
+#define ONEWIRE_SLOT_BEGIN()
+#define ONEWIRE_SLOT_END(stats)
+#endif
+
 /*
  * TODO:
  *
@@ -13,6 +24,179 @@
  */
 namespace OneWire {
 
+// ============================ CRC8 ==========================================
+// Nibble tables for reflected polynomial 0x8C, 32 bytes instead of 256
+static const uint8_t crc8_low[16] = {
+    0x00, 0x5E, 0xBC, 0xE2, 0x61, 0x3F, 0xDD, 0x83,
+    0xC2, 0x9C, 0x7E, 0x20, 0xA3, 0xFD, 0x1F, 0x41
+};
+static const uint8_t crc8_high[16] = {
+    0x00, 0x9D, 0x23, 0xBE, 0x46, 0xDB, 0x65, 0xF8,
+    0x8C, 0x11, 0xAF, 0x32, 0xCA, 0x57, 0xE9, 0x74
+};
+
+uint8_t crc8(const uint8_t* data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t index = crc ^ *data++;
+        crc = crc8_low[index & 0x0F] ^ crc8_high[index >> 4];
+    }
+    return crc;
+}
+
+bool check_rom(const uint8_t (&address)[8])
+{
+    // All zeros has valid CRC, but it's a shorted bus
+    return address[0] != 0 && crc8(address, 7) == address[7];
+}
+
+static bool contains(const uint8_t (*roms)[8], uint8_t count, const uint8_t (&rom)[8])
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (memcmp(roms[i], rom, 8) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint8_t merge_roms(uint8_t (*known)[8], uint8_t known_count, const uint8_t (*found)[8],
+    uint8_t found_count, uint8_t max_count, bool keep_missing)
+{
+    bool missing[ONEWIRE_MAX_DEVICES] = { false };
+    if (max_count > ONEWIRE_MAX_DEVICES) {
+        max_count = ONEWIRE_MAX_DEVICES;
+    }
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < known_count && count < max_count; i++) {
+        const bool present = contains(found, found_count, known[i]);
+        if (!present && !keep_missing) {
+            continue;
+        }
+        memmove(known[count], known[i], 8);
+        missing[count++] = !present;
+    }
+
+    uint8_t reused = 0; // Slots of missing devices are searched from here
+    for (uint8_t j = 0; j < found_count; j++) {
+        if (contains(known, count, found[j])) {
+            continue;
+        }
+        if (count < max_count) {
+            memcpy(known[count++], found[j], 8);
+            continue;
+        }
+        while (reused < count && !missing[reused]) {
+            ++reused;
+        }
+        if (reused == count) {
+            break; // Every slot has a device
+        }
+        memcpy(known[reused], found[j], 8);
+        missing[reused] = false;
+    }
+    return count;
+}
+
+// Temperature from validated scratchpad
+esp_err_t decode_temp(uint8_t family, const uint8_t (&data)[9], Temp_NS::q4_t& temperature)
+{
+    // Convert the data to actual temperature
+    // because the result is a 16 bit signed integer, it should
+    // be stored to an "int16_t" type, which is always 16 bits
+    // even when compiled on a 32 bit processor.
+    int16_t raw = (data[1] << 8) | data[0];
+
+    // Power on value, device was reset and conversion did not happen
+    if ((0x10 == family && raw == (POWER_ON_TEMPERATURE >> 3))
+        || (0x10 != family && raw == POWER_ON_TEMPERATURE)) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (0x10 == family) {
+        raw = raw << 3; // 9 bit resolution default
+        if (data[7] == 0x10) {
+            // "count remain" gives full 12 bit resolution
+            raw = (raw & 0xFFF0) + 12 - data[6];
+        }
+    } else {
+        uint8_t cfg = (data[4] & 0x60);
+        // at lower res, the low bits are undefined, so let's zero them
+        if (cfg == 0x00)
+            raw = raw & ~7; // 9 bit resolution, 93.75 ms
+        else if (cfg == 0x20)
+            raw = raw & ~3; // 10 bit res, 187.5 ms
+        else if (cfg == 0x40)
+            raw = raw & ~1; // 11 bit res, 375 ms
+                            //// default is 12 bit resolution, 750 ms
+                            // conversion time
+    }
+    temperature = raw; // Q12.4 is the native format
+    return ESP_OK;
+}
+
+uint8_t decode_resolution(uint8_t family, const uint8_t (&data)[9])
+{
+    if (0x10 == family) {
+        return MAX_RESOLUTION;
+    }
+    // Bits 5-6 of configuration register: 0 - 9 bit ... 3 - 12 bit
+    return MIN_RESOLUTION + ((data[4] >> 5) & 0x03);
+}
+
+#if ONEWIRE_BACKEND != ONEWIRE_BACKEND_GPIO
+// ========================= Initialization ===============================
+// Time slots are generated by the backend, GPIO functions are not used
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+DS18B20::DS18B20(const uart_port_t port)
+    : _pin { GPIO_NUM_MAX }
+    , _bus { port }
+#else
+DS18B20::DS18B20(const uint8_t virtual_devices)
+    : _pin { GPIO_NUM_MAX }
+    , _bus { virtual_devices }
+#endif
+{
+    _is_initialized = (_bus.init() == ESP_OK);
+};
+
+// ========================= 1-Wire ===========================================
+// Reset signal
+esp_err_t DS18B20::reset(void)
+{
+    if (_is_initialized == false) {
+        ESP_LOGE(TAG, "Onewire reset fail. Onewire not initialized.");
+        return ESP_ERR_INVALID_STATE;
+    }
+    return _bus.reset();
+}
+
+// Write bit
+void DS18B20::write_bit(uint8_t bit)
+{
+    _bus.touch_bit(bit);
+}
+
+// Write byte
+void DS18B20::write_byte(uint8_t byte)
+{
+    _bus.touch_byte(byte);
+}
+
+// Read bit
+uint8_t DS18B20::read_bit(void)
+{
+    return _bus.touch_bit(1);
+}
+
+// Read byte
+uint8_t DS18B20::read_byte(void)
+{
+    return _bus.touch_byte(0xFF);
+}
+
+#else
 // ========================= Initialization ===============================
 // Constructor by default for GPIO
 DS18B20::DS18B20(const gpio_num_t pin)
@@ -26,12 +210,24 @@ DS18B20::DS18B20(const gpio_num_t pin, const bool invert_logic)
     : DS18B20(pin)
 {
     _invert_logic = invert_logic;
+#if ONEWIRE_FAST_GPIO
+    if (_invert_logic != ONEWIRE_INVERT_LOGIC) {
+        ESP_LOGE(TAG, "Onewire fast GPIO is built with other logic inversion.");
+        _is_initialized = false;
+    }
+#endif
 };
 
 // Initialization of the GPIO pin
 esp_err_t DS18B20::_init_one_wire_gpio(void)
 {
     ESP_LOGI(TAG, "Onewire initialization begin.");
+#if ONEWIRE_FAST_GPIO
+    if (_pin != ONEWIRE_GPIO_PIN) {
+        ESP_LOGE(TAG, "Onewire fast GPIO is built for GPIO%d.", ONEWIRE_GPIO_PIN);
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
     // Configuration of the GPIO pin
     config.pin_bit_mask = 1ULL << _pin; // Bit mask for the pin
     config.pull_up_en = GPIO_PULLUP_DISABLE; // Because of pull-up resistor is
@@ -85,10 +281,93 @@ uint8_t DS18B20::get_pin_level(void)
 };
 
 // ========================= 1-Wire ===========================================
+#if ONEWIRE_FAST_GPIO
+typedef FastPin<ONEWIRE_GPIO_PIN, ONEWIRE_INVERT_LOGIC> Pin;
+
+// Reset signal
+esp_err_t IRAM_ATTR DS18B20::reset(void)
+{
+    if (_is_initialized == false) {
+        ESP_LOGE(TAG, "Onewire reset fail. Onewire not initialized.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Check if not set up pull-up resistor
+    Pin::input();
+    if (Pin::get() != 1) {
+        ESP_LOGE(TAG, "Onewire reset fail. Bus is busy.");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    // Reset condition
+    Pin::set(0);
+    Pin::output();
+    taskENTER_CRITICAL();
+    os_delay_us(MASTER_RESET_PULSE_DURATION);
+    Pin::set(1);
+
+    // Check presence
+    Pin::input();
+    os_delay_us(BUS_RECOVERY_DURATION);
+    uint8_t response_time = 0;
+    while (Pin::get() == 1) {
+        if (response_time > SLAVE_RESPONSE_MAX_DURATION) {
+            taskEXIT_CRITICAL();
+            ESP_LOGE(TAG, "Onewire reset fail. Timeout exceeded.");
+            return ESP_ERR_TIMEOUT;
+        }
+        ++response_time;
+        os_delay_us(1);
+    }
+    taskEXIT_CRITICAL();
+    os_delay_us(RECOVERY_AFTER_RESET_PULSE);
+    return ESP_OK;
+}
+
+// Write bit
+void IRAM_ATTR DS18B20::write_bit(uint8_t bit)
+{
+    const uint32_t pulse = bit ? MASTER_WRITE_1_PULSE_DURATION : MASTER_WRITE_0_PULSE_DURATION;
+    const uint32_t recovery = bit ? MASTER_WRITE_1_RECOVERY_DURATION : MASTER_WRITE_0_RECOVERY_DURATION;
+
+    taskENTER_CRITICAL();
+    Pin::output();
+    ets_delay_us(PAUSE_BETWEEN_TIME_SLOTS);
+    ONEWIRE_SLOT_BEGIN();
+    Pin::set(0);
+    ets_delay_us(pulse);
+    Pin::set(1);
+    if (bit) {
+        ONEWIRE_SLOT_END(_write_stats);
+    }
+    ets_delay_us(recovery);
+    taskEXIT_CRITICAL();
+}
+
+// Read bit
+uint8_t IRAM_ATTR DS18B20::read_bit(void)
+{
+    taskENTER_CRITICAL();
+    Pin::output();
+    ets_delay_us(BUS_RECOVERY_DURATION);
+    ONEWIRE_SLOT_BEGIN();
+    Pin::set(0);
+    os_delay_us(MASTER_READ_PULSE_DURATION);
+    Pin::set(1);
+    ONEWIRE_SLOT_END(_read_stats);
+    Pin::input();
+    os_delay_us(MASTER_READ_SAMPLE);
+    uint8_t bit = Pin::get();
+    taskEXIT_CRITICAL();
+    os_delay_us(MASTER_READ_RECOVERY_DURATION);
+    return bit;
+}
+
+#else
 // Reset signal
 esp_err_t DS18B20::reset(void)
 {
-    ESP_LOGI(TAG, "Onewire reset begin.");
+    ESP_LOGD(TAG, "Onewire reset begin.");
     if (_is_initialized == false) {
         ESP_LOGE(TAG, "Onewire reset fail. Onewire not initialized.");
         return ESP_ERR_INVALID_STATE;
@@ -114,6 +393,7 @@ esp_err_t DS18B20::reset(void)
     uint8_t response_time = 0;
     while (get_pin_level() == 1) {
         if (response_time > SLAVE_RESPONSE_MAX_DURATION) {
+            taskEXIT_CRITICAL();
             ESP_LOGE(TAG, "Onewire reset fail. Timeout exceeded.");
             return ESP_ERR_TIMEOUT;
         }
@@ -122,20 +402,25 @@ esp_err_t DS18B20::reset(void)
     }
     taskEXIT_CRITICAL();
     os_delay_us(RECOVERY_AFTER_RESET_PULSE);
-    ESP_LOGI(TAG, "Onewire reset success.");
+    ESP_LOGD(TAG, "Onewire reset success.");
     return ESP_OK;
 }
 
 // Write bit
 void DS18B20::write_bit(uint8_t bit)
 {
+    if (!_is_output) {
+        pin_direction(GPIO_MODE_OUTPUT);
+    }
     taskENTER_CRITICAL();
     if (bit) {
         // bit is 1
         ets_delay_us(PAUSE_BETWEEN_TIME_SLOTS);
+        ONEWIRE_SLOT_BEGIN();
         set_level(0);
         ets_delay_us(MASTER_WRITE_1_PULSE_DURATION);
         set_level(1);
+        ONEWIRE_SLOT_END(_write_stats);
         ets_delay_us(MASTER_WRITE_1_RECOVERY_DURATION);
     } else {
         // bit is 0
@@ -148,27 +433,17 @@ void DS18B20::write_bit(uint8_t bit)
     taskEXIT_CRITICAL();
 }
 
-// Write byte
-void DS18B20::write_byte(uint8_t byte)
-{
-    pin_direction(GPIO_MODE_OUTPUT);
-    ets_delay_us(BUS_RECOVERY_DURATION);
-
-    for (uint8_t i = 0; i < 8; i++) {
-        write_bit(byte & 0x01);
-        byte >>= 1;
-    }
-}
-
 // Read bit
 uint8_t DS18B20::read_bit(void)
 {
     taskENTER_CRITICAL();
     pin_direction(GPIO_MODE_OUTPUT);
     ets_delay_us(BUS_RECOVERY_DURATION);
+    ONEWIRE_SLOT_BEGIN();
     set_level(0);
     os_delay_us(MASTER_READ_PULSE_DURATION);
     set_level(1);
+    ONEWIRE_SLOT_END(_read_stats);
     pin_direction(GPIO_MODE_INPUT);
     os_delay_us(MASTER_READ_SAMPLE);
     uint8_t bit = get_pin_level();
@@ -176,9 +451,24 @@ uint8_t DS18B20::read_bit(void)
     os_delay_us(MASTER_READ_RECOVERY_DURATION);
     return bit;
 }
+#endif // ONEWIRE_FAST_GPIO
+
+// Write byte
+void IRAM_ATTR DS18B20::write_byte(uint8_t byte)
+{
+#if !ONEWIRE_FAST_GPIO
+    pin_direction(GPIO_MODE_OUTPUT);
+#endif
+    ets_delay_us(BUS_RECOVERY_DURATION);
+
+    for (uint8_t i = 0; i < 8; i++) {
+        write_bit(byte & 0x01);
+        byte >>= 1;
+    }
+}
 
 // Read byte
-uint8_t DS18B20::read_byte(void)
+uint8_t IRAM_ATTR DS18B20::read_byte(void)
 {
     uint8_t byte = 0;
     for (uint8_t i = 0; i < 8; i++) {
@@ -187,9 +477,28 @@ uint8_t DS18B20::read_byte(void)
 
     return byte;
 }
+#endif // ONEWIRE_BACKEND
 
-// Read ROM
-esp_err_t DS18B20::readROM(void)
+// Search triplet: read bit and its complement, then write chosen direction.
+// Returns bit 0 - id bit, bit 1 - complement bit, bit 2 - taken direction.
+uint8_t DS18B20::triplet(uint8_t direction)
+{
+    uint8_t id_bit = read_bit();
+    uint8_t cmp_bit = read_bit();
+
+    if (id_bit != cmp_bit) {
+        // All devices have the same bit in this position
+        direction = id_bit;
+    }
+    if (!(id_bit && cmp_bit)) {
+        write_bit(direction);
+    }
+
+    return id_bit | (cmp_bit << 1) | (direction << 2);
+}
+
+// Read ROM. Works only with one device on the bus.
+esp_err_t DS18B20::readROM(uint8_t (&address)[8])
 {
     ESP_LOGI(TAG, "Read ROM command begin.");
     if (ESP_OK != reset()) {
@@ -197,31 +506,112 @@ esp_err_t DS18B20::readROM(void)
         return ESP_FAIL;
     }
     write_byte(READ_ROM); // READ ROM command
-    // ets_delay_us(TIME_SLOT_START_DURATION);
-    uint8_t buf[8] = { 0 };
 
     for (uint8_t i = 0; i < 8; i++) {
-        buf[i] = read_byte();
+        address[i] = read_byte();
     }
 
-    printf("Address ROM: { ");
-    for (uint8_t i = 0; i < 8; ++i) {
-        if (i == 7) {
-            printf("0x%02x", buf[i]);
-        } else {
-            printf("0x%02x, ", buf[i]);
-        }
+    if (!check_rom(address)) {
+        ++_crc_errors;
+        ESP_LOGE(TAG, "Read ROM CRC mismatch.");
+        return ESP_ERR_INVALID_CRC;
     }
-    printf(" },\n");
 
     ESP_LOGI(TAG, "Read ROM command success.");
     return ESP_OK;
 }
 
+// Search ROM. Every pass resolves one device going through the binary tree
+// of ROM codes, the last discrepancy tells where to branch next time.
+esp_err_t DS18B20::search_rom(uint8_t (*addresses)[8], uint8_t max_count,
+    uint8_t& count, uint8_t command)
+{
+    uint8_t rom[8] = { 0 };
+    uint8_t last_discrepancy = 0;
+    bool last_device = false;
+    uint8_t errors = 0;
+
+    count = 0;
+    while (!last_device && count < max_count) {
+        // Path of the last good pass, a failed pass overwrites bits of "rom"
+        uint8_t path[8];
+        memcpy(path, rom, sizeof(rom));
+        const uint8_t path_discrepancy = last_discrepancy;
+
+        if (ESP_OK != reset()) {
+            // No presence pulse - no devices
+            return count ? ESP_OK : ESP_ERR_NOT_FOUND;
+        }
+        write_byte(command);
+
+        uint8_t last_zero = 0;
+        bool no_response = false;
+        for (uint8_t bit_number = 1; bit_number <= 64; bit_number++) {
+            uint8_t byte = (bit_number - 1) / 8;
+            uint8_t mask = 1 << ((bit_number - 1) % 8);
+
+            // Direction for discrepancy: repeat previous path before the
+            // last discrepancy, take 1 on it and 0 after it
+            uint8_t direction;
+            if (bit_number < last_discrepancy) {
+                direction = (rom[byte] & mask) ? 1 : 0;
+            } else {
+                direction = (bit_number == last_discrepancy) ? 1 : 0;
+            }
+
+            uint8_t result = triplet(direction);
+            if ((result & 0x03) == 0x03) {
+                // Nobody answered. On the first bit it means there are no
+                // devices for this command (e.g. no alarms).
+                if (bit_number == 1) {
+                    return count ? ESP_OK : ESP_ERR_NOT_FOUND;
+                }
+                no_response = true;
+                break;
+            }
+            if ((result & 0x03) == 0x00 && !(result & 0x04)) {
+                last_zero = bit_number;
+            }
+
+            if (result & 0x04) {
+                rom[byte] |= mask;
+            } else {
+                rom[byte] &= ~mask;
+            }
+        }
+
+        if (no_response || !check_rom(rom)) {
+            ++_crc_errors;
+            // Restart the same pass a few times along the good path
+            if (++errors >= ONEWIRE_RETRIES) {
+                ESP_LOGE(TAG, "Search ROM failed.");
+                return ESP_ERR_INVALID_CRC;
+            }
+            memcpy(rom, path, sizeof(rom));
+            last_discrepancy = path_discrepancy;
+            continue;
+        }
+
+        memcpy(addresses[count], rom, sizeof(rom));
+        ++count;
+        ESP_LOGI(TAG, "Found device %d: %02x %02x %02x %02x %02x %02x %02x %02x",
+            count, rom[0], rom[1], rom[2], rom[3], rom[4], rom[5], rom[6], rom[7]);
+
+        last_discrepancy = last_zero;
+        last_device = (last_discrepancy == 0);
+    }
+
+    return count ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
 // Match ROM
 esp_err_t DS18B20::match_rom(uint8_t (&address)[8])
 {
-    ESP_LOGI(TAG, "Match ROM command begin.");
+    ESP_LOGD(TAG, "Match ROM command begin.");
+    if (!check_rom(address)) {
+        ESP_LOGE(TAG, "Invalid ROM address.");
+        return ESP_ERR_INVALID_ARG;
+    }
     if (ESP_OK != reset()) {
         ESP_LOGE(TAG, "Reset failed in read ROM command.");
         return ESP_FAIL;
@@ -233,51 +623,381 @@ esp_err_t DS18B20::match_rom(uint8_t (&address)[8])
         write_byte(address[i]);
     }
 
-    ESP_LOGI(TAG, "Match ROM command success.");
+    ESP_LOGD(TAG, "Match ROM command success.");
     return ESP_OK;
 }
 
-// Get temperature
-esp_err_t DS18B20::get_temp(uint8_t (&address)[8], float& temperature)
+// Skip ROM
+esp_err_t DS18B20::skip_rom(void)
 {
+    if (ESP_OK != reset()) {
+        ESP_LOGE(TAG, "Reset failed in skip ROM command.");
+        return ESP_FAIL;
+    }
+
+    write_byte(SKIP_ROM); // SKIP ROM command
+    return ESP_OK;
+}
+
+// ========================= Temperature ======================================
+// Start temperature conversion of one device
+esp_err_t DS18B20::start_conversion(uint8_t (&address)[8])
+{
+    _conversion_state = conversion_state::IDLE;
+    if (ESP_OK != match_rom(address)) { // Set address
+        return ESP_FAIL;
+    }
 
-    match_rom(address); // Set address
     write_byte(CONVERT_T); // Convert temperature
-    vTaskDelay(pdMS_TO_TICKS(WAIT_FOR_TEMPERATURE_CONVERSION));
+    _conversion_start = _now();
+    _conversion_state = conversion_state::CONVERTING;
+    return ESP_OK;
+}
 
-    match_rom(address);
-    write_byte(READ_SCRATCHPAD); // READ SCRATCHPAD command
+// Start temperature conversion on every device on the bus
+esp_err_t DS18B20::convert_all(void)
+{
+    _conversion_state = conversion_state::IDLE;
+    if (ESP_OK != skip_rom()) {
+        return ESP_FAIL;
+    }
+
+    write_byte(CONVERT_T); // Convert temperature
+    _conversion_start = _now();
+    _conversion_state = conversion_state::CONVERTING;
+    return ESP_OK;
+}
+
+// Check if conversion is finished. Device holds the bus low during read slots
+// while converting, so the bus reads 1 only when every device is done.
+// NOTE: Doesn't work with parasite power, there conversion ends by timeout.
+conversion_state DS18B20::poll_conversion(void)
+{
+    if (_conversion_state != conversion_state::CONVERTING) {
+        return _conversion_state;
+    }
 
+    int64_t elapsed = _now() - _conversion_start;
+    if (read_bit() == 1) {
+        _conversion_latency = static_cast<uint32_t>(elapsed);
+        _conversion_state = conversion_state::DONE;
+    } else if (elapsed > conversion_timeout()) {
+        _conversion_latency = static_cast<uint32_t>(elapsed);
+        _conversion_state = conversion_state::TIMEOUT;
+        ESP_LOGE(TAG, "Conversion timeout.");
+    }
+    return _conversion_state;
+}
+
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+int64_t DS18B20::_now(void)
+{
+    return static_cast<int64_t>(_bus.now());
+}
+
+void DS18B20::_pause(uint32_t ms)
+{
+    _bus.idle(ms * 1000);
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+#else
+int64_t DS18B20::_now(void)
+{
+    return esp_timer_get_time();
+}
+
+void DS18B20::_pause(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+#endif
+
+uint32_t DS18B20::conversion_timeout(void)
+{
+    return conversion_timeout(_resolution);
+}
+
+// Wait for the end of conversion
+esp_err_t DS18B20::wait_for_conversion(void)
+{
+    conversion_state state = poll_conversion();
+    while (state == conversion_state::CONVERTING) {
+        _pause(CONVERSION_POLL_INTERVAL);
+        state = poll_conversion();
+    }
+    switch (state) {
+    case conversion_state::DONE:
+        return ESP_OK;
+    case conversion_state::TIMEOUT:
+        return ESP_ERR_TIMEOUT;
+    default:
+        return ESP_ERR_INVALID_STATE; // Not started
+    }
+}
+
+// Read scratchpad
+esp_err_t DS18B20::read_scratchpad(uint8_t (&address)[8], uint8_t (&data)[9])
+{
+    for (uint8_t attempt = 0; attempt < ONEWIRE_RETRIES; attempt++) {
+        if (ESP_OK != match_rom(address)) {
+            continue;
+        }
+
+        write_byte(READ_SCRATCHPAD); // READ SCRATCHPAD command
+
+        uint8_t all_bits = 0x00;
+        for (uint8_t i = 0; i < 9; i++) {
+            data[i] = read_byte();
+            all_bits |= data[i];
+        }
+
+        // Zeros pass CRC check, but it's the bus held low
+        if (all_bits != 0x00 && crc8(data, 8) == data[8]) {
+            return ESP_OK;
+        }
+
+        ++_crc_errors;
+        ESP_LOGW(TAG, "Scratchpad CRC mismatch, attempt %d.", attempt + 1);
+    }
+
+    return ESP_ERR_INVALID_CRC;
+}
+
+// Read temperature converted before
+esp_err_t DS18B20::read_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature)
+{
     uint8_t data[9];
+    return read_temp(address, temperature, data);
+}
 
-    for (uint8_t i = 0; i < 9; i++) {
-        data[i] = read_byte();
+esp_err_t DS18B20::read_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature,
+    uint8_t (&data)[9])
+{
+    esp_err_t status = read_scratchpad(address, data);
+    if (ESP_OK != status) {
+        return status;
     }
 
-    // Convert the data to actual temperature
-    // because the result is a 16 bit signed integer, it should
-    // be stored to an "int16_t" type, which is always 16 bits
-    // even when compiled on a 32 bit processor.
-    int16_t raw = (data[1] << 8) | data[0];
+    status = decode_temp(address[0], data, temperature);
+    if (ESP_OK != status) {
+        ESP_LOGW(TAG, "Power on value 85 C discarded.");
+    }
+    return status;
+}
+
+// ========================= Configuration ====================================
+// Write TH, TL and configuration register
+esp_err_t DS18B20::write_scratchpad(uint8_t (&address)[8], uint8_t th,
+    uint8_t tl, uint8_t config)
+{
+    if (ESP_OK != match_rom(address)) {
+        return ESP_FAIL;
+    }
+
+    write_byte(WRITE_SCRATCHPAD); // WRITE SCRATCHPAD command
+    write_byte(th);
+    write_byte(tl);
+    write_byte(config);
+    return ESP_OK;
+}
+
+// Save TH, TL and configuration register to EEPROM
+esp_err_t DS18B20::copy_scratchpad(uint8_t (&address)[8])
+{
+    if (ESP_OK != match_rom(address)) {
+        return ESP_FAIL;
+    }
+
+    write_byte(COPY_SCRATCHPAD); // COPY SCRATCHPAD command
+    vTaskDelay(pdMS_TO_TICKS(COPY_SCRATCHPAD_DURATION));
+    return ESP_OK;
+}
+
+// Set resolution
+esp_err_t DS18B20::set_resolution(uint8_t (&address)[8], uint8_t resolution)
+{
+    uint8_t running = MAX_RESOLUTION; // Unknown until the scratchpad is read
+    const esp_err_t status = _write_resolution(address, resolution, running);
+    // Broadcast conversion lasts as long as the slowest device, a device
+    // which wasn't changed counts at its own resolution
+    if (running > _resolution) {
+        _resolution = running;
+    }
+    return status;
+}
+
+esp_err_t DS18B20::_write_resolution(uint8_t (&address)[8], uint8_t resolution, uint8_t& running)
+{
+    if (resolution < MIN_RESOLUTION || resolution > MAX_RESOLUTION) {
+        ESP_LOGE(TAG, "Resolution %d is not supported.", resolution);
+        return ESP_ERR_INVALID_ARG;
+    }
+    // DS18S20 has fixed resolution
     if (0x10 == address[0]) {
-        raw = raw << 3; // 9 bit resolution default
-        if (data[7] == 0x10) {
-            // "count remain" gives full 12 bit resolution
-            raw = (raw & 0xFFF0) + 12 - data[6];
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint8_t data[9];
+    if (ESP_OK != read_scratchpad(address, data)) {
+        return ESP_FAIL;
+    }
+    running = decode_resolution(address[0], data);
+
+    // Bits 5-6 of configuration register: 0 - 9 bit ... 3 - 12 bit
+    uint8_t config = ((resolution - MIN_RESOLUTION) << 5) | 0x1F;
+    if ((data[4] & 0x60) != (config & 0x60)) {
+        ESP_LOGI(TAG, "Changing resolution to %d bit.", resolution);
+        // Keep alarm registers
+        if (ESP_OK != write_scratchpad(address, data[2], data[3], config)) {
+            return ESP_FAIL;
         }
-    } else {
-        uint8_t cfg = (data[4] & 0x60);
-        // at lower res, the low bits are undefined, so let's zero them
-        if (cfg == 0x00)
-            raw = raw & ~7; // 9 bit resolution, 93.75 ms
-        else if (cfg == 0x20)
-            raw = raw & ~3; // 10 bit res, 187.5 ms
-        else if (cfg == 0x40)
-            raw = raw & ~1; // 11 bit res, 375 ms
-                            //// default is 12 bit resolution, 750 ms
-                            // conversion time
+        // Check before writing to EEPROM
+        if (ESP_OK != read_scratchpad(address, data)) {
+            running = MAX_RESOLUTION;
+            ESP_LOGE(TAG, "Resolution was not written.");
+            return ESP_FAIL;
+        }
+        running = decode_resolution(address[0], data);
+        if ((data[4] & 0x60) != (config & 0x60)) {
+            ESP_LOGE(TAG, "Resolution was not written.");
+            return ESP_FAIL;
+        }
+        if (ESP_OK != copy_scratchpad(address)) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+// Set alarm registers, keep configuration
+esp_err_t DS18B20::set_alarms(uint8_t (&address)[8], int8_t th, int8_t tl,
+    bool persist)
+{
+    uint8_t data[9];
+    if (ESP_OK != read_scratchpad(address, data)) {
+        return ESP_FAIL;
+    }
+    return set_alarms(address, th, tl, data, persist);
+}
+
+esp_err_t DS18B20::set_alarms(uint8_t (&address)[8], int8_t th, int8_t tl,
+    const uint8_t (&data)[9], bool persist)
+{
+    if (static_cast<int8_t>(data[2]) == th && static_cast<int8_t>(data[3]) == tl) {
+        return ESP_OK;
+    }
+
+    ESP_LOGD(TAG, "Alarm window %d .. %d C.", tl, th);
+    if (ESP_OK != write_scratchpad(address, th, tl, data[4])) {
+        return ESP_FAIL;
+    }
+    if (persist) {
+        return copy_scratchpad(address);
     }
-    temperature = raw / 16.0;
     return ESP_OK;
 }
+
+// Search devices with alarm flag
+esp_err_t DS18B20::alarm_search(uint8_t (*addresses)[8], uint8_t max_count,
+    uint8_t& count)
+{
+    esp_err_t status = search_rom(addresses, max_count, count, ALARM_SEARCH);
+    // Presence pulse was there, but nobody answered the search
+    if (status == ESP_ERR_NOT_FOUND && ESP_OK == reset()) {
+        count = 0;
+        return ESP_OK;
+    }
+    return status;
+}
+
+// Get temperature
+esp_err_t DS18B20::get_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature)
+{
+    if (ESP_OK != start_conversion(address)) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t status = wait_for_conversion();
+    if (status != ESP_OK) {
+        return status;
+    }
+
+    return read_temp(address, temperature);
+}
+
+// Get temperature of several devices. All of them convert simultaneously,
+// so the sweep costs one conversion time whatever the number of devices.
+esp_err_t DS18B20::get_temps(uint8_t (*addresses)[8], uint8_t count,
+    Temp_NS::q4_t* temperatures, esp_err_t* results, uint8_t (*scratchpads)[9])
+{
+    const bool converted = (convert_all() == ESP_OK) && (wait_for_conversion() == ESP_OK);
+    if (!converted) {
+        ESP_LOGE(TAG, "Broadcast conversion failed.");
+    }
+
+    esp_err_t status = converted ? ESP_OK : ESP_FAIL;
+    for (uint8_t i = 0; i < count; i++) {
+        esp_err_t result = ESP_FAIL;
+        if (converted && scratchpads != nullptr) {
+            result = read_temp(addresses[i], temperatures[i], scratchpads[i]);
+        } else if (converted) {
+            result = read_temp(addresses[i], temperatures[i]);
+        }
+        if (results != nullptr) {
+            results[i] = result;
+        }
+        if (result != ESP_OK) {
+            status = result;
+        }
+    }
+
+    return status;
+}
+
+// Get temperatures of devices in alarm state
+esp_err_t DS18B20::get_alarm_temps(uint8_t (*addresses)[8], uint8_t count,
+    Temp_NS::q4_t* temperatures, esp_err_t* results, bool* alarms,
+    uint8_t (*scratchpads)[9])
+{
+    for (uint8_t i = 0; i < count; i++) {
+        alarms[i] = false;
+    }
+
+    if (count > ONEWIRE_MAX_DEVICES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (convert_all() != ESP_OK || wait_for_conversion() != ESP_OK) {
+        ESP_LOGE(TAG, "Broadcast conversion failed.");
+        return ESP_FAIL;
+    }
+
+    // One more than the known devices, so all of them in alarm fit and a
+    // full array means an unknown device
+    uint8_t found[ONEWIRE_MAX_DEVICES + 1][8];
+    uint8_t found_count = 0;
+    esp_err_t status = alarm_search(found, sizeof(found) / sizeof(found[0]), found_count);
+    if (status != ESP_OK) {
+        ESP_LOGE(TAG, "Alarm search failed.");
+        return status;
+    }
+    // Search stops on the array size, the rest is not known
+    if (found_count == sizeof(found) / sizeof(found[0])) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        for (uint8_t j = 0; j < found_count; j++) {
+            if (memcmp(addresses[i], found[j], sizeof(found[j])) != 0) {
+                continue;
+            }
+            alarms[i] = true;
+            results[i] = scratchpads != nullptr
+                ? read_temp(addresses[i], temperatures[i], scratchpads[i])
+                : read_temp(addresses[i], temperatures[i]);
+            break;
+        }
+    }
+
+    return status;
+}
 } // namespace OneWire
@@ -4,6 +4,47 @@
 #include "esp_err.h"
 #include "esp_event.h" // IWYU pragma: keep
 #include "esp_log.h" // IWYU pragma: keep
+#include "esp_timer.h"
+#include "temperature.h"
+
+// ============================ Backend =======================================
+// Time slots are bit-banged on GPIO, generated by UART hardware or simulated
+// with virtual devices. Select with -DONEWIRE_BACKEND=... in component.mk.
+#define ONEWIRE_BACKEND_GPIO 0
+#define ONEWIRE_BACKEND_UART 1
+#define ONEWIRE_BACKEND_SIM 2
+#ifndef ONEWIRE_BACKEND
+#define ONEWIRE_BACKEND ONEWIRE_BACKEND_GPIO
+#endif
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+#include "onewire_sim.h"
+#define ONEWIRE_SIM_DEVICES 2 // Virtual sensors on the simulated bus
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+#include "onewire_uart.h"
+#include "sdkconfig.h"
+// UART1 has no RX on ESP8266. UART0 is swapped to GPIO13 (RX) / GPIO15 (TX),
+// so the fan must be moved from GPIO13 for this backend. UART0 then runs at
+// the 1-Wire baud rates with TX on the bus, the console must be on UART1
+// (TX only, GPIO2): CONFIG_CONSOLE_UART_CUSTOM and
+// CONFIG_CONSOLE_UART_CUSTOM_NUM_1 in menuconfig, or no console at all.
+#define ONEWIRE_UART_PORT UART_NUM_0
+#if !defined(CONFIG_CONSOLE_UART_NONE) && CONFIG_CONSOLE_UART_NUM != 1
+#error "UART 1-Wire backend takes UART0, set the console to UART1 (CONFIG_CONSOLE_UART_CUSTOM_NUM_1)"
+#endif
+#else
+#include "onewire_fast.h"
+// Fast path writes GPIO registers directly from IRAM. Pin and inversion are
+// fixed at compile time, constructor must get the same pin.
+#ifndef ONEWIRE_FAST_GPIO
+#define ONEWIRE_FAST_GPIO 1
+#endif
+#define ONEWIRE_GPIO_PIN GPIO_NUM_12
+#define ONEWIRE_INVERT_LOGIC false
+#endif
+// Collect low pulse duration of time slots in CPU cycles
+#ifndef ONEWIRE_SLOT_STATS
+#define ONEWIRE_SLOT_STATS 0
+#endif
 
 // #define esp_delay_us(x) os_delay_us(x) // Delay in microseconds max 65535 us
 
@@ -26,14 +67,55 @@
 #define BUS_RECOVERY_DURATION 2 // Bus recovery time.
 #define PAUSE_BETWEEN_TIME_SLOTS 5
 // =========================== Commands =======================================
-#define WAIT_FOR_TEMPERATURE_CONVERSION 1000
+#define WAIT_FOR_TEMPERATURE_CONVERSION 1000 // Conversion timeout, ms (12 bit)
+#define CONVERSION_POLL_INTERVAL 10 // Read slot interval while converting, ms
 #define MATCH_ROM 0x55 // Match ROM command to address a specific 1-Wire device
+#define SKIP_ROM 0xCC // Skip ROM command to address all devices on the bus
 #define CONVERT_T 0x44 // Convert temperature command
 #define READ_ROM 0x33 // Read ROM command for 1-Wire device
+#define SEARCH_ROM 0xF0 // Search ROM command to enumerate devices on the bus
+#define ALARM_SEARCH 0xEC // Search ROM among devices with alarm flag set
 #define READ_SCRATCHPAD 0xBE // Read Scratchpad command to read temperature
+#define WRITE_SCRATCHPAD 0x4E // Write TH, TL and configuration registers
+#define COPY_SCRATCHPAD 0x48 // Copy TH, TL and configuration to EEPROM
+#define COPY_SCRATCHPAD_DURATION 10 // EEPROM write time, ms
+// ========================== Validation ======================================
+#define ONEWIRE_RETRIES 3 // Attempts for one transaction
+#define ONEWIRE_MAX_DEVICES 8 // Known devices of one bus for the alarm sweep
+#define POWER_ON_TEMPERATURE 0x0550 // 85 C, scratchpad value after power on
+// ========================= Resolution =======================================
+#define MIN_RESOLUTION 9
+#define MAX_RESOLUTION 12
+#define CONVERSION_TIME_9_BIT 93750 // us, doubles with every extra bit
 
 namespace OneWire {
 
+// Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1)
+uint8_t crc8(const uint8_t* data, uint8_t len);
+// ROM code is valid if 8th byte is CRC of the first seven
+bool check_rom(const uint8_t (&address)[8]);
+// Merges devices "found" by SEARCH ROM into the "known" slots, up to
+// "max_count". Sensor number is the slot, so known devices keep theirs,
+// the missing ones too if "keep_missing". New devices take the next free
+// slots, slots of missing devices only when there are no free ones.
+// Returns the slot count.
+uint8_t merge_roms(uint8_t (*known)[8], uint8_t known_count, const uint8_t (*found)[8],
+    uint8_t found_count, uint8_t max_count, bool keep_missing = true);
+// Temperature (Q12.4) from validated scratchpad of device with given family
+// code. ESP_ERR_INVALID_RESPONSE if it holds power on value.
+esp_err_t decode_temp(uint8_t family, const uint8_t (&data)[9], Temp_NS::q4_t& temperature);
+// Resolution the device converts at from its scratchpad. DS18S20 always
+// takes 750 ms like 12 bit, its reserved byte 4 reads 0xFF - 12 bit too.
+uint8_t decode_resolution(uint8_t family, const uint8_t (&data)[9]);
+
+// Conversion state machine
+enum class conversion_state {
+    IDLE,
+    CONVERTING,
+    DONE,
+    TIMEOUT
+};
+
 class DS18B20 {
 protected:
     // ================= Class variables ======================================
@@ -43,21 +125,56 @@ protected:
     gpio_config_t config; // Pin configuration
     bool _is_initialized { false };
     bool _level; // Output level
-    bool _is_output;
+    bool _is_output { false };
     const char* TAG = "DS18B20";
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+    UartBus _bus;
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    SimBus _bus;
+#endif
+
+    // Conversion tracking
+    conversion_state _conversion_state { conversion_state::IDLE };
+    int64_t _conversion_start { 0 }; // us
+    uint32_t _conversion_latency { 0 }; // us, last finished conversion
+    uint8_t _resolution { 0 }; // Highest resolution on the bus, 0 - unknown
+    uint32_t _crc_errors { 0 }; // Corrupted reads
+#if ONEWIRE_SLOT_STATS && ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+    SlotStats _write_stats {};
+    SlotStats _read_stats {};
+#endif
 
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
     // Initialization of the GPIO pin in output/input mode
     esp_err_t _init_one_wire_gpio(void);
+#endif
+    // set_resolution() without the bus timeout, "running" is the resolution
+    // the device is left at
+    esp_err_t _write_resolution(uint8_t (&address)[8], uint8_t resolution, uint8_t& running);
+    // Clock of the conversion timing, us. The simulated bus has its own.
+    int64_t _now(void);
+    // Master leaves the bus between conversion polls
+    void _pause(uint32_t ms);
 
 public:
     // =================== Constructor ========================================
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+    explicit DS18B20(const uart_port_t port);
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    explicit DS18B20(const uint8_t virtual_devices);
+    // Access to virtual devices, fault injection and bus time
+    SimBus& sim(void) { return _bus; }
+#else
     DS18B20(const gpio_num_t pin);
     DS18B20(const gpio_num_t pin, const bool invert_logic);
+#endif
 
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
     // ================ GPIO-mode & level +====================================
     esp_err_t pin_direction(gpio_mode_t direction);
     esp_err_t set_level(const bool level);
     uint8_t get_pin_level(void);
+#endif
 
     // =================== 1-Wire =============================================
     esp_err_t reset(void);
@@ -65,9 +182,91 @@ public:
     void write_byte(uint8_t byte);
     uint8_t read_bit(void);
     uint8_t read_byte(void);
-    esp_err_t readROM(void);
+    uint8_t triplet(uint8_t direction);
+    esp_err_t readROM(uint8_t (&address)[8]);
+    // Enumerate up to "max_count" devices, "count" is number of found
+    esp_err_t search_rom(uint8_t (*addresses)[8], uint8_t max_count,
+        uint8_t& count, uint8_t command = SEARCH_ROM);
     esp_err_t match_rom(uint8_t (&address)[8]);
-    esp_err_t get_temp(uint8_t (&address)[8], float& temperature);
+    esp_err_t skip_rom(void);
+
+    // ================= Temperature ==========================================
+    // Start conversion of the addressed device
+    esp_err_t start_conversion(uint8_t (&address)[8]);
+    // Start conversion on all devices at once (SKIP ROM + CONVERT T)
+    esp_err_t convert_all(void);
+    // Non-blocking check of the conversion. CONVERTING while devices are
+    // busy, TIMEOUT when they are too slow, IDLE if none was started.
+    conversion_state poll_conversion(void);
+    // Poll every CONVERSION_POLL_INTERVAL until conversion is done
+    esp_err_t wait_for_conversion(void);
+    conversion_state get_conversion_state(void) { return _conversion_state; }
+    // Duration of the last finished conversion, us
+    uint32_t get_conversion_latency(void) { return _conversion_latency; }
+    // Conversion time for given resolution, us. Unknown resolution is 12 bit.
+    static constexpr uint32_t conversion_time(uint8_t resolution)
+    {
+        return CONVERSION_TIME_9_BIT
+            << ((resolution < MIN_RESOLUTION || resolution > MAX_RESOLUTION ? MAX_RESOLUTION : resolution)
+                - MIN_RESOLUTION);
+    }
+    // Timeout keeps the same margin as WAIT_FOR_TEMPERATURE_CONVERSION for
+    // 750 ms, us
+    static constexpr uint32_t conversion_timeout(uint8_t resolution)
+    {
+        return conversion_time(resolution) / 3 * 4;
+    }
+    // Conversion timeout for the highest resolution set on the bus, us
+    uint32_t conversion_timeout(void);
+
+    // ================= Configuration ========================================
+    esp_err_t write_scratchpad(uint8_t (&address)[8], uint8_t th, uint8_t tl,
+        uint8_t config);
+    esp_err_t copy_scratchpad(uint8_t (&address)[8]);
+    // Set resolution (9 - 12 bit). EEPROM is written only if it's changed.
+    // The bus timeout follows the device also when it fails.
+    esp_err_t set_resolution(uint8_t (&address)[8], uint8_t resolution);
+    // Set TH and TL alarm registers, whole degrees. Alarm flag is set by
+    // conversion when T >= TH or T <= TL. "persist" copies them to EEPROM.
+    // Registers are written only if they are changed.
+    esp_err_t set_alarms(uint8_t (&address)[8], int8_t th, int8_t tl,
+        bool persist = false);
+    // Same from the scratchpad "data" just read, no read on the bus and no
+    // write at all if the window is the same
+    esp_err_t set_alarms(uint8_t (&address)[8], int8_t th, int8_t tl,
+        const uint8_t (&data)[9], bool persist = false);
+    // Find devices with alarm flag after the last conversion. No alarms is
+    // ESP_OK with zero "count".
+    esp_err_t alarm_search(uint8_t (*addresses)[8], uint8_t max_count,
+        uint8_t& count);
+
+    uint32_t get_crc_errors(void) { return _crc_errors; }
+#if ONEWIRE_SLOT_STATS && ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+    SlotStats& get_write_stats(void) { return _write_stats; }
+    SlotStats& get_read_stats(void) { return _read_stats; }
+#endif
+    // Read scratchpad of the addressed device. Retried on CRC mismatch.
+    esp_err_t read_scratchpad(uint8_t (&address)[8], uint8_t (&data)[9]);
+    // Read already converted temperature of the addressed device (collect)
+    esp_err_t read_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature);
+    // Same, the scratchpad is kept in "data"
+    esp_err_t read_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature,
+        uint8_t (&data)[9]);
+    // Convert and read one device
+    esp_err_t get_temp(uint8_t (&address)[8], Temp_NS::q4_t& temperature);
+    // Convert all devices with one shared poll, then read each of them.
+    // Per device status is returned in "results" and the scratchpad in
+    // "scratchpads" if they are not nullptr.
+    esp_err_t get_temps(uint8_t (*addresses)[8], uint8_t count,
+        Temp_NS::q4_t* temperatures, esp_err_t* results = nullptr,
+        uint8_t (*scratchpads)[9] = nullptr);
+    // Convert all devices, then read only the ones found by ALARM SEARCH.
+    // "alarms[i]" tells if device was read, "results[i]" is its status.
+    // Error is returned only if conversion or search failed. Up to
+    // ONEWIRE_MAX_DEVICES devices.
+    esp_err_t get_alarm_temps(uint8_t (*addresses)[8], uint8_t count,
+        Temp_NS::q4_t* temperatures, esp_err_t* results, bool* alarms,
+        uint8_t (*scratchpads)[9] = nullptr);
 
 }; // class Gpio
 
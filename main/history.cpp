@@ -0,0 +1,426 @@
+#include "history.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "temperature.h"
+#include <cstdio>
+#include <cstring>
+
+namespace History_NS {
+
+Store history;
+
+uint32_t now_s(void)
+{
+    return static_cast<uint32_t>(esp_timer_get_time() / 1000000);
+}
+
+size_t format_value(char* buffer, size_t size, uint8_t series, int16_t value)
+{
+    if (series < TEMPERATURE_SERIES) {
+        return Temp_NS::format(buffer, size, value);
+    }
+    int length = snprintf(buffer, size, "%d", value);
+    return (length > 0 && static_cast<size_t>(length) < size) ? length : 0;
+}
+
+// ===================== Variable length integers =============================
+size_t varint_write(uint8_t* buffer, uint32_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80) {
+        buffer[size++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    buffer[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+size_t varint_read(const uint8_t* buffer, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (size_t i = 0; i < VARINT_MAX_SIZE && buffer + i < end; i++) {
+        value |= static_cast<uint32_t>(buffer[i] & 0x7F) << (7 * i);
+        if ((buffer[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// ========================= Store ============================================
+Store::Store(void)
+    : _mutex(xSemaphoreCreateMutex())
+{
+    memset(_series, 0, sizeof(_series));
+    for (uint8_t i = 0; i < SERIES_COUNT; i++) {
+        for (uint16_t j = 0; j < MINUTE_ROLLUPS; j++) {
+            _series[i].minutes[j].avg = Rollup::EMPTY;
+        }
+        for (uint16_t j = 0; j < QUARTER_ROLLUPS; j++) {
+            _series[i].quarters[j].avg = Rollup::EMPTY;
+        }
+    }
+}
+
+Store::~Store(void)
+{
+    if (_mutex != NULL) {
+        vSemaphoreDelete(_mutex);
+    }
+}
+
+void Store::_append_raw(Series& series, const Point& point)
+{
+    Block* block = &series.blocks[series.block_seq % BLOCK_COUNT];
+    if (block->count > 0) {
+        const int32_t delta = static_cast<int32_t>(point.time - series.last_time);
+        uint8_t encoded[2 * VARINT_MAX_SIZE];
+        size_t size = varint_write(encoded, zigzag_encode(delta - series.last_delta));
+        size += varint_write(encoded + size, zigzag_encode(point.value - series.last_value));
+
+        if (block->used + size <= BLOCK_SIZE) {
+            memcpy(block->data + block->used, encoded, size);
+            block->used += size;
+            ++block->count;
+            series.last_time = point.time;
+            series.last_delta = delta;
+            series.last_value = point.value;
+            return;
+        }
+        // Full - start the next block over the oldest one
+        ++series.block_seq;
+        block = &series.blocks[series.block_seq % BLOCK_COUNT];
+    }
+
+    block->first_time = point.time;
+    block->first_value = point.value;
+    block->count = 1;
+    block->used = 0;
+    series.last_time = point.time;
+    series.last_delta = 0;
+    series.last_value = point.value;
+}
+
+void Store::_append_rollup(Series& series, Tier tier, const Point& point)
+{
+    Aggregate& current = series.current[static_cast<uint8_t>(tier)];
+    const uint32_t period = point.time / _period_length(tier);
+
+    if (current.count > 0 && period != current.period) {
+        // Close the collected period, periods without points stay empty
+        Rollup* rollups = _rollups(series, tier);
+        const uint16_t count = _rollup_count(tier);
+        Rollup& closed = rollups[current.period % count];
+        closed.min = current.min;
+        closed.max = current.max;
+        closed.avg = static_cast<int16_t>(current.sum / current.count);
+
+        uint32_t gap = period - current.period - 1;
+        if (gap > count) {
+            gap = count;
+        }
+        for (uint32_t i = 1; i <= gap; i++) {
+            rollups[(current.period + i) % count].avg = Rollup::EMPTY;
+        }
+        current.count = 0;
+    }
+
+    if (current.count == 0) {
+        current.period = period;
+        current.min = point.value;
+        current.max = point.value;
+        current.sum = 0;
+    }
+    if (point.value < current.min) {
+        current.min = point.value;
+    }
+    if (point.value > current.max) {
+        current.max = point.value;
+    }
+    current.sum += point.value;
+    ++current.count;
+}
+
+esp_err_t Store::append(uint8_t series, uint32_t time, int16_t value)
+{
+    if (series >= SERIES_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+    Series& data = _series[series];
+    if (data.points > 0 && time < data.last_time) {
+        xSemaphoreGive(_mutex);
+        ESP_LOGW(TAG, "Point of series %d is older than the last one", series);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const Point point { time, value };
+    _append_raw(data, point);
+    _append_rollup(data, Tier::MINUTE, point);
+    _append_rollup(data, Tier::QUARTER, point);
+    ++data.points;
+
+    xSemaphoreGive(_mutex);
+    return ESP_OK;
+}
+
+bool Store::_decode(const Block& block, PointVisitor visitor, void* context, uint32_t since)
+{
+    Point point { block.first_time, block.first_value };
+    int32_t delta = 0;
+    const uint8_t* position = block.data;
+    const uint8_t* end = block.data + block.used;
+
+    for (uint16_t i = 0;; i++) {
+        if (point.time >= since && !visitor(point, context)) {
+            return false;
+        }
+        if (i + 1 >= block.count) {
+            return true;
+        }
+        uint32_t time_code = 0;
+        uint32_t value_code = 0;
+        size_t size = varint_read(position, end, time_code);
+        if (size == 0) {
+            return true;
+        }
+        position += size;
+        size = varint_read(position, end, value_code);
+        if (size == 0) {
+            return true;
+        }
+        position += size;
+
+        delta += zigzag_decode(time_code);
+        point.time += delta;
+        point.value = static_cast<int16_t>(point.value + zigzag_decode(value_code));
+    }
+}
+
+esp_err_t Store::for_each_point(uint8_t series, uint32_t since, PointVisitor visitor, void* context)
+{
+    if (series >= SERIES_COUNT || visitor == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Series& data = _series[series];
+    Block block;
+
+    // Blocks are copied one at a time, a block overwritten meanwhile is
+    // recognised by its sequence number and skipped
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    uint32_t newest = data.block_seq;
+    uint32_t seq = newest >= BLOCK_COUNT - 1 ? newest - (BLOCK_COUNT - 1) : 0;
+    xSemaphoreGive(_mutex);
+
+    for (; seq <= newest; seq++) {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        newest = data.block_seq;
+        const bool kept = seq + BLOCK_COUNT > newest;
+        if (kept) {
+            block = data.blocks[seq % BLOCK_COUNT];
+        }
+        xSemaphoreGive(_mutex);
+
+        if (!kept || block.count == 0) {
+            continue;
+        }
+        if (!_decode(block, visitor, context, since)) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Store::for_each_rollup(uint8_t series, Tier tier, RollupVisitor visitor, void* context)
+{
+    if (series >= SERIES_COUNT || visitor == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Series& data = _series[series];
+    const uint16_t count = _rollup_count(tier);
+    const uint32_t length = _period_length(tier);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    const Aggregate current = data.current[static_cast<uint8_t>(tier)];
+    xSemaphoreGive(_mutex);
+    if (current.count == 0) {
+        return ESP_OK; // Nothing appended yet
+    }
+
+    // Closed periods before the current one, the oldest could be before boot
+    const uint32_t first = current.period >= count ? current.period - count : 0;
+    for (uint32_t period = first; period < current.period; period++) {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        // The current period could move on meanwhile and reuse the slot
+        const bool kept = period + count > data.current[static_cast<uint8_t>(tier)].period;
+        const Rollup rollup = _rollups(data, tier)[period % count];
+        xSemaphoreGive(_mutex);
+        if (!kept || rollup.empty()) {
+            continue;
+        }
+        if (!visitor(period * length, rollup, context)) {
+            return ESP_OK;
+        }
+    }
+
+    const Rollup partial { current.min, current.max,
+        static_cast<int16_t>(current.sum / current.count) };
+    visitor(current.period * length, partial, context);
+    return ESP_OK;
+}
+
+size_t Store::raw_bytes(uint8_t series)
+{
+    if (series >= SERIES_COUNT) {
+        return 0;
+    }
+    size_t size = 0;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (uint8_t i = 0; i < BLOCK_COUNT; i++) {
+        const Block& block = _series[series].blocks[i];
+        if (block.count > 0) {
+            size += sizeof(block.first_time) + sizeof(block.first_value) + block.used;
+        }
+    }
+    xSemaphoreGive(_mutex);
+    return size;
+}
+
+uint32_t Store::point_count(uint8_t series)
+{
+    return series < SERIES_COUNT ? _series[series].points : 0;
+}
+
+// ========================= JSON export ======================================
+// Text is collected in a small buffer, the sink gets it in pieces
+class JsonWriter {
+protected:
+    TextSink _sink;
+    void* _context;
+    char _buffer[128];
+    size_t _used { 0 };
+    bool _failed { false };
+
+public:
+    uint8_t series;
+    bool first { true }; // No array element yet
+
+    JsonWriter(TextSink sink, void* context, uint8_t series)
+        : _sink(sink)
+        , _context(context)
+        , series(series)
+    {
+    }
+
+    bool failed(void) const { return _failed; }
+
+    void flush(void)
+    {
+        if (_used > 0 && !_failed) {
+            _failed = !_sink(_buffer, _used, _context);
+        }
+        _used = 0;
+    }
+
+    void write(const char* text, size_t length)
+    {
+        if (_used + length > sizeof(_buffer)) {
+            flush();
+        }
+        if (length > sizeof(_buffer)) {
+            _failed = _failed || !_sink(text, length, _context);
+            return;
+        }
+        memcpy(_buffer + _used, text, length);
+        _used += length;
+    }
+    void write(const char* text) { write(text, strlen(text)); }
+
+    void write_number(uint32_t number)
+    {
+        char text[11];
+        write(text, snprintf(text, sizeof(text), "%u", number));
+    }
+    void write_value(int16_t value)
+    {
+        char text[Temp_NS::FORMAT_SIZE];
+        write(text, format_value(text, sizeof(text), series, value));
+    }
+    void write_separator(void)
+    {
+        if (!first) {
+            write(",");
+        }
+        first = false;
+    }
+};
+
+static bool point_to_json(const Point& point, void* context)
+{
+    JsonWriter* writer = static_cast<JsonWriter*>(context);
+    writer->write_separator();
+    writer->write("[");
+    writer->write_number(point.time);
+    writer->write(",");
+    writer->write_value(point.value);
+    writer->write("]");
+    return !writer->failed();
+}
+
+static bool rollup_to_json(uint32_t start, const Rollup& rollup, void* context)
+{
+    JsonWriter* writer = static_cast<JsonWriter*>(context);
+    writer->write_separator();
+    writer->write("[");
+    writer->write_number(start);
+    writer->write(",");
+    writer->write_value(rollup.min);
+    writer->write(",");
+    writer->write_value(rollup.max);
+    writer->write(",");
+    writer->write_value(rollup.avg);
+    writer->write("]");
+    return !writer->failed();
+}
+
+static void write_header(JsonWriter& writer, uint8_t series)
+{
+    writer.write("{\"series\":");
+    writer.write_number(series);
+    writer.write(",\"now\":");
+    writer.write_number(now_s());
+}
+
+esp_err_t write_points_json(Store& store, uint8_t series, uint32_t since, TextSink sink, void* context)
+{
+    if (series >= SERIES_COUNT || sink == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    JsonWriter writer(sink, context, series);
+    write_header(writer, series);
+    writer.write(",\"points\":[");
+    store.for_each_point(series, since, point_to_json, &writer);
+    writer.write("]}");
+    writer.flush();
+    return writer.failed() ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t write_rollups_json(Store& store, uint8_t series, Tier tier, TextSink sink, void* context)
+{
+    if (series >= SERIES_COUNT || sink == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    JsonWriter writer(sink, context, series);
+    write_header(writer, series);
+    writer.write(",\"period\":");
+    writer.write_number(Store::period_length(tier));
+    writer.write(",\"rollups\":[");
+    store.for_each_rollup(series, tier, rollup_to_json, &writer);
+    writer.write("]}");
+    writer.flush();
+    return writer.failed() ? ESP_FAIL : ESP_OK;
+}
+
+} // namespace History_NS
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h" // IWYU pragma: keep
+#include "freertos/semphr.h"
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-memory history of temperatures and fan duty. Raw points are kept
+// compressed in a ring of blocks, 1-minute and 15-minute min/max/avg
+// rollups in rings of their own. Nothing is allocated after start.
+namespace History_NS {
+
+// Every drive has a series, Fan_NS::SENSOR_COUNT checks it. The depths are
+// set for 9 series in about 7 kB of RAM.
+constexpr uint8_t TEMPERATURE_SERIES = 8; // Drives with history, ids 0..7
+constexpr uint8_t SERIES_DUTY = TEMPERATURE_SERIES; // Fan duty, %
+constexpr uint8_t SERIES_COUNT = TEMPERATURE_SERIES + 1;
+
+constexpr size_t BLOCK_SIZE = 128; // Compressed bytes of one raw block
+constexpr uint8_t BLOCK_COUNT = 2; // Raw blocks of every series, 1 .. 2 are full
+constexpr uint16_t MINUTE_ROLLUPS = 30; // 30 minutes
+constexpr uint16_t QUARTER_ROLLUPS = 48; // 12 hours
+
+// Time is in seconds since boot. Value is Q12.4 for temperatures, percent
+// for duty.
+struct Point {
+    uint32_t time;
+    int16_t value;
+};
+
+enum class Tier : uint8_t {
+    MINUTE = 0,
+    QUARTER = 1
+};
+constexpr uint8_t TIER_COUNT = 2;
+
+struct Rollup {
+    static constexpr int16_t EMPTY = INT16_MIN; // "avg" of a period without points
+    int16_t min;
+    int16_t max;
+    int16_t avg;
+    bool empty(void) const { return avg == EMPTY; }
+};
+
+// ===================== Variable length integers =============================
+// Zig-zag maps small negative numbers to small unsigned ones, varint keeps 7
+// bits per byte with the high bit set on all but the last byte.
+inline uint32_t zigzag_encode(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+inline int32_t zigzag_decode(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+constexpr size_t VARINT_MAX_SIZE = 5; // 32 bits
+// Returns bytes written
+size_t varint_write(uint8_t* buffer, uint32_t value);
+// Returns bytes read, 0 if the value doesn't end before "end"
+size_t varint_read(const uint8_t* buffer, const uint8_t* end, uint32_t& value);
+
+// Return false to stop the iteration
+typedef bool (*PointVisitor)(const Point& point, void* context);
+// "start" - first second of the period
+typedef bool (*RollupVisitor)(uint32_t start, const Rollup& rollup, void* context);
+
+// ========================= Store ============================================
+class Store {
+protected:
+    // Timestamps are stored as delta-of-delta, values as delta
+    struct Block {
+        uint32_t first_time;
+        int16_t first_value;
+        uint16_t count; // Points, 0 - the block is unused
+        uint16_t used; // Bytes of "data"
+        uint8_t data[BLOCK_SIZE];
+    };
+
+    struct Aggregate {
+        uint32_t period; // Index of the period being collected, time / length
+        int16_t min;
+        int16_t max;
+        int32_t sum;
+        uint16_t count;
+    };
+
+    struct Series {
+        Block blocks[BLOCK_COUNT];
+        uint32_t block_seq; // Sequence number of the block being written
+        // Encoder state of the current block
+        uint32_t last_time;
+        int32_t last_delta;
+        int16_t last_value;
+
+        Rollup minutes[MINUTE_ROLLUPS];
+        Rollup quarters[QUARTER_ROLLUPS];
+        Aggregate current[TIER_COUNT];
+        uint32_t points; // Appended since start
+    };
+
+    Series _series[SERIES_COUNT];
+    SemaphoreHandle_t _mutex;
+
+    static uint32_t _period_length(Tier tier) { return tier == Tier::MINUTE ? 60 : 900; }
+    static uint16_t _rollup_count(Tier tier)
+    {
+        return tier == Tier::MINUTE ? MINUTE_ROLLUPS : QUARTER_ROLLUPS;
+    }
+    Rollup* _rollups(Series& series, Tier tier)
+    {
+        return tier == Tier::MINUTE ? series.minutes : series.quarters;
+    }
+
+    void _append_raw(Series& series, const Point& point);
+    void _append_rollup(Series& series, Tier tier, const Point& point);
+    static bool _decode(const Block& block, PointVisitor visitor, void* context, uint32_t since);
+
+public:
+    Store(void);
+    ~Store(void);
+
+    // Points of one series must come in time order
+    esp_err_t append(uint8_t series, uint32_t time, int16_t value);
+
+    // Raw points from "since" on, oldest first. The lock is held only while
+    // a block is copied, so the visitor may send data over the network.
+    esp_err_t for_each_point(uint8_t series, uint32_t since, PointVisitor visitor, void* context);
+    // Finished periods of the tier, oldest first, the current one last
+    esp_err_t for_each_rollup(uint8_t series, Tier tier, RollupVisitor visitor, void* context);
+
+    // Compressed bytes of raw points kept for the series
+    size_t raw_bytes(uint8_t series);
+    uint32_t point_count(uint8_t series);
+    static uint32_t period_length(Tier tier) { return _period_length(tier); }
+
+    constexpr static const char* TAG = "History";
+};
+
+// Seconds since boot
+uint32_t now_s(void);
+// Value of the series as text, "23.06" for temperatures, "55" for duty.
+// Returns text length.
+size_t format_value(char* buffer, size_t size, uint8_t series, int16_t value);
+
+// ========================= JSON export ======================================
+// Receives the text piece by piece, returns false to stop
+typedef bool (*TextSink)(const char* text, size_t length, void* context);
+// {"series":0,"now":7200,"points":[[6600,35.06],...]}
+esp_err_t write_points_json(Store& store, uint8_t series, uint32_t since, TextSink sink, void* context);
+// {"series":0,"now":7200,"period":60,"rollups":[[6600,34.88,35.13,35.00],...]},
+// a rollup is [start, min, max, avg]
+esp_err_t write_rollups_json(Store& store, uint8_t series, Tier tier, TextSink sink, void* context);
+
+extern Store history;
+
+} // namespace History_NS
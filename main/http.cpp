@@ -1,4 +1,5 @@
 #include "http.h"
+#include "history.h"
 #include "nvs.h"
 #include "secrets.h"
 #include <cstdint>
@@ -7,9 +8,15 @@ namespace Http_NS {
 
 httpd_handle_t HttpServer::_server = NULL;
 esp_vfs_spiffs_conf_t HttpServer::spiffs_config;
+uint8_t HttpServer::_storage_users = 0;
+bool HttpServer::_storage_mounted = false;
 
-HttpServer::HttpServer(void)
+// Storage is shared with the telemetry log, the last user unmounts it
+esp_err_t HttpServer::mount_storage(void)
 {
+    if (_storage_users++ > 0) {
+        return ESP_OK;
+    }
 
     // initialize and mounting SPIFFS
     spiffs_config.base_path = "/spiffs";
@@ -18,15 +25,37 @@ HttpServer::HttpServer(void)
     spiffs_config.format_if_mount_failed = true;
     esp_err_t ret = esp_vfs_spiffs_register(&spiffs_config);
     if (ret != ESP_OK) {
+        _storage_users = 0;
         if (ret == ESP_FAIL) {
             ESP_LOGE(TAG_SPIFF, "Failed to mount or format filesystem");
         } else {
             ESP_LOGE(TAG_SPIFF, "Failed to initialize SPIFFS (%s)",
                 esp_err_to_name(ret));
         }
-        return;
+        return ret;
     }
     ESP_LOGI("SPIFFS", "Finished mounting SPIFFS");
+    return ESP_OK;
+}
+
+void HttpServer::unmount_storage(void)
+{
+    if (_storage_users == 0 || --_storage_users > 0) {
+        return;
+    }
+    if (esp_spiffs_mounted(spiffs_config.partition_label)) {
+        ESP_ERROR_CHECK(esp_vfs_spiffs_unregister(spiffs_config.partition_label));
+        ESP_LOGI(TAG, "SPIFFS unmounted");
+    }
+}
+
+HttpServer::HttpServer(void)
+{
+    esp_err_t ret = mount_storage();
+    if (ret != ESP_OK) {
+        return;
+    }
+    _storage_mounted = true;
 
     // get SPIFFS partition information
     size_t total = 0, used = 0;
@@ -165,6 +194,60 @@ httpd_uri_t settings_get = { .uri = "/get-settings",
     .method = HTTP_GET,
     .handler = settings_get_handler,
     .user_ctx = NULL };
+// ======================== "/history" ==================================
+// ?series=0..2 (2 - fan duty), tier=raw|minute|quarter, since=<s> for raw
+static bool history_chunk(const char* text, size_t length, void* context)
+{
+    return httpd_resp_send_chunk(static_cast<httpd_req_t*>(context), text, length) == ESP_OK;
+}
+
+static esp_err_t history_get_handler(httpd_req_t* req)
+{
+    char query[64] {};
+    char value[12] {};
+    uint8_t series = 0;
+    uint32_t since = 0;
+    char tier[8] = "raw";
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "series", value, sizeof(value)) == ESP_OK) {
+            series = static_cast<uint8_t>(atoi(value));
+        }
+        if (httpd_query_key_value(query, "since", value, sizeof(value)) == ESP_OK) {
+            since = static_cast<uint32_t>(strtoul(value, nullptr, 10));
+        }
+        httpd_query_key_value(query, "tier", tier, sizeof(tier));
+    }
+    if (series >= History_NS::SERIES_COUNT) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown series");
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    esp_err_t ret;
+    if (strcmp(tier, "minute") == 0) {
+        ret = History_NS::write_rollups_json(History_NS::history, series,
+            History_NS::Tier::MINUTE, history_chunk, req);
+    } else if (strcmp(tier, "quarter") == 0) {
+        ret = History_NS::write_rollups_json(History_NS::history, series,
+            History_NS::Tier::QUARTER, history_chunk, req);
+    } else {
+        ret = History_NS::write_points_json(History_NS::history, series, since,
+            history_chunk, req);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(HttpServer::TAG, "History sending failed!");
+        return ESP_FAIL;
+    }
+    // Always finish sending the response
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+httpd_uri_t history_get = { .uri = "/history",
+    .method = HTTP_GET,
+    .handler = history_get_handler,
+    .user_ctx = NULL };
 // ======================================================================
 
 void HttpServer::_connect_handler(void* arg, esp_event_base_t event_base,
@@ -192,6 +275,7 @@ esp_err_t HttpServer::start_webserver(void)
         ESP_LOGI(TAG, "Registering URI handlers");
         httpd_register_uri_handler(_server, &root_dir);
         httpd_register_uri_handler(_server, &settings_get);
+        httpd_register_uri_handler(_server, &history_get);
         // httpd_register_uri_handler(server, &echo);
         // httpd_register_uri_handler(server, &ctrl);
         return ESP_OK;
@@ -218,9 +302,9 @@ void HttpServer::stop_webserver(void)
             ESP_LOGE(TAG, "Failed to stop server: %s", esp_err_to_name(ret));
         }
         _server = NULL;
-        if (esp_spiffs_mounted(spiffs_config.partition_label)) {
-            ESP_ERROR_CHECK(esp_vfs_spiffs_unregister(spiffs_config.partition_label));
-            ESP_LOGI(TAG, "SPIFFS unmounted");
+        if (_storage_mounted) {
+            _storage_mounted = false;
+            unmount_storage();
         }
         ESP_LOGI(TAG, "Server stopped successfully");
     }
@@ -21,6 +21,8 @@ private:
                                int32_t event_id, void *event_data);
   static void _disconnect_handler(void *arg, esp_event_base_t event_base,
                                   int32_t event_id, void *event_data);
+  static uint8_t _storage_users; // Tasks using the storage partition
+  static bool _storage_mounted;  // By the server
 
 public:
   HttpServer(void);
@@ -32,6 +34,10 @@ public:
 
   static Nvs_NS::Nvs _nvs;
 
+  // SPIFFS on "storage" at /spiffs, counted for every user
+  static esp_err_t mount_storage(void);
+  static void unmount_storage(void);
+
   static esp_err_t start_webserver(void);
   static void stop_webserver(void);
 };
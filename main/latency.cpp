@@ -0,0 +1,23 @@
+#include "latency.h"
+
+namespace Latency_NS {
+
+Histogram stages[STAGE_COUNT];
+
+const char* stage_name(Stage stage)
+{
+    switch (stage) {
+    case STAGE_ACQUISITION:
+        return "acquisition";
+    case STAGE_FILTER:
+        return "filter";
+    case STAGE_ACTUATION:
+        return "actuation";
+    case STAGE_PUBLISH:
+        return "publish";
+    default:
+        return "unknown";
+    }
+}
+
+} // namespace Latency_NS
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "esp_timer.h"
+#include <cstddef>
+#include <cstdint>
+
+// Latency of the sensor pipeline stages. Every stage is recorded by one
+// task, others only read the counters for export.
+namespace Latency_NS {
+
+// Lower 32 bits of esp_timer_get_time(), differences are right across the
+// wrap for up to ~71 minutes
+inline uint32_t now_us(void) { return static_cast<uint32_t>(esp_timer_get_time()); }
+
+enum Stage : uint8_t {
+    STAGE_ACQUISITION = 0, // Conversion start to values read
+    STAGE_FILTER, // Values read to sample published
+    STAGE_ACTUATION, // Sample published to fan duty set
+    STAGE_PUBLISH, // Sample published to MQTT message sent
+    STAGE_COUNT
+};
+
+// ======================== Histogram =========================================
+// Bucket 0 - 0 us, bucket k - [2^(k-1), 2^k) us, the last one is open
+class Histogram {
+public:
+    static constexpr uint8_t BUCKETS = 25; // The last one from ~8.4 s
+
+protected:
+    volatile uint32_t _counts[BUCKETS] {};
+    volatile uint32_t _count { 0 };
+    volatile uint32_t _max { 0 };
+
+public:
+    static uint8_t bucket_of(uint32_t latency)
+    {
+        uint8_t bucket = latency ? 32 - __builtin_clz(latency) : 0;
+        return bucket < BUCKETS ? bucket : BUCKETS - 1;
+    }
+    // Latencies of the bucket are below this value
+    static uint32_t upper_bound(uint8_t bucket) { return 1UL << bucket; }
+
+    void add(uint32_t latency)
+    {
+        ++_counts[bucket_of(latency)];
+        ++_count;
+        if (latency > _max) {
+            _max = latency;
+        }
+    }
+    void clear(void)
+    {
+        for (uint8_t i = 0; i < BUCKETS; i++) {
+            _counts[i] = 0;
+        }
+        _count = 0;
+        _max = 0;
+    }
+
+    uint32_t count(void) const { return _count; }
+    uint32_t count(uint8_t bucket) const { return _counts[bucket]; }
+    uint32_t max(void) const { return _max; }
+
+    // Upper bound of the bucket holding "percent" of recorded latencies
+    uint32_t percentile(uint8_t percent) const
+    {
+        const uint64_t wanted = (static_cast<uint64_t>(_count) * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (uint8_t i = 0; i < BUCKETS; i++) {
+            seen += _counts[i];
+            if (seen >= wanted && seen > 0) {
+                return upper_bound(i);
+            }
+        }
+        return _max;
+    }
+};
+
+extern Histogram stages[STAGE_COUNT];
+const char* stage_name(Stage stage);
+
+} // namespace Latency_NS
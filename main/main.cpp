@@ -4,21 +4,46 @@
 #include "esp_log.h"
 #include "esp_netif.h"
 #include "esp_system.h"
+#include "esp_timer.h"
+#include "estimator.h"
 #include "fan.h"
+#include "filters.h"
 #include "freertos/queue.h"
 #include "gpio.h" // IWYU pragma: keep
+#include "history.h"
 #include "http.h" // IWYU pragma: keep
 #include "mqtt.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "onewire_multi.h"
 #include "ota.h"
 #include "secrets.h"
+#include "tach.h"
+#include "telemetry_log.h"
 #include "wifi_simple.h"
-#include <cmath>
+#include "zone.h"
 #include <cstdint>
 #include <cstdio>
-
-constexpr uint8_t SENSOR_COUNT { 2 };
+#include <cstring>
+#include <new>
+
+constexpr uint8_t MAX_SENSOR_COUNT { Fan_NS::SENSOR_COUNT }; // Sensors on the 1-Wire bus
+static_assert(MAX_SENSOR_COUNT <= ONEWIRE_MAX_DEVICES, "Alarm sweep covers every sensor");
+constexpr uint8_t RESCAN_AFTER_FAILURES { 10 }; // Failed sweeps in a row
+constexpr uint16_t SEARCH_EVERY_SWEEPS { 300 }; // Added sensors are found within ~15 min
+constexpr uint32_t SWEEP_PERIOD_MS { 2000 }; // Pause between bus sweeps
+constexpr uint8_t FULL_SWEEP_EVERY { 15 }; // Every Nth sweep reads all sensors
+constexpr uint8_t READINGS_PER_SAMPLE { 3 }; // Median of a triple is published
+// Every sensor has a fresh conversion in one of FULL_SWEEP_EVERY / 3 samples
+static_assert(FULL_SWEEP_EVERY % READINGS_PER_SAMPLE == 0,
+    "Full sweeps must line up with the published samples");
+constexpr uint32_t SENSOR_READ_MS { 25 }; // Scratchpad and alarm window of a sensor
+// Longest sweep: the pause, a 12 bit conversion up to its timeout and the
+// reads of all sensors, ms
+constexpr uint32_t MAX_SWEEP_MS { SWEEP_PERIOD_MS
+    + OneWire::DS18B20::conversion_timeout(MAX_RESOLUTION) / 1000 + MAX_SENSOR_COUNT * SENSOR_READ_MS };
+// Oldest conversion behind a sample, a shorter stale time is always stale
+constexpr uint32_t MIN_STALE_AFTER { ((FULL_SWEEP_EVERY + READINGS_PER_SAMPLE) * MAX_SWEEP_MS + 999) / 1000 };
 uint16_t STACK_TASK_SIZE { 4096 }; // 1024 * 4
 
 // ============================ Global Variables ==============================
@@ -35,13 +60,11 @@ volatile bool is_http_running { false };
 // TODO: Make class Event Manager
 EventGroupHandle_t common_event_group = xEventGroupCreate();
 
-// Queue for fan control must contain at least 6 elements. Because average
-// data contain 6 measurements from sensors
-QueueHandle_t temperature_queue_PWM = xQueueCreate(10, sizeof(SensorData_t));
-// Queue for mqtt - % duty cycle
-QueueHandle_t duty_percent_queue = xQueueCreate(5, sizeof(uint8_t));
-// Queue for mqtt - temperature
-QueueHandle_t temperature_queue = xQueueCreate(5, sizeof(SensorData_t));
+// Queue for mqtt - % duty cycle of every fan zone
+QueueHandle_t duty_percent_queue = xQueueCreate(PERCENT_QUEUE_LENGTH, sizeof(FanDuty_t));
+// Measured and estimated temperatures for the fan and mqtt tasks. The sensor
+// task never waits for them, the fan task is woken by FAN_EVENT_SAMPLE.
+SensorChannel_t sensor_channel;
 // ===================== FreeRTOS Tasks =======================================
 // Fan control
 TaskHandle_t fan_control_handle = NULL;
@@ -49,9 +72,6 @@ void fan_control(void* pvParameter)
 {
     Nvs_NS::Nvs* nvs = static_cast<Nvs_NS::Nvs*>(pvParameter);
 
-    // Pin for fan
-    uint8_t pin = 13;
-
     uint32_t min_temp_hdd = MIN_HDD_TEMP;
     uint32_t max_temp_hdd = MAX_HDD_TEMP;
     uint32_t frequency = FREQUENCY;
@@ -61,31 +81,188 @@ void fan_control(void* pvParameter)
     nvs->read_u32(MAX_HDD_TEMP_KEY, &max_temp_hdd, &max_temp_hdd);
     nvs->read_u32(FREQUENCY_KEY, &frequency, &frequency);
 
-    Fan_NS::FanPWM fan(pin, &temperature_queue_PWM, &duty_percent_queue,
-        &frequency, &min_temp_hdd, &max_temp_hdd);
+    // A fan of every zone in Fan_NS::zone_map. They are made once and live
+    // as long as the task. All channels share LEDC_TIMER_0 and its
+    // frequency; the build's frequency on the first channel gets the duty
+    // math with constants, anything else is computed at run time.
+    Fan_NS::ZoneManager zones(&sensor_channel);
+    // Curve "30:0,35:30,40:60,45:100" of zone 0 and the default of others
+    char common_curve[Control_NS::CURVE_MAX_POINTS * 8 + 1] = FAN_CURVE;
+    nvs->read_str(FAN_CURVE_KEY, common_curve, FAN_CURVE);
+    for (uint8_t i = 0; i < Fan_NS::zone_map.count; i++) {
+        const Fan_NS::Zone& zone = Fan_NS::zone_map.zones[i];
+        Fan_NS::Output* output = i == 0 && frequency == FREQUENCY
+            ? static_cast<Fan_NS::Output*>(
+                new (std::nothrow) Fan_NS::Pwm<FREQUENCY, LEDC_TIMER_10_BIT, LEDC_CHANNEL_0>)
+            : static_cast<Fan_NS::Output*>(
+                new (std::nothrow) Fan_NS::RuntimePwm(frequency, static_cast<ledc_channel_t>(i)));
+        Fan_NS::FanPWM* fan = nullptr;
+        if (output != nullptr) {
+            fan = new (std::nothrow) Fan_NS::FanPWM(*output, zone.gpio, zone.id,
+                &duty_percent_queue, min_temp_hdd, max_temp_hdd);
+        }
+        if (fan == nullptr) {
+            ESP_LOGE("Fan", "No memory for the fan of zone %d", zone.id);
+            break;
+        }
+        fan->set_sensors(zone.sensors);
+        fan->set_mode(zone.mode);
+
+        if (zone.id == 0) {
+            fan->set_fan_curve(common_curve);
+        } else {
+            char key[16] = { 0 };
+            char curve[sizeof(common_curve)] = { 0 };
+            strcpy(curve, common_curve);
+            snprintf(key, sizeof(key), "%s%d", ZONE_CURVE_KEY, zone.id);
+            nvs->read_str(key, curve, common_curve);
+            fan->set_fan_curve(curve);
+        }
+        zones.add(fan);
+    }
+    if (zones.count() == 0) {
+        ESP_LOGE("Fan", "No fan zones");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    // Per drive: "fan_weight0", "drive_min0", "drive_max0" ...
+    for (uint8_t i = 0; i < Fan_NS::SENSOR_COUNT; i++) {
+        char key[16] = { 0 };
+        uint32_t weight = 1;
+        snprintf(key, sizeof(key), "%s%d", FAN_WEIGHT_KEY, i);
+        nvs->read_u32(key, &weight, &weight);
+
+        uint32_t drive_min = min_temp_hdd;
+        uint32_t drive_max = max_temp_hdd;
+        snprintf(key, sizeof(key), "%s%d", DRIVE_MIN_TEMP_KEY, i);
+        nvs->read_u32(key, &drive_min, &drive_min);
+        snprintf(key, sizeof(key), "%s%d", DRIVE_MAX_TEMP_KEY, i);
+        nvs->read_u32(key, &drive_max, &drive_max);
+        for (uint8_t z = 0; z < zones.count(); z++) {
+            zones.fan(z).set_weight(i, weight);
+            if (zones.fan(z).set_curve(i, drive_min, drive_max) != ESP_OK) {
+                ESP_LOGE("Fan", "Wrong curve of drive %d: %u .. %u", i, drive_min, drive_max);
+                break;
+            }
+        }
+    }
+    // Closed loop to the target temperature instead of the curves
+    uint32_t control = FAN_CONTROL;
+    uint32_t target = PID_TARGET;
+    uint32_t kp = PID_KP;
+    uint32_t ki = PID_KI;
+    uint32_t kd = PID_KD;
+    nvs->read_u32(FAN_CONTROL_KEY, &control, &control);
+    nvs->read_u32(PID_TARGET_KEY, &target, &target);
+    nvs->read_u32(PID_KP_KEY, &kp, &kp);
+    nvs->read_u32(PID_KI_KEY, &ki, &ki);
+    nvs->read_u32(PID_KD_KEY, &kd, &kd);
+
+    // Hysteresis and duty step
+    uint32_t rise = HYSTERESIS_RISE;
+    uint32_t fall = HYSTERESIS_FALL;
+    uint32_t duty_step = DUTY_STEP;
+    nvs->read_u32(HYSTERESIS_RISE_KEY, &rise, &rise);
+    nvs->read_u32(HYSTERESIS_FALL_KEY, &fall, &fall);
+    nvs->read_u32(DUTY_STEP_KEY, &duty_step, &duty_step);
+
+    // Stale data: no new conversion of a drive for "stale_after" seconds
+    uint32_t stale_after = STALE_AFTER;
+    uint32_t failsafe_duty = FAILSAFE_DUTY;
+    nvs->read_u32(STALE_AFTER_KEY, &stale_after, &stale_after);
+    nvs->read_u32(FAILSAFE_DUTY_KEY, &failsafe_duty, &failsafe_duty);
+    if (failsafe_duty > 100) {
+        ESP_LOGE("Fan", "Wrong failsafe duty %u %%, using 100 %%", failsafe_duty);
+        failsafe_duty = 100;
+    }
+    if (stale_after < MIN_STALE_AFTER) {
+        ESP_LOGE("Fan", "Stale time %u s is under a full sweep, using %u s", stale_after,
+            MIN_STALE_AFTER);
+        stale_after = MIN_STALE_AFTER;
+    }
+
+    for (uint8_t z = 0; z < zones.count(); z++) {
+        Fan_NS::FanPWM& fan = zones.fan(z);
+        fan.set_control(static_cast<Fan_NS::control_mode>(control));
+        fan.set_pid(target, kp, ki, kd);
+        fan.set_hysteresis(rise, fall);
+        fan.set_duty_step(duty_step);
+        fan.set_failsafe(stale_after, failsafe_duty);
+    }
+
+    // Tach of the first zone, 0 pulses - the fan has none. Other zones
+    // follow the curve in RPM mode.
+    uint32_t pulses = FAN_PULSES;
+    uint32_t stall_rpm = STALL_RPM;
+    uint32_t max_rpm = MAX_RPM;
+    nvs->read_u32(FAN_PULSES_KEY, &pulses, &pulses);
+    nvs->read_u32(STALL_RPM_KEY, &stall_rpm, &stall_rpm);
+    nvs->read_u32(MAX_RPM_KEY, &max_rpm, &max_rpm);
+#if ONEWIRE_BUS_COUNT > 3 && ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+    if (FAN_TACH_GPIO == 14 && pulses) {
+        ESP_LOGE("Fan", "GPIO14 is the 4th 1-Wire bus, move the tach with FAN_TACH_GPIO");
+        pulses = 0;
+    }
+#endif
+    zones.fan(0).set_tach(static_cast<gpio_num_t>(FAN_TACH_GPIO), pulses, stall_rpm, max_rpm);
+    if (control == static_cast<uint32_t>(Fan_NS::control_mode::RPM)
+        && (!zones.fan(0).tach_enabled() || max_rpm == 0)) {
+        ESP_LOGE("Fan", "RPM mode needs the tach and the full speed, using the curve");
+    }
+
+    // Control passes are due every CONTROL_PERIOD_MS whatever the sensors
+    // and the network do, samples are handled as they come in between
+    constexpr int64_t period = Fan_NS::CONTROL_PERIOD_MS * 1000LL;
+    int64_t due = esp_timer_get_time() + period;
     bool set_full_power = { false };
     for (;;) {
+        // Sleep until a sample arrives, the mode changes or a pass is due
+        const int64_t now = esp_timer_get_time();
+        const TickType_t wait = now < due
+            ? (static_cast<uint32_t>((due - now) / 1000) + portTICK_PERIOD_MS) / portTICK_PERIOD_MS
+            : 0;
+        xTaskNotifyWait(0, UINT32_MAX, NULL, wait);
+        const bool periodic = esp_timer_get_time() >= due;
+
         // If http server is running
         if (is_http_running == true) {
-            // Turn on the fan
+            // Turn on the fans
             if (set_full_power == false) {
                 set_full_power = true;
-                uint8_t power_percent = 100;
-
-                fan.set_duty(fan.get_max_duty());
-                ESP_LOGI("Fan", "Fan is turned on for full power");
-                if (xQueueSend(duty_percent_queue, &power_percent, 0) != pdPASS) {
-                    ESP_LOGE("FAN", "Failed to send duty percent.");
-                }
+                zones.full_power();
             }
         } else {
-            // Wait for at least 6 measurements
-            if (uxQueueMessagesWaiting(temperature_queue_PWM) >= 6) {
-                fan.start();
+            // Every drive has its own channel, any new measurement counts
+            if (periodic || zones.pending()) {
+                zones.start();
+            }
+            if (periodic) {
+                zones.tach();
             }
             set_full_power = false;
         }
-        vTaskDelay(pdMS_TO_TICKS(1000));
+
+        if (periodic) {
+            const int64_t finished = esp_timer_get_time();
+            const uint32_t pass = static_cast<uint32_t>(finished - due);
+            Control_NS::LoopStats& stats = Control_NS::loop_stats;
+            ++stats.passes;
+            if (pass > stats.max_pass_us) {
+                stats.max_pass_us = pass;
+            }
+            if (pass > Fan_NS::CONTROL_DEADLINE_MS * 1000) {
+                ++stats.deadline_misses;
+                ESP_LOGW("Fan", "Control pass ended %u us after it was due", pass);
+            }
+            due += period;
+            // Passes that were due meanwhile are lost
+            if (finished >= due) {
+                const uint32_t lost = static_cast<uint32_t>((finished - due) / period) + 1;
+                stats.deadline_misses += lost;
+                due += lost * period;
+            }
+        }
     }
 }
 
@@ -98,6 +275,7 @@ void http_server(void* pvParameter)
 
     if (server.start_webserver() != ESP_OK) {
         is_http_running = false;
+        xTaskNotify(fan_control_handle, FAN_EVENT_MODE, eSetBits);
         vTaskDelete(NULL);
         return;
     }
@@ -133,88 +311,365 @@ void wifi_connection(void* pvParameter)
     }
 }
 
-// Processes three sensor values by discarding min/max and averaging remaining
-// values
-float process_sensor_values(float a, float b, float c)
+// Find sensors on the bus. ROM codes are cached in NVS, the sensor number is
+// the slot in the cache, so per-sensor keys stay with their drive. At boot
+// the bus is searched only when a cached sensor doesn't answer, "search"
+// looks for added sensors too.
+uint8_t discover_sensors(OneWire::DS18B20& onewire, Nvs_NS::Nvs* nvs,
+    uint8_t (*addresses)[8], bool search)
+{
+    // Sensors installed before the discovery, they keep their order
+    // (left - 0, right - 1) when there is no cache yet
+    static const uint8_t default_address[][8] = {
+        // Left temperature sensor
+        { 0x28, 0xf5, 0x48, 0x16, 0x00, 0x00, 0x00, 0x61 },
+        // Right temperature sensor
+        { 0x28, 0x1c, 0xc1, 0x11, 0x00, 0x00, 0x00, 0x60 },
+    };
+
+    uint8_t count = 0;
+    size_t length = MAX_SENSOR_COUNT * sizeof(addresses[0]);
+    const bool cached = nvs->read_blob(SENSOR_ROMS_KEY, addresses, &length) == ESP_OK;
+    if (cached) {
+        count = length / sizeof(addresses[0]);
+        bool present = (count > 0);
+        for (uint8_t i = 0; i < count && present && !search; i++) {
+            uint8_t data[9];
+            present = (onewire.read_scratchpad(addresses[i], data) == ESP_OK);
+        }
+        if (present && !search) {
+            ESP_LOGI("DS18B20", "Using %d cached sensors", count);
+            return count;
+        }
+    } else {
+        count = sizeof(default_address) / sizeof(default_address[0]);
+        memcpy(addresses, default_address, sizeof(default_address));
+    }
+
+    uint8_t found[MAX_SENSOR_COUNT][8];
+    uint8_t found_count = 0;
+    if (onewire.search_rom(found, MAX_SENSOR_COUNT, found_count) != ESP_OK) {
+        ESP_LOGE("DS18B20", "No sensors found on the bus");
+        // Cached sensors keep their numbers for the next search
+        return cached ? count : 0;
+    }
+
+    // Cached sensors keep their slots also while they are missing, the
+    // default ones only if they are there
+    uint8_t before[MAX_SENSOR_COUNT][8];
+    memcpy(before, addresses, count * sizeof(addresses[0]));
+    const uint8_t before_count = count;
+    count = OneWire::merge_roms(addresses, count, found, found_count, MAX_SENSOR_COUNT, cached);
+    if (!cached || count != before_count || memcmp(before, addresses, count * sizeof(addresses[0])) != 0) {
+        nvs->write_blob(SENSOR_ROMS_KEY, addresses, count * sizeof(addresses[0]));
+    }
+    ESP_LOGI("DS18B20", "Found %d of %d sensors", found_count, count);
+    return count;
+}
+
+// NVS value is 32 bits, out of range one is the default
+static uint8_t checked_resolution(uint32_t resolution, uint8_t sensor)
+{
+    if (resolution < MIN_RESOLUTION || resolution > MAX_RESOLUTION) {
+        ESP_LOGE("DS18B20", "Sensor %d: resolution %u is not supported, using %d", sensor,
+            resolution, SENSOR_RESOLUTION);
+        return SENSOR_RESOLUTION;
+    }
+    return static_cast<uint8_t>(resolution);
+}
+
+// Resolution of every sensor, "sensor_res0", "sensor_res1" ...
+// Alarm band is the fan range (MIN_HDD_TEMP .. MAX_HDD_TEMP).
+// Lower resolution gives shorter conversion: 9 bit - 93.75 ms,
+// 10 bit - 187.5 ms, 11 bit - 375 ms, 12 bit - 750 ms
+void configure_sensors(OneWire::DS18B20& onewire, Nvs_NS::Nvs* nvs,
+    uint8_t (*addresses)[8], uint8_t count)
+{
+    uint32_t min_temp_hdd = MIN_HDD_TEMP;
+    uint32_t max_temp_hdd = MAX_HDD_TEMP;
+    nvs->read_u32(MIN_HDD_TEMP_KEY, &min_temp_hdd, &min_temp_hdd);
+    nvs->read_u32(MAX_HDD_TEMP_KEY, &max_temp_hdd, &max_temp_hdd);
+
+    for (uint8_t i = 0; i < count; i++) {
+        char key[16] = { 0 };
+        uint32_t resolution = SENSOR_RESOLUTION;
+        snprintf(key, sizeof(key), "%s%d", SENSOR_RESOLUTION_KEY, i);
+        nvs->read_u32(key, &resolution, &resolution);
+        resolution = checked_resolution(resolution, i);
+        if (onewire.set_resolution(addresses[i], resolution) != ESP_OK) {
+            ESP_LOGE("DS18B20", "Failed to set resolution of sensor %d", i);
+        }
+        // Fan range is the alarm band kept in EEPROM after power loss
+        if (onewire.set_alarms(addresses[i], max_temp_hdd, min_temp_hdd, true) != ESP_OK) {
+            ESP_LOGE("DS18B20", "Failed to set alarms of sensor %d", i);
+        }
+    }
+}
+
+// Alarm window of whole degrees around the last reading. Sensor takes part
+// in the alarm search when it has moved out of the reading's degree. The
+// scratchpad of the reading has the current window, it's written only when
+// the reading left it.
+void update_alarm_window(OneWire::DS18B20& onewire, uint8_t (&address)[8],
+    Temp_NS::q4_t temperature, const uint8_t (&scratchpad)[9])
 {
-    float min_val = fminf(a, fminf(b, c));
-    float max_val = fmaxf(a, fmaxf(b, c));
+    int8_t whole = static_cast<int8_t>(Temp_NS::floor_degrees(temperature));
+    if (onewire.set_alarms(address, whole + 1, whole - 1, scratchpad) != ESP_OK) {
+        ESP_LOGE("DS18B20", "Failed to set alarm window");
+    }
+}
 
-    // Calculate sum excluding min and max values (effectively gets middle values)
-    float avg = a + b + c - min_val - max_val;
+#if ONEWIRE_BUS_COUNT > 1
+// One sensor on every bus, sensor number is the bus number
+uint8_t discover_sensors(OneWire::MultiBus& onewire, Nvs_NS::Nvs* nvs,
+    uint8_t (*addresses)[8], bool search)
+{
+    ESP_LOGI("DS18B20", "Using %d buses", onewire.count());
+    return onewire.count();
+}
 
-    // Return average of the three values
-    return avg;
+// Resolutions from the same keys as on the single bus, all buses at once
+void configure_sensors(OneWire::MultiBus& onewire, Nvs_NS::Nvs* nvs,
+    uint8_t (*addresses)[8], uint8_t count)
+{
+    uint8_t resolutions[ONEWIRE_MAX_BUSES] = {};
+    for (uint8_t i = 0; i < count; i++) {
+        char key[16] = { 0 };
+        uint32_t resolution = SENSOR_RESOLUTION;
+        snprintf(key, sizeof(key), "%s%d", SENSOR_RESOLUTION_KEY, i);
+        nvs->read_u32(key, &resolution, &resolution);
+        resolutions[i] = checked_resolution(resolution, i);
+    }
+    if (onewire.set_resolutions(resolutions) != ESP_OK) {
+        ESP_LOGE("DS18B20", "Failed to set resolution of some buses");
+    }
 }
+#endif
+
 // Get temperature task
 TaskHandle_t get_temperature_handle = NULL;
 void get_temperature(void* pvParameter)
 {
-    // Array of DS18B20 addresses
-    uint8_t ds18b20_address[SENSOR_COUNT][8] = {
-        // Left temperature sensor
-        { 0x28, 0xf5, 0x48, 0x16, 0x00, 0x00, 0x00, 0x61 },
-        // Right temperature sensor
-        { 0x28, 0x1c, 0xc1, 0x11, 0x00, 0x00, 0x00, 0x60 },
-        // ...
-    };
+    Nvs_NS::Nvs* nvs = static_cast<Nvs_NS::Nvs*>(pvParameter);
+
     // DS18B20 initialization
-    OneWire::DS18B20 onewire_pin { GPIO_NUM_12 };
+#if ONEWIRE_BUS_COUNT > 1 && ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    OneWire::MultiBus onewire_pin { ONEWIRE_BUS_COUNT };
+#elif ONEWIRE_BUS_COUNT > 1
+    const gpio_num_t bus_pins[ONEWIRE_MAX_BUSES] = ONEWIRE_BUS_PINS;
+    OneWire::MultiBus onewire_pin { bus_pins, ONEWIRE_BUS_COUNT };
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+    OneWire::DS18B20 onewire_pin { ONEWIRE_UART_PORT };
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    OneWire::DS18B20 onewire_pin { static_cast<uint8_t>(ONEWIRE_SIM_DEVICES) };
+#else
+    OneWire::DS18B20 onewire_pin { ONEWIRE_GPIO_PIN, ONEWIRE_INVERT_LOGIC };
+#endif
 
-    // Uncomment this to read ROM address of DS18B20, one sensor at a time
-    // onewire_pin.readROM();
+    // Array of DS18B20 addresses
+    uint8_t ds18b20_address[MAX_SENSOR_COUNT][8] = {};
+    uint8_t sensor_count = discover_sensors(onewire_pin, nvs, ds18b20_address, false);
+    configure_sensors(onewire_pin, nvs, ds18b20_address, sensor_count);
+    // Failed sweeps in a row for every sensor
+    uint8_t failures[MAX_SENSOR_COUNT] = { 0 };
+    // Bus search is due: periodic, a sensor stopped answering or none found
+    uint16_t sweeps_since_search = 0;
+    bool search = false;
 
     SensorData_t sensor_data = {};
 
-    // Circular buffers to store last 3 readings for each sensor (2 sensors)
-    float sensor_values[2][3] = {};
-    // Index pointers for circular buffers (0-2 for each sensor)
-    uint8_t value_index[2] = { 0 };
+    // Median of the last 3 readings filters out outliers of every sensor
+    Filter_NS::MedianFilter<3, Temp_NS::q4_t> median[MAX_SENSOR_COUNT];
+    // Temperature and its rate, fan gets the temperature "horizon" ahead
+    Filter_NS::TrendKalman estimator[MAX_SENSOR_COUNT];
+    uint32_t horizon = PREDICTION_HORIZON; // s
+    nvs->read_u32(PREDICTION_HORIZON_KEY, &horizon, &horizon);
+    int64_t last_update[MAX_SENSOR_COUNT] = { 0 }; // us
+    // Readings since the last sent median (0-2 for each sensor)
+    uint8_t value_index[MAX_SENSOR_COUNT] = { 0 };
+    // Flags of the readings of the triple, KEPT only if all of them were
+    uint8_t sample_flags[MAX_SENSOR_COUNT] = { 0 };
+    // Samples sent for every sensor
+    uint16_t seq[MAX_SENSOR_COUNT] = { 0 };
+
+    // Last sweep results
+    Temp_NS::q4_t new_temp[MAX_SENSOR_COUNT] = {};
+    esp_err_t results[MAX_SENSOR_COUNT] = {};
+    // Sweeps since the last full sweep, alarm sweeps in between
+    uint8_t sweep_number = 0;
 
     for (;;) {
-        vTaskDelay(pdMS_TO_TICKS(2000));
-        for (uint8_t i = 0; i < SENSOR_COUNT; i++) {
-            sensor_data.sensor_id = i;
-            vTaskDelay(pdMS_TO_TICKS(2000));
-
-            // Variable to store new temperature reading
-            float new_temp;
+        vTaskDelay(pdMS_TO_TICKS(SWEEP_PERIOD_MS));
+
+        // Sensor was added, replaced or bus is empty - look for sensors again
+        if (sensor_count == 0 || search || ++sweeps_since_search >= SEARCH_EVERY_SWEEPS) {
+            uint8_t before[MAX_SENSOR_COUNT][8];
+            memcpy(before, ds18b20_address, sizeof(before));
+            const uint8_t before_count = sensor_count;
+            sensor_count = discover_sensors(onewire_pin, nvs, ds18b20_address, true);
+            search = false;
+            sweeps_since_search = 0;
+            // Known sensors keep their numbers, only new slots start over
+            bool changed = false;
+            for (uint8_t i = 0; i < MAX_SENSOR_COUNT; i++) {
+                if (i < before_count && i < sensor_count
+                    && memcmp(before[i], ds18b20_address[i], 8) == 0) {
+                    continue;
+                }
+                changed |= i < sensor_count;
+                median[i].clear();
+                estimator[i].reset();
+                failures[i] = 0;
+                value_index[i] = 0;
+            }
+            if (changed) {
+                configure_sensors(onewire_pin, nvs, ds18b20_address, sensor_count);
+                sweep_number = 0;
+            }
+            if (changed || sensor_count == 0) {
+                continue;
+            }
+        }
 
-            onewire_pin.get_temp(ds18b20_address[i], new_temp);
+        // All sensors convert at once, the sweep costs one conversion time
+        uint8_t flags[MAX_SENSOR_COUNT] = { 0 };
+        const uint32_t conversion_start = Latency_NS::now_us();
+#if ONEWIRE_BUS_COUNT > 1
+        // Buses are read in parallel, the sweep costs one scratchpad read
+        onewire_pin.get_temps(new_temp, results);
+        (void)sweep_number; // Every multi-bus sweep is a full one
+#else
+        // Between full sweeps only sensors out of their alarm window are
+        // read, the rest keep the last value
+        bool alarms[MAX_SENSOR_COUNT] = { false };
+        uint8_t scratchpads[MAX_SENSOR_COUNT][9];
+        bool full_sweep = (sweep_number == 0);
+        if (!full_sweep
+            && onewire_pin.get_alarm_temps(ds18b20_address, sensor_count,
+                   new_temp, results, alarms, scratchpads)
+                != ESP_OK) {
+            ESP_LOGW("DS18B20", "Alarm sweep failed, reading all sensors");
+            full_sweep = true;
+        }
+        if (full_sweep) {
+            onewire_pin.get_temps(ds18b20_address, sensor_count, new_temp, results, scratchpads);
+        }
+        sweep_number = (sweep_number + 1) % FULL_SWEEP_EVERY;
 
-            ESP_LOGI("DS18B20", "Temperature %d: %.2f", i, sensor_data.temperature);
+        for (uint8_t i = 0; i < sensor_count; i++) {
+            if (!full_sweep && !alarms[i]) {
+                flags[i] |= SENSOR_KEPT;
+            } else if (results[i] == ESP_OK) {
+                update_alarm_window(onewire_pin, ds18b20_address[i], new_temp[i], scratchpads[i]);
+            }
+        }
+#endif
+        const int64_t now = esp_timer_get_time();
+        const uint32_t conversion_end = static_cast<uint32_t>(now);
+        Latency_NS::stages[Latency_NS::STAGE_ACQUISITION].add(conversion_end - conversion_start);
+        ESP_LOGI("DS18B20", "Conversion took %u us",
+            onewire_pin.get_conversion_latency());
+#if ONEWIRE_SLOT_STATS && ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO && ONEWIRE_BUS_COUNT == 1
+        // Low pulse width in CPU cycles, jitter is the max-min spread
+        ESP_LOGI("DS18B20", "Write-1 slot avg %u jitter %u, read slot avg %u jitter %u cycles",
+            onewire_pin.get_write_stats().average(), onewire_pin.get_write_stats().jitter(),
+            onewire_pin.get_read_stats().average(), onewire_pin.get_read_stats().jitter());
+#endif
+
+        for (uint8_t i = 0; i < sensor_count; i++) {
+            if (results[i] != ESP_OK) {
+                ESP_LOGE("DS18B20", "Failed to read sensor %d", i);
+                sweep_number = 0; // Don't keep the failed value until full sweep
+                // Once in a streak: a missing sensor keeps its slot
+                if (failures[i] < UINT8_MAX && ++failures[i] == RESCAN_AFTER_FAILURES) {
+                    search = true; // On the next sweep
+                }
+                continue;
+            }
+            if (failures[i] > 0) {
+                flags[i] |= SENSOR_RECOVERED;
+            }
+            failures[i] = 0;
 
-            // Store new reading in circular buffer
-            sensor_values[i][value_index[i]] = new_temp;
+            char text[Temp_NS::FORMAT_SIZE];
+            Temp_NS::format(text, sizeof(text), new_temp[i]);
+            ESP_LOGI("DS18B20", "Temperature %d: %s", i, text);
 
-            // Update circular buffer index (wraps around at 3)
-            value_index[i] = (value_index[i] + 1) % 3;
+            Temp_NS::q4_t filtered_temp = median[i].push(new_temp[i]);
+            estimator[i].update(filtered_temp, static_cast<uint32_t>((now - last_update[i]) / 1000));
+            last_update[i] = now;
 
-            // When we've collected 3 readings (index wraps back to 0)
+            // One converted reading makes the median fresh
             if (value_index[i] == 0) {
-                // Process the three readings to filter out outliers
-                float filtered_temp = process_sensor_values(sensor_values[i][0], // Oldest reading
-                    sensor_values[i][1], // Middle reading
-                    sensor_values[i][2] // Newest reading
-                );
+                sample_flags[i] = flags[i];
+            } else {
+                const uint8_t kept = sample_flags[i] & flags[i] & SENSOR_KEPT;
+                sample_flags[i] = ((sample_flags[i] | flags[i]) & ~SENSOR_KEPT) | kept;
+            }
 
-                // Prepare data structure for queue
+            // Every third reading is sent, the median of non-overlapping
+            // triples
+            value_index[i] = (value_index[i] + 1) % READINGS_PER_SAMPLE;
+            if (value_index[i] == 0) {
+                // Prepare data structure for the channel
+                if (!median[i].full()) {
+                    sample_flags[i] |= SENSOR_WARMUP;
+                }
+                sensor_data.conversion_start = conversion_start;
+                sensor_data.conversion_end = conversion_end;
+                sensor_data.seq = seq[i]++;
                 sensor_data.sensor_id = i;
+                sensor_data.flags = sample_flags[i];
+                sensor_data.kind = SENSOR_MEASURED;
                 sensor_data.temperature = filtered_temp;
-
-                // Send to mqtt task
-                if (xQueueSend(temperature_queue, &sensor_data, portMAX_DELAY) != pdPASS) {
-                    ESP_LOGE("DS18B20", "Failed to send data to queue from main.cpp");
-                }
-                // Send to fan control task
-                if (xQueueSend(temperature_queue_PWM, &sensor_data, portMAX_DELAY) != pdPASS) {
-                    ESP_LOGE("DS18B20", "Failed to send data to queue from main.cpp");
-                }
+                sensor_data.published = Latency_NS::now_us();
+                sensor_channel.publish(sensor_data);
+                History_NS::history.append(i, History_NS::now_s(), filtered_temp);
+                Telemetry_NS::record(i, History_NS::now_s(), filtered_temp);
+
+                sensor_data.kind = SENSOR_ESTIMATED;
+                sensor_data.temperature = estimator[i].predict(horizon);
+                Temp_NS::format(text, sizeof(text), sensor_data.temperature);
+                // Rate in 1/1000 C per minute
+                ESP_LOGI("DS18B20", "Estimate %d: %s in %u s, rate %d mC/min", i, text,
+                    horizon, static_cast<int>((static_cast<int64_t>(estimator[i].rate()) * 60000)
+                                 >> Filter_NS::TrendKalman::RATE_SHIFT));
+                sensor_data.published = Latency_NS::now_us();
+                sensor_channel.publish(sensor_data);
+                Latency_NS::stages[Latency_NS::STAGE_FILTER].add(sensor_data.published - conversion_end);
+
+                // Wake fan control task, it follows estimates
+                xTaskNotify(fan_control_handle, FAN_EVENT_SAMPLE, eSetBits);
             }
         }
     }
 }
 
+// Telemetry log on the storage partition. Flash writes are slow, so they
+// are done here and not in the sensor or fan task.
+TaskHandle_t telemetry_log_handle = NULL;
+void telemetry_log(void* pvParameter)
+{
+    Telemetry_NS::BinaryLog& log = Telemetry_NS::telemetry_log;
+    if (Http_NS::HttpServer::mount_storage() != ESP_OK || log.open() != ESP_OK) {
+        ESP_LOGE("TelemetryLog", "Log is not available");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    Telemetry_NS::Record record;
+    for (;;) {
+        // A partial batch is written if no record comes for a while
+        if (xQueueReceive(Telemetry_NS::log_queue, &record,
+                pdMS_TO_TICKS(Telemetry_NS::FLUSH_PERIOD_MS))
+            == pdTRUE) {
+            log.append(record.series, record.time, record.value);
+        } else {
+            log.flush();
+        }
+    }
+}
+
 TaskHandle_t ota_update_handle = NULL;
 void ota_update(void* pvParameter)
 {
@@ -229,7 +684,7 @@ void ota_update(void* pvParameter)
 TaskHandle_t mqtt_connection_handle = NULL;
 void mqtt_connection(void* pvParameter)
 {
-    Mqtt_NS::Mqtt mqtt(common_event_group, temperature_queue, duty_percent_queue);
+    Mqtt_NS::Mqtt mqtt(common_event_group, sensor_channel, duty_percent_queue);
     for (;;) {
         mqtt.publish();
         mqtt.connection_watcher();
@@ -285,8 +740,10 @@ extern "C" void app_main(void)
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(esp_netif_init());
 
-    // Create NVS object
-    Nvs_NS::Nvs nvs(STORAGE_SPACE);
+    // Create NVS object. Static because tasks keep using it after return
+    static Nvs_NS::Nvs nvs(STORAGE_SPACE);
+    // Before the fan and MQTT tasks, both read it
+    Fan_NS::zone_map.load(nvs);
 
     // ======================= Tasks Looping ==================================
 
@@ -296,10 +753,16 @@ extern "C" void app_main(void)
     xTaskCreate(&mqtt_connection, "Mqtt", STACK_TASK_SIZE, &nvs, 5,
         &mqtt_connection_handle);
 
+    // Before the producers, they notify it by the handle. Above the network
+    // tasks, so control passes keep their deadline.
+    xTaskCreate(&fan_control, "FanControl", STACK_TASK_SIZE, &nvs, 6,
+        &fan_control_handle);
+
     xTaskCreate(&get_temperature, "Temperature", STACK_TASK_SIZE, &nvs, 5,
         &get_temperature_handle);
 
-    xTaskCreate(&fan_control, "FanControl", STACK_TASK_SIZE, &nvs, 5, NULL);
+    xTaskCreate(&telemetry_log, "TelemetryLog", STACK_TASK_SIZE, NULL, 4,
+        &telemetry_log_handle);
 
     // Debug tasks
     // xTaskCreate(checkStackUsage, "CheckStack", STACK_TASK_SIZE, NULL, 5, NULL);
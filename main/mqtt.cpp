@@ -1,6 +1,12 @@
 #include "mqtt.h"
+#include "cJSON.h"
+#include "curve.h"
+#include "history.h"
+#include "telemetry_log.h"
 #include "nvs.h"
 #include "secrets.h"
+#include "tach.h"
+#include "zone.h"
 #include <cstdint>
 
 std::string get_current_ip()
@@ -27,10 +33,11 @@ esp_mqtt_client_config_t Mqtt::mqtt_cfg {};
 
 // Constructor
 Mqtt::Mqtt(EventGroupHandle_t& common_event_group,
-    QueueHandle_t& temperature_queue, QueueHandle_t& percent_queue)
+    const SensorChannel_t& sensor_channel, QueueHandle_t& percent_queue)
     : _state(state_m::NOT_INITIALISED)
     , _common_event_group(&common_event_group)
-    , _sensor_queue(&temperature_queue)
+    , _sensor_channel(&sensor_channel)
+    , _sensor_cursor(sensor_channel.subscribe())
     , _percent_queue(&percent_queue)
     , _mdns_mqtt_server({})
 {
@@ -147,15 +154,6 @@ void Mqtt::init(void)
         return;
     }
 
-    // Create queue set
-    if (_queue_set != nullptr) {
-        vQueueDelete(_queue_set);
-    }
-
-    _queue_set = xQueueCreateSet(2);
-    xQueueAddToSet(*_sensor_queue, _queue_set);
-    xQueueAddToSet(*_percent_queue, _queue_set);
-
     // Read from NVS
     Nvs_NS::Nvs nvs(STORAGE_SPACE);
     char ip[18] = { 0 };
@@ -247,8 +245,9 @@ esp_err_t Mqtt::mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
         _state = state_m::CONNECTED;
         _connection_retry = 0;
 
-        // Clear queues
-        xQueueReset(*_sensor_queue);
+        // Skip samples collected while disconnected, the cursor belongs to
+        // the publishing task
+        _resubscribe = true;
         xQueueReset(*_percent_queue);
 
         // Device left HDD
@@ -257,9 +256,20 @@ esp_err_t Mqtt::mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
         // Device right HDD
         esp_mqtt_client_publish(event->client, topic_right.c_str(),
             (get_device_json() + msg_right).c_str(), 0, 1, 1);
+        // Predicted temperatures
+        esp_mqtt_client_publish(event->client, topic_left_estimate.c_str(),
+            (get_device_json() + msg_left_estimate).c_str(), 0, 1, 1);
+        esp_mqtt_client_publish(event->client, topic_right_estimate.c_str(),
+            (get_device_json() + msg_right_estimate).c_str(), 0, 1, 1);
         // Device fan
         esp_mqtt_client_publish(event->client, topic_fan.c_str(),
             (get_device_json() + msg_fan).c_str(), 0, 1, 1);
+        _publish_zones(event->client);
+        // Fan tach
+        esp_mqtt_client_publish(event->client, topic_fan_rpm.c_str(),
+            (get_device_json() + msg_fan_rpm).c_str(), 0, 1, 1);
+        esp_mqtt_client_publish(event->client, topic_fan_alert.c_str(),
+            (get_device_json() + msg_fan_alert).c_str(), 0, 1, 1);
 
         // Subscribe to command topic
         esp_mqtt_client_subscribe(event->client, command_topic.c_str(), 0);
@@ -304,6 +314,7 @@ esp_err_t Mqtt::mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
 
             if (strncmp(event->data, "ENABLE_HTTP", event->data_len) == 0) {
                 is_http_running = true;
+                xTaskNotify(fan_control_handle, FAN_EVENT_MODE, eSetBits);
                 vTaskDelete(get_temperature_handle);
                 vTaskDelay(pdMS_TO_TICKS(100));
                 xTaskCreate(&http_server, "HTTP Server", STACK_TASK_SIZE * 2, NULL, 5,
@@ -313,11 +324,15 @@ esp_err_t Mqtt::mqtt_event_handler_cb(esp_mqtt_event_handle_t event)
                 // Restart because OTA conflicting after http server disable
                 esp_restart();
 
+            } else if (strncmp(event->data, "HISTORY", event->data_len) == 0) {
+                _publish_history();
+
             } else if (strncmp(event->data, "RESTART", event->data_len) == 0) {
                 esp_restart();
 
             } else if (strncmp(event->data, "UPDATE", event->data_len) == 0) {
                 is_http_running = true;
+                xTaskNotify(fan_control_handle, FAN_EVENT_MODE, eSetBits);
                 vTaskDelete(get_temperature_handle);
                 vTaskDelay(pdMS_TO_TICKS(100));
                 Ota_NS::OtaParams* params = new Ota_NS::OtaParams;
@@ -341,7 +356,7 @@ void Mqtt::publish()
 {
     // Publish sensor data
     SensorData_t sensor_data {};
-    uint8_t percent {};
+    FanDuty_t duty {};
 
     // xEventGroupWaitBits(*_common_event_group, _mqtt_connect_bit, pdTRUE,
     // pdFALSE,
@@ -350,47 +365,217 @@ void Mqtt::publish()
         return;
     }
 
-    QueueSetMemberHandle_t activate_handle = xQueueSelectFromSet(_queue_set, 0);
-    if (activate_handle == nullptr) {
-        return;
+    if (_resubscribe) {
+        _resubscribe = false;
+        _sensor_cursor = _sensor_channel->subscribe();
+        _fan_health = -1;
     }
 
-    if (activate_handle == *_sensor_queue) {
-        if (xQueueReceive(*_sensor_queue, &sensor_data, portMAX_DELAY) == pdTRUE) {
-            if (sensor_data.temperature == 0.0f && sensor_data.sensor_id == 0) {
-                ESP_LOGW(TAG, "Received zero value from sensor %d",
-                    sensor_data.sensor_id);
-                return; // skip sending
-            }
-            char msg[12]; // buffer for message
-            snprintf(msg, sizeof(msg), "%.2f", sensor_data.temperature);
-
-            char topic[64]; // buffer for topic
-            snprintf(topic, sizeof(topic),
-                "homeassistant/sensor/HDDdock/temp_%d/state",
+    // All new samples, the channel doesn't wait for a slow reader
+    const uint32_t skipped = _sensor_cursor.skipped;
+    while (_sensor_channel->read(_sensor_cursor, sensor_data)) {
+        if (sensor_data.temperature == 0 && sensor_data.sensor_id == 0) {
+            ESP_LOGW(TAG, "Received zero value from sensor %d",
                 sensor_data.sensor_id);
+            continue; // skip sending
+        }
+        char msg[Temp_NS::FORMAT_SIZE]; // buffer for message
+        Temp_NS::format(msg, sizeof(msg), sensor_data.temperature);
+
+        char topic[64]; // buffer for topic
+        snprintf(topic, sizeof(topic),
+            "homeassistant/sensor/HDDdock/temp_%d%s/state",
+            sensor_data.sensor_id,
+            sensor_data.kind == SENSOR_ESTIMATED ? "_est" : "");
+
+        ESP_LOGI(TAG, "Temperature from MQTT: %s %s", msg, topic);
+        esp_mqtt_client_publish(client, topic, msg, 0, 0, 0);
+        Latency_NS::stages[Latency_NS::STAGE_PUBLISH].add(
+            Latency_NS::now_us() - sensor_data.published);
+    }
+    if (_sensor_cursor.skipped != skipped) {
+        ESP_LOGW(TAG, "Skipped %u samples", _sensor_cursor.skipped - skipped);
+    }
+
+    while (xQueueReceive(*_percent_queue, &duty, 0) == pdTRUE) {
+        char msg[10]; // buffer for message
+        snprintf(msg, sizeof(msg), "%d", duty.percent);
 
-            ESP_LOGI(TAG, "Temperature from MQTT: %s %s", msg, topic);
-            esp_mqtt_client_publish(client, topic, msg, 0, 0, 0);
+        char topic[50]; // buffer for topic
+        if (duty.zone == 0) {
+            snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/fan/state");
         } else {
-            ESP_LOGE(TAG, "Failed to receive data from sensor queue");
+            snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/fan_%u/state", duty.zone);
         }
 
-    } else if (activate_handle == *_percent_queue) {
-        if (xQueueReceive(*_percent_queue, &percent, portMAX_DELAY) == pdTRUE) {
+        ESP_LOGI(TAG, "Percent from MQTT: %s %s", msg, topic);
+        esp_mqtt_client_publish(client, topic, msg, 0, 0, 0);
+    }
 
-            char msg[10]; // buffer for message
-            snprintf(msg, sizeof(msg), "%d", percent);
+    _publish_tach();
 
-            char topic[50]; // buffer for topic
-            snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/fan/state");
+    const int64_t now = esp_timer_get_time();
+    if (now - _latency_published >= LATENCY_PUBLISH_PERIOD_MS * 1000LL) {
+        _latency_published = now;
+        _publish_latency();
+        _publish_log_stats();
+        _publish_actuation_stats();
+        _publish_loop_stats();
+    }
+}
 
-            ESP_LOGI(TAG, "Percent from MQTT: %s %s", msg, topic);
-            esp_mqtt_client_publish(client, topic, msg, 0, 0, 0);
+// {"passes": 3600, "deadline_misses": 0, "max_pass_us": 4200, "stale": 0,
+// "failsafe_passes": 0}
+void Mqtt::_publish_loop_stats(void)
+{
+    const Control_NS::LoopStats& stats = Control_NS::loop_stats;
+    char msg[120]; // buffer for message
+    snprintf(msg, sizeof(msg),
+        "{\"passes\":%u,\"deadline_misses\":%u,\"max_pass_us\":%u,\"stale\":%u,"
+        "\"failsafe_passes\":%u}",
+        stats.passes, stats.deadline_misses, stats.max_pass_us, stats.stale,
+        stats.failsafe_passes);
+    esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/control/state", msg, 0, 0, 0);
+}
+
+void Mqtt::_publish_tach(void)
+{
+    const uint32_t windows = Tach_NS::status.windows;
+    if (windows == _tach_windows) {
+        return; // No tach or no new window
+    }
+    _tach_windows = windows;
+
+    const Tach_NS::Health health = Tach_NS::status.health;
+    if (static_cast<int16_t>(health) != _fan_health) {
+        _fan_health = static_cast<int16_t>(health);
+        ESP_LOGI(TAG, "Fan health: %s", Tach_NS::health_name(health));
+        esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/fan_alert/state",
+            Tach_NS::health_name(health), 0, 1, 1);
+        _rpm_published = 0; // The speed goes with the alert
+    }
+
+    const int64_t now = esp_timer_get_time();
+    if (now - _rpm_published >= RPM_PUBLISH_PERIOD_MS * 1000LL) {
+        _rpm_published = now;
+        char msg[12]; // buffer for message
+        snprintf(msg, sizeof(msg), "%u", Tach_NS::status.rpm);
+        esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/rpm/state", msg, 0, 0, 0);
+    }
+}
+
+// Zone 0 is the "fan" entity, others get their own. Attributes are
+// retained: {"gpio": 13, "channel": 0, "drives": [0, 1], "mode": "max"}
+void Mqtt::_publish_zones(esp_mqtt_client_handle_t client)
+{
+    const Fan_NS::ZoneMap& map = Fan_NS::zone_map;
+    for (uint8_t channel = 0; channel < map.count; channel++) {
+        const Fan_NS::Zone& zone = map.zones[channel];
+        char topic[64]; // buffer for topic
+        if (zone.id != 0) {
+            char msg[300]; // buffer for message
+            snprintf(topic, sizeof(topic), topic_fan_zone, zone.id);
+            snprintf(msg, sizeof(msg), msg_fan_zone, zone.id, zone.id, zone.id, zone.id);
+            esp_mqtt_client_publish(client, topic, (get_device_json() + msg).c_str(), 0, 1, 1);
+            snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/fan_%u/attributes", zone.id);
         } else {
-            ESP_LOGE(TAG, "Failed to receive data from percent queue");
+            snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/fan/attributes");
         }
+
+        char drives[Fan_NS::SENSOR_COUNT * 2 + 1] = { 0 }; // "0,1,2"
+        size_t length = 0;
+        for (uint8_t i = 0; i < Fan_NS::SENSOR_COUNT; i++) {
+            if (zone.sensors & (1U << i)) {
+                length += snprintf(drives + length, sizeof(drives) - length, "%s%d",
+                    length ? "," : "", i);
+            }
+        }
+        char msg[100]; // buffer for message
+        snprintf(msg, sizeof(msg), "{\"gpio\":%u,\"channel\":%u,\"drives\":[%s],\"mode\":\"%s\"}",
+            zone.gpio, channel, drives, Fan_NS::mode_name(zone.mode));
+        esp_mqtt_client_publish(client, topic, msg, 0, 1, 1);
+    }
+}
+
+// {"actuations": 40, "unchanged": 300, "coalesced": 25}
+void Mqtt::_publish_actuation_stats(void)
+{
+    const Control_NS::ActuationStats& stats = Control_NS::actuation_stats;
+    char msg[80]; // buffer for message
+    snprintf(msg, sizeof(msg), "{\"actuations\":%u,\"unchanged\":%u,\"coalesced\":%u}",
+        stats.actuations, stats.unchanged, stats.coalesced);
+    esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/actuation/state", msg, 0, 0, 0);
+}
+
+// {"records": 1200, "dropped": 0, "queue_drops": 0, "flushes": 38,
+// "amplification": 2.00, "erases": 5, "segments": 3, "torn_bytes": 0}
+void Mqtt::_publish_log_stats(void)
+{
+    const Telemetry_NS::Stats& stats = Telemetry_NS::telemetry_log.stats();
+    const uint32_t amplification = stats.amplification();
+    char msg[200]; // buffer for message
+    snprintf(msg, sizeof(msg),
+        "{\"records\":%u,\"dropped\":%u,\"queue_drops\":%u,\"flushes\":%u,"
+        "\"amplification\":%u.%02u,\"erases\":%u,\"segments\":%u,\"torn_bytes\":%u}",
+        stats.records, stats.dropped, Telemetry_NS::queue_drops(), stats.flushes,
+        amplification / 100, amplification % 100, stats.erases, stats.segments,
+        stats.torn_bytes);
+    esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/log/state", msg, 0, 0, 0);
+}
+
+static bool history_to_string(const char* text, size_t length, void* context)
+{
+    static_cast<std::string*>(context)->append(text, length);
+    return true;
+}
+
+// 1-minute rollups of every series, one message per series
+void Mqtt::_publish_history(void)
+{
+    std::string json;
+    for (uint8_t series = 0; series < History_NS::SERIES_COUNT; series++) {
+        json.clear();
+        History_NS::write_rollups_json(History_NS::history, series,
+            History_NS::Tier::MINUTE, history_to_string, &json);
+
+        char topic[50]; // buffer for topic
+        snprintf(topic, sizeof(topic), "homeassistant/sensor/HDDdock/history/%d", series);
+        esp_mqtt_client_publish(client, topic, json.c_str(), json.size(), 0, 0);
+    }
+}
+
+// {"acquisition": {"count": 10, "p50": 1024, "p99": 2048, "max": 1500,
+// "buckets": [0, 0, ...]}, "filter": {...}, ...}, latencies in us
+void Mqtt::_publish_latency(void)
+{
+    cJSON* root = cJSON_CreateObject();
+    if (root == nullptr) {
+        ESP_LOGE(TAG, "Failed to create latency JSON");
+        return;
+    }
+    for (uint8_t stage = 0; stage < Latency_NS::STAGE_COUNT; stage++) {
+        const Latency_NS::Histogram& histogram = Latency_NS::stages[stage];
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddItemToObject(root,
+            Latency_NS::stage_name(static_cast<Latency_NS::Stage>(stage)), item);
+        cJSON_AddNumberToObject(item, "count", histogram.count());
+        cJSON_AddNumberToObject(item, "p50", histogram.percentile(50));
+        cJSON_AddNumberToObject(item, "p99", histogram.percentile(99));
+        cJSON_AddNumberToObject(item, "max", histogram.max());
+        cJSON* buckets = cJSON_CreateArray();
+        cJSON_AddItemToObject(item, "buckets", buckets);
+        for (uint8_t i = 0; i < Latency_NS::Histogram::BUCKETS; i++) {
+            cJSON_AddItemToArray(buckets, cJSON_CreateNumber(histogram.count(i)));
+        }
+    }
+
+    char* json = cJSON_PrintUnformatted(root);
+    if (json != nullptr) {
+        esp_mqtt_client_publish(client, "homeassistant/sensor/HDDdock/latency/state",
+            json, 0, 0, 0);
+        free(json);
     }
+    cJSON_Delete(root);
 }
 
 } // namespace Mqtt_NS
@@ -1,11 +1,13 @@
 #pragma once
 
+#include "broadcast.h"
 #include "esp_err.h"
 #include "esp_event.h"
 #include "esp_log.h"           // IWYU pragma: keep
 #include "freertos/FreeRTOS.h" // IWYU pragma: keep
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include "latency.h"
 #include "mdns.h" // IWYU pragma: keep
 #include "mqtt_client.h"
 #include "mqtt_device.h" // IWYU pragma: keep
@@ -13,6 +15,7 @@
 #include "nvs_flash.h"   // IWYU pragma: keep
 #include "ota.h"         // IWYU pragma: keep
 #include "secrets.h"     // IWYU pragma: keep
+#include "temperature.h"
 #include <cstdint>
 
 extern "C" {
@@ -22,15 +25,55 @@ void get_temperature(void *pvParameter);
 extern TaskHandle_t get_temperature_handle;
 void ota_update(void *pvParameter);
 extern TaskHandle_t ota_update_handle;
+extern TaskHandle_t fan_control_handle;
 
 extern volatile bool is_http_running;
 extern uint16_t STACK_TASK_SIZE;
 }
 
+// Notification bits of the fan control task
+constexpr uint32_t FAN_EVENT_SAMPLE = BIT0; // New sample in sensor_channel
+constexpr uint32_t FAN_EVENT_MODE = BIT1;   // is_http_running changed
+
+// Samples kept for consumers of the sensor channel, a power of two
+constexpr uint8_t SENSOR_CHANNEL_LENGTH = 16;
+// Duties of every fan zone for a few passes
+constexpr uint8_t PERCENT_QUEUE_LENGTH = 16;
+
+// Kind of the temperature in SensorData_t
+enum SensorKind : uint8_t {
+  SENSOR_MEASURED = 0, // Filtered reading of the sensor
+  SENSOR_ESTIMATED = 1 // Prediction for the configured horizon
+};
+
+// Quality of the temperature in SensorData_t, bit mask
+enum SensorFlags : uint8_t {
+  SENSOR_KEPT = BIT0,      // No reading of the sample was converted, last value
+  SENSOR_WARMUP = BIT1,    // Filter window isn't full yet
+  SENSOR_RECOVERED = BIT2, // First good reading after failed ones
+};
+
+// Times are lower 32 bits of esp_timer_get_time(), us
 typedef struct {
-  uint8_t sensor_id; // ID sensor
-  float temperature; // Temperature
+  uint32_t conversion_start; // Convert command of the sweep
+  uint32_t conversion_end;   // Scratchpads of the sweep are read
+  uint32_t published;        // Put into the sensor channel
+  uint16_t seq;              // Samples of the sensor, gaps are lost ones
+  Temp_NS::q4_t temperature; // Temperature, 1/16 C
+  uint8_t sensor_id;         // ID sensor
+  uint8_t kind;              // SensorKind
+  uint8_t flags;             // SensorFlags
 } SensorData_t;
+static_assert(sizeof(SensorData_t) == 20, "SensorData_t is copied by value");
+
+// Applied duty of a fan zone, the percent queue item
+typedef struct {
+  uint8_t zone;    // Fan_NS::Zone::id
+  uint8_t percent; // Duty, %
+} FanDuty_t;
+
+// Samples of get_temperature() for the fan and mqtt tasks
+typedef Broadcast_NS::Channel<SensorData_t, SENSOR_CHANNEL_LENGTH> SensorChannel_t;
 
 typedef struct {
   char hostname[60];   // hostname
@@ -85,17 +128,37 @@ private:
                                  void *event_data);
   esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event);
 
-  QueueSetHandle_t _queue_set = nullptr;
+  // Histograms of Latency_NS stages as one JSON message
+  void _publish_latency(void);
+  // Counters of the telemetry log, with the latency
+  void _publish_log_stats(void);
+  // Control_NS::actuation_stats, with the latency
+  void _publish_actuation_stats(void);
+  // Control_NS::loop_stats, with the latency
+  void _publish_loop_stats(void);
+  // History_NS rollups on the HISTORY command
+  void _publish_history(void);
+  // Tach_NS::status: the health at once, the speed every RPM_PUBLISH_PERIOD_MS
+  void _publish_tach(void);
+  // Discovery and attributes of every fan zone in Fan_NS::zone_map
+  void _publish_zones(esp_mqtt_client_handle_t client);
+
   EventGroupHandle_t *_common_event_group;
-  QueueHandle_t *_sensor_queue;
+  const SensorChannel_t *_sensor_channel;
+  Broadcast_NS::Cursor _sensor_cursor;
+  volatile bool _resubscribe{false}; // Set on connect
+  int64_t _latency_published{0};     // esp_timer_get_time(), us
+  int64_t _rpm_published{0};         // esp_timer_get_time(), us
+  uint32_t _tach_windows{0};         // Tach_NS::status.windows published
+  int16_t _fan_health{-1};           // Published Tach_NS::Health, -1 - none
   QueueHandle_t *_percent_queue;
 
   MdnsMqttServer_t _mdns_mqtt_server;
   state_m _mdns_interface_state{state_m::NOT_INITIALISED};
 
 public:
-  Mqtt(EventGroupHandle_t &common_event_group, QueueHandle_t &temperature_queue,
-       QueueHandle_t &percent_queue);
+  Mqtt(EventGroupHandle_t &common_event_group,
+       const SensorChannel_t &sensor_channel, QueueHandle_t &percent_queue);
   ~Mqtt(void);
   bool find_mqtt_server(MdnsMqttServer_t &mqtt_server);
   void connection_watcher();
@@ -110,6 +173,8 @@ public:
   constexpr static const char *TAG_mDNS = "mDNS";
 
   static constexpr uint8_t MAX_CONNECTION_RETRIES = 3;
+  static constexpr uint32_t LATENCY_PUBLISH_PERIOD_MS = 60000;
+  static constexpr uint32_t RPM_PUBLISH_PERIOD_MS = 10000;
   static constexpr uint32_t MDNS_QUERY_TIMEOUT_MS = 10000;
 };
 
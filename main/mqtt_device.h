@@ -48,15 +48,70 @@ const std::string msg_right = R"(
   "unit_of_meas": "°C"
  })";
 
+// Predicted temperature of left HDD
+const std::string topic_left_estimate = R"(homeassistant/sensor/HDDdock_temp_left_est/config)";
+const std::string msg_left_estimate = R"(
+  "name": "Left HDD forecast",
+  "deve_cla": "temperature",
+  "stat_t": "homeassistant/sensor/HDDdock/temp_0_est/state",
+  "uniq_id": "DockHDD_temp_left_est",
+  "icon": "mdi:chart-bell-curve-cumulative",
+  "unit_of_meas": "°C"
+})";
+
+// Predicted temperature of right HDD
+const std::string topic_right_estimate = R"(homeassistant/sensor/HDDdock_temp_right_est/config)";
+const std::string msg_right_estimate = R"(
+  "name": "Right HDD forecast",
+  "deve_cla": "temperature",
+  "stat_t": "homeassistant/sensor/HDDdock/temp_1_est/state",
+  "uniq_id": "DockHDD_temp_right_est",
+  "icon": "mdi:chart-bell-curve-cumulative",
+  "unit_of_meas": "°C"
+})";
+
 // Device fan
 const std::string topic_fan = R"(homeassistant/sensor/HDDdock_fan/config)";
 const std::string msg_fan = R"(
     "name": "Fan HDD",
   "deve_cla": "power_factor",
   "stat_t": "homeassistant/sensor/HDDdock/fan/state",
+  "json_attr_t": "homeassistant/sensor/HDDdock/fan/attributes",
   "uniq_id": "DockHDD_fan",
   "icon": "mdi:fan",
   "unit_of_meas": "%"
  })";
 
+// Fan of zone N > 0, printf formats with N; zone 0 is the fan above.
+// Attributes are the zone map: pin, LEDC channel, drives and mode.
+const char* const topic_fan_zone = "homeassistant/sensor/HDDdock_fan_%u/config";
+const char* const msg_fan_zone = R"(
+  "name": "Fan HDD zone %u",
+  "deve_cla": "power_factor",
+  "stat_t": "homeassistant/sensor/HDDdock/fan_%u/state",
+  "json_attr_t": "homeassistant/sensor/HDDdock/fan_%u/attributes",
+  "uniq_id": "DockHDD_fan_%u",
+  "icon": "mdi:fan",
+  "unit_of_meas": "%%"
+})";
+
+// Fan speed from the tach
+const std::string topic_fan_rpm = R"(homeassistant/sensor/HDDdock_fan_rpm/config)";
+const std::string msg_fan_rpm = R"(
+  "name": "Fan HDD speed",
+  "stat_t": "homeassistant/sensor/HDDdock/rpm/state",
+  "uniq_id": "DockHDD_fan_rpm",
+  "icon": "mdi:fan",
+  "unit_of_meas": "rpm"
+})";
+
+// Fan health: ok, stall, under_speed
+const std::string topic_fan_alert = R"(homeassistant/sensor/HDDdock_fan_alert/config)";
+const std::string msg_fan_alert = R"(
+  "name": "Fan HDD alert",
+  "stat_t": "homeassistant/sensor/HDDdock/fan_alert/state",
+  "uniq_id": "DockHDD_fan_alert",
+  "icon": "mdi:fan-alert"
+})";
+
 const std::string command_topic = R"(homeassistant/sensor/HDDdock_commands)";
@@ -254,4 +254,54 @@ esp_err_t Nvs::write_float(const char* key, float* value)
     xSemaphoreGive(_mutex);
     return err;
 };
+
+// Read blob from NVS. "length" is buffer size on input and data size on
+// output. There is no default value, ESP_ERR_NVS_NOT_FOUND is returned.
+esp_err_t Nvs::read_blob(const char* key, void* value, size_t* length)
+{
+    // Check if NVS handle is valid
+    if (_nvs_handle == 0) {
+        ESP_LOGE(TAG, "Invalid NVS handle!");
+        return ESP_FAIL;
+    }
+
+    // Take mutex
+    if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = nvs_get_blob(_nvs_handle, key, value, length);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "Key '%s' not found.", key);
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Read failed for key '%s': %s", key, esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "Successfully read key '%s' with %zu bytes", key, *length);
+    }
+
+    xSemaphoreGive(_mutex);
+    return err;
+};
+
+// Write blob to NVS
+esp_err_t Nvs::write_blob(const char* key, const void* value, size_t length)
+{
+    // Take mutex
+    if (xSemaphoreTake(_mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = nvs_set_blob(_nvs_handle, key, value, length);
+    if (err == ESP_OK) {
+        nvs_commit(_nvs_handle);
+        ESP_LOGI(TAG, "Successfully wrote key '%s' with %zu bytes", key, length);
+    } else {
+        ESP_LOGE(TAG, "Failed to write key '%s': %s", key, esp_err_to_name(err));
+        xSemaphoreGive(_mutex);
+        return err;
+    }
+
+    xSemaphoreGive(_mutex);
+    return err;
+};
 } // namespace Nvs_NS
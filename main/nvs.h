@@ -30,6 +30,8 @@ public:
     esp_err_t write_u32(const char* key, uint32_t* value);
     esp_err_t read_float(const char* key, float* value, float* default_value);
     esp_err_t write_float(const char* key, float* value);
+    esp_err_t read_blob(const char* key, void* value, size_t* length);
+    esp_err_t write_blob(const char* key, const void* value, size_t length);
 
     constexpr static const char* TAG = "NVS";
 };
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include <cstdint>
+
+// Direct access to ESP8266 GPIO registers (PERIPHS_GPIO_BASEADDR 0x60000300).
+// Writes to W1TS/W1TC registers change only bits set in the mask, so there is
+// no read-modify-write and no branching on pin number or logic inversion.
+// Host tests define ONEWIRE_GPIO_REG to put simulated lines behind them.
+#ifndef ONEWIRE_GPIO_REG
+#define ONEWIRE_GPIO_REG(offset) (*reinterpret_cast<volatile uint32_t*>(0x60000300 + (offset)))
+#endif
+#define ONEWIRE_GPIO_OUT_W1TS ONEWIRE_GPIO_REG(0x04)
+#define ONEWIRE_GPIO_OUT_W1TC ONEWIRE_GPIO_REG(0x08)
+#define ONEWIRE_GPIO_ENABLE_W1TS ONEWIRE_GPIO_REG(0x10)
+#define ONEWIRE_GPIO_ENABLE_W1TC ONEWIRE_GPIO_REG(0x14)
+#define ONEWIRE_GPIO_IN ONEWIRE_GPIO_REG(0x18)
+
+namespace OneWire {
+
+// Pin and inversion are template parameters, so every call compiles to a
+// single register access with constant mask
+template <gpio_num_t Pin, bool Invert>
+struct FastPin {
+    static_assert(Pin < GPIO_NUM_16, "GPIO16 is RTC pin without fast access");
+    static constexpr uint32_t mask = 1UL << Pin;
+
+    static inline void output(void) { ONEWIRE_GPIO_ENABLE_W1TS = mask; }
+    static inline void input(void) { ONEWIRE_GPIO_ENABLE_W1TC = mask; }
+    static inline void set(bool level)
+    {
+        if (level != Invert) {
+            ONEWIRE_GPIO_OUT_W1TS = mask;
+        } else {
+            ONEWIRE_GPIO_OUT_W1TC = mask;
+        }
+    }
+    static inline uint8_t get(void)
+    {
+        return ((ONEWIRE_GPIO_IN >> Pin) & 0x01) ^ (Invert ? 1 : 0);
+    }
+};
+
+// CPU cycle counter for slot timing
+static inline uint32_t cycle_count(void)
+{
+#if defined(__XTENSA__)
+    uint32_t cycles;
+    __asm__ __volatile__("rsr %0, ccount" : "=a"(cycles));
+    return cycles;
+#else
+    return static_cast<uint32_t>(esp_timer_get_time());
+#endif
+}
+
+// Duration statistics of time slot low pulses, in CPU cycles
+struct SlotStats {
+    uint32_t count { 0 };
+    uint32_t min { UINT32_MAX };
+    uint32_t max { 0 };
+    uint64_t sum { 0 };
+
+    inline void add(uint32_t cycles)
+    {
+        ++count;
+        sum += cycles;
+        if (cycles < min) {
+            min = cycles;
+        }
+        if (cycles > max) {
+            max = cycles;
+        }
+    }
+    // Spread between the longest and the shortest pulse
+    uint32_t jitter(void) { return count ? max - min : 0; }
+    uint32_t average(void) { return count ? static_cast<uint32_t>(sum / count) : 0; }
+    void clear(void) { *this = SlotStats(); }
+};
+
+} // namespace OneWire
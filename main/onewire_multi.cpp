@@ -0,0 +1,426 @@
+#include "onewire_multi.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "rom/ets_sys.h"
+#include <cstring>
+
+namespace OneWire {
+
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+// ========================= Initialization ===================================
+MultiBus::MultiBus(uint8_t count)
+    : _count { count > ONEWIRE_MAX_BUSES ? static_cast<uint8_t>(ONEWIRE_MAX_BUSES) : count }
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        // Different ROM codes to tell buses apart in logs
+        _sim[i].device(0).init(i + 1);
+        _buses |= 1UL << i;
+    }
+}
+
+// Buses are stepped one after another, the clock is the one of the bus
+// which is furthest
+int64_t MultiBus::_now(void)
+{
+    uint64_t now = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_sim[i].now() > now) {
+            now = _sim[i].now();
+        }
+    }
+    return static_cast<int64_t>(now);
+}
+
+void MultiBus::_pause(uint32_t ms)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        _sim[i].idle(ms * 1000);
+    }
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+uint64_t MultiBus::bus_time(void)
+{
+    uint64_t time = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_sim[i].bus_time() > time) {
+            time = _sim[i].bus_time();
+        }
+    }
+    return time;
+}
+
+// ========================= 1-Wire ===========================================
+// Simulated buses are stepped one after another, bus time is counted for
+// every bus separately
+uint32_t MultiBus::reset(uint32_t buses)
+{
+    uint32_t presence = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if ((buses & (1UL << i)) && _sim[i].reset() == ESP_OK) {
+            presence |= 1UL << i;
+        }
+    }
+    return presence;
+}
+
+void MultiBus::write_bytes(uint32_t buses, const uint8_t* bytes)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        if (buses & (1UL << i)) {
+            _sim[i].touch_byte(bytes[i]);
+        }
+    }
+}
+
+uint32_t MultiBus::read_bits(uint32_t buses)
+{
+    uint32_t ones = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if ((buses & (1UL << i)) && _sim[i].touch_bit(1)) {
+            ones |= 1UL << i;
+        }
+    }
+    return ones;
+}
+
+void MultiBus::read_bytes(uint32_t buses, uint8_t* bytes)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        if (buses & (1UL << i)) {
+            bytes[i] = _sim[i].touch_byte(0xFF);
+        }
+    }
+}
+
+#else
+// ========================= Initialization ===================================
+MultiBus::MultiBus(const gpio_num_t* pins, uint8_t count)
+    : _count { count > ONEWIRE_MAX_BUSES ? static_cast<uint8_t>(ONEWIRE_MAX_BUSES) : count }
+{
+    gpio_config_t config = {};
+    config.mode = GPIO_MODE_INPUT;
+    config.pull_up_en = GPIO_PULLUP_DISABLE; // Pull-up resistors are external
+    config.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    config.intr_type = GPIO_INTR_DISABLE;
+
+    for (uint8_t i = 0; i < _count; i++) {
+        if (pins[i] >= GPIO_NUM_16) {
+            ESP_LOGE(TAG, "Bus %d: GPIO%d has no fast access.", i, pins[i]);
+            continue;
+        }
+        config.pin_bit_mask = 1ULL << pins[i];
+        if (gpio_config(&config) != ESP_OK) {
+            ESP_LOGE(TAG, "Bus %d: GPIO%d initialization fail.", i, pins[i]);
+            continue;
+        }
+        _pin_mask[i] = 1UL << pins[i];
+        _buses |= 1UL << i;
+    }
+
+    // Output latch is low, direction alone drives the lines
+    ONEWIRE_GPIO_OUT_W1TC = _gpio_mask(_buses);
+    ESP_LOGI(TAG, "%d buses initialized, mask 0x%02x.", _count, _buses);
+}
+
+int64_t MultiBus::_now(void)
+{
+    return esp_timer_get_time();
+}
+
+void MultiBus::_pause(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+uint32_t MultiBus::_gpio_mask(uint32_t buses)
+{
+    uint32_t mask = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (buses & (1UL << i)) {
+            mask |= _pin_mask[i];
+        }
+    }
+    return mask;
+}
+
+// ========================= 1-Wire ===========================================
+// Reset all selected buses at once
+uint32_t IRAM_ATTR MultiBus::reset(uint32_t buses)
+{
+    const uint32_t mask = _gpio_mask(buses & _buses);
+
+    // Bus held low is busy or has no pull-up resistor
+    const uint32_t idle = ONEWIRE_GPIO_IN & mask;
+
+    taskENTER_CRITICAL();
+    ONEWIRE_GPIO_ENABLE_W1TS = idle;
+    os_delay_us(MASTER_RESET_PULSE_DURATION);
+    ONEWIRE_GPIO_ENABLE_W1TC = idle;
+    os_delay_us(MASTER_READ_PRESENSE);
+    // Device answers with low level
+    const uint32_t low = ~ONEWIRE_GPIO_IN & idle;
+    taskEXIT_CRITICAL();
+    os_delay_us(RECOVERY_AFTER_RESET_PULSE);
+
+    uint32_t presence = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (low & _pin_mask[i]) {
+            presence |= 1UL << i;
+        }
+    }
+    return presence;
+}
+
+// Write slot: all "low" lines go down, "ones" are released after the short
+// pulse, the rest after the long one
+void IRAM_ATTR MultiBus::_write_slot(uint32_t low, uint32_t ones)
+{
+    taskENTER_CRITICAL();
+    ets_delay_us(PAUSE_BETWEEN_TIME_SLOTS);
+    ONEWIRE_GPIO_ENABLE_W1TS = low;
+    ets_delay_us(MASTER_WRITE_1_PULSE_DURATION);
+    ONEWIRE_GPIO_ENABLE_W1TC = ones;
+    ets_delay_us(MASTER_WRITE_0_PULSE_DURATION - MASTER_WRITE_1_PULSE_DURATION);
+    ONEWIRE_GPIO_ENABLE_W1TC = low;
+    ets_delay_us(MASTER_WRITE_0_RECOVERY_DURATION);
+    taskEXIT_CRITICAL();
+}
+
+void MultiBus::write_bytes(uint32_t buses, const uint8_t* bytes)
+{
+    const uint32_t mask = _gpio_mask(buses & _buses);
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        uint32_t ones = 0;
+        for (uint8_t i = 0; i < _count; i++) {
+            if ((bytes[i] >> bit) & 0x01) {
+                ones |= _pin_mask[i];
+            }
+        }
+        _write_slot(mask, ones & mask);
+    }
+}
+
+uint32_t IRAM_ATTR MultiBus::read_bits(uint32_t buses)
+{
+    const uint32_t mask = _gpio_mask(buses & _buses);
+
+    taskENTER_CRITICAL();
+    ets_delay_us(BUS_RECOVERY_DURATION);
+    ONEWIRE_GPIO_ENABLE_W1TS = mask;
+    os_delay_us(MASTER_READ_PULSE_DURATION);
+    ONEWIRE_GPIO_ENABLE_W1TC = mask;
+    os_delay_us(MASTER_READ_SAMPLE);
+    const uint32_t level = ONEWIRE_GPIO_IN;
+    taskEXIT_CRITICAL();
+    os_delay_us(MASTER_READ_RECOVERY_DURATION);
+
+    uint32_t ones = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        if ((buses & (1UL << i)) && (level & _pin_mask[i])) {
+            ones |= 1UL << i;
+        }
+    }
+    return ones;
+}
+
+void MultiBus::read_bytes(uint32_t buses, uint8_t* bytes)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        if (buses & (1UL << i)) {
+            bytes[i] = 0;
+        }
+    }
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        const uint32_t ones = read_bits(buses);
+        for (uint8_t i = 0; i < _count; i++) {
+            if (ones & (1UL << i)) {
+                bytes[i] |= 1 << bit;
+            }
+        }
+    }
+}
+#endif // ONEWIRE_BACKEND
+
+void MultiBus::write_byte(uint32_t buses, uint8_t byte)
+{
+    uint8_t bytes[ONEWIRE_MAX_BUSES];
+    memset(bytes, byte, sizeof(bytes));
+    write_bytes(buses, bytes);
+}
+
+// ========================= Temperature ======================================
+uint32_t MultiBus::convert_all(void)
+{
+    const int64_t start = _now();
+    const uint32_t timeout = DS18B20::conversion_timeout(_resolution);
+
+    _present = reset(_buses);
+    write_byte(_present, SKIP_ROM);
+    write_byte(_present, CONVERT_T);
+
+    // Device answers 1 to read slot when its conversion is done
+    uint32_t done = 0;
+    while (done != _present) {
+        if (_now() - start > timeout) {
+            ESP_LOGE(TAG, "Conversion timeout, done 0x%02x of 0x%02x.", done, _present);
+            break;
+        }
+        _pause(CONVERSION_POLL_INTERVAL);
+        done |= read_bits(_present & ~done);
+    }
+
+    _conversion_latency = static_cast<uint32_t>(_now() - start);
+    return done;
+}
+
+uint32_t MultiBus::read_scratchpads(uint32_t buses, uint8_t (*data)[9])
+{
+    uint32_t valid = 0;
+    uint8_t bytes[ONEWIRE_MAX_BUSES] = {};
+
+    for (uint8_t attempt = 0; attempt < ONEWIRE_RETRIES && (buses & ~valid); attempt++) {
+        const uint32_t pending = reset(buses & ~valid);
+        write_byte(pending, SKIP_ROM);
+        write_byte(pending, READ_SCRATCHPAD);
+
+        uint8_t all_bits[ONEWIRE_MAX_BUSES] = {};
+        for (uint8_t n = 0; n < 9; n++) {
+            read_bytes(pending, bytes);
+            for (uint8_t i = 0; i < _count; i++) {
+                if (pending & (1UL << i)) {
+                    data[i][n] = bytes[i];
+                    all_bits[i] |= bytes[i];
+                }
+            }
+        }
+
+        for (uint8_t i = 0; i < _count; i++) {
+            if (!(pending & (1UL << i))) {
+                continue;
+            }
+            // Zeros pass CRC check, but it's the bus held low
+            if (all_bits[i] != 0x00 && crc8(data[i], 8) == data[i][8]) {
+                valid |= 1UL << i;
+                continue;
+            }
+            ++_crc_errors;
+            ESP_LOGW(TAG, "Bus %d: scratchpad CRC mismatch, attempt %d.", i, attempt + 1);
+        }
+    }
+
+    return valid;
+}
+
+// Broadcast conversion lasts as long as the slowest device: the resolution
+// in its scratchpad, 12 bit if it couldn't be read
+void MultiBus::_update_resolution(uint32_t known, const uint8_t (*data)[9])
+{
+    _resolution = 0;
+    for (uint8_t i = 0; i < _count; i++) {
+        // Family is not known with SKIP ROM, DS18S20 reads as 12 bit anyway
+        const uint8_t resolution = (known & (1UL << i)) ? decode_resolution(0, data[i]) : MAX_RESOLUTION;
+        if (resolution > _resolution) {
+            _resolution = resolution;
+        }
+    }
+}
+
+esp_err_t MultiBus::set_resolutions(const uint8_t* resolutions)
+{
+    uint8_t data[ONEWIRE_MAX_BUSES][9] = {};
+    const uint32_t valid = read_scratchpads(_buses, data);
+
+    uint8_t th[ONEWIRE_MAX_BUSES] = {};
+    uint8_t tl[ONEWIRE_MAX_BUSES] = {};
+    uint8_t config[ONEWIRE_MAX_BUSES] = {};
+    uint32_t changed = 0;
+
+    for (uint8_t i = 0; i < _count; i++) {
+        uint8_t resolution = resolutions[i];
+        if (resolution < MIN_RESOLUTION || resolution > MAX_RESOLUTION) {
+            ESP_LOGE(TAG, "Bus %d: resolution %d is not supported.", i, resolution);
+            resolution = MAX_RESOLUTION;
+        }
+        if (!(valid & (1UL << i))) {
+            continue;
+        }
+
+        // Bits 5-6 of configuration register: 0 - 9 bit ... 3 - 12 bit.
+        // Alarm registers are kept.
+        config[i] = ((resolution - MIN_RESOLUTION) << 5) | 0x1F;
+        th[i] = data[i][2];
+        tl[i] = data[i][3];
+        if ((data[i][4] & 0x60) != (config[i] & 0x60)) {
+            ESP_LOGI(TAG, "Bus %d: changing resolution to %d bit.", i, resolution);
+            changed |= 1UL << i;
+        }
+    }
+
+    uint32_t known = valid; // Scratchpad in "data" is the device's
+    if (changed) {
+        uint32_t buses = reset(changed);
+        write_byte(buses, SKIP_ROM);
+        write_byte(buses, WRITE_SCRATCHPAD);
+        write_bytes(buses, th);
+        write_bytes(buses, tl);
+        write_bytes(buses, config);
+
+        // Check before writing to EEPROM
+        const uint32_t written = read_scratchpads(buses, data);
+        known &= ~changed | written;
+        for (uint8_t i = 0; i < _count; i++) {
+            if ((written & (1UL << i)) && (data[i][4] & 0x60) != (config[i] & 0x60)) {
+                ESP_LOGE(TAG, "Bus %d: resolution was not written.", i);
+                buses &= ~(1UL << i);
+            }
+        }
+        buses = reset(buses & written);
+        write_byte(buses, SKIP_ROM);
+        write_byte(buses, COPY_SCRATCHPAD);
+        vTaskDelay(pdMS_TO_TICKS(COPY_SCRATCHPAD_DURATION));
+
+        if (buses != changed) {
+            _update_resolution(known, data);
+            return ESP_FAIL;
+        }
+    }
+
+    _update_resolution(known, data);
+    return valid == _buses ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t MultiBus::get_temps(Temp_NS::q4_t* temperatures, esp_err_t* results)
+{
+    const uint32_t converted = convert_all();
+
+    uint8_t data[ONEWIRE_MAX_BUSES][9] = {};
+    const uint32_t valid = read_scratchpads(converted, data);
+
+    esp_err_t status = ESP_OK;
+    for (uint8_t i = 0; i < _count; i++) {
+        const uint32_t bus = 1UL << i;
+        esp_err_t result = ESP_OK;
+        if (!(_present & bus)) {
+            result = ESP_ERR_NOT_FOUND;
+        } else if (!(converted & bus)) {
+            result = ESP_ERR_TIMEOUT;
+        } else if (!(valid & bus)) {
+            result = ESP_ERR_INVALID_CRC;
+        } else {
+            // Only DS18B20 has configurable resolution, family is not known
+            // with SKIP ROM
+            result = decode_temp(0x28, data[i], temperatures[i]);
+        }
+        if (results != nullptr) {
+            results[i] = result;
+        }
+        if (result != ESP_OK) {
+            status = result;
+        }
+    }
+
+    return status;
+}
+
+} // namespace OneWire
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "gpio.h"
+#include "onewire_fast.h"
+
+// Several 1-Wire buses with one DS18B20 on each of them. Time slots of all
+// buses are generated in one pass by toggling a GPIO mask, so reading N buses
+// costs the bus time of one. Devices are addressed with SKIP ROM.
+// ============================ Buses =========================================
+#define ONEWIRE_MAX_BUSES 4
+// 1 - single bus with SEARCH ROM (DS18B20 class), 2..ONEWIRE_MAX_BUSES - one
+// sensor per bus on the first ONEWIRE_BUS_COUNT of ONEWIRE_BUS_PINS
+#ifndef ONEWIRE_BUS_COUNT
+#define ONEWIRE_BUS_COUNT 1
+#endif
+#define ONEWIRE_BUS_PINS { GPIO_NUM_12, GPIO_NUM_4, GPIO_NUM_5, GPIO_NUM_14 }
+#if ONEWIRE_BUS_COUNT > 1 && ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+#error "Multi-bus acquisition needs GPIO or SIM backend"
+#endif
+
+namespace OneWire {
+
+class MultiBus {
+protected:
+    // ================= Class variables ======================================
+    uint8_t _count { 0 };
+    uint32_t _buses { 0 }; // Initialized buses, bit "i" is bus "i"
+    uint32_t _present { 0 }; // Buses answered the last conversion reset
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    SimBus _sim[ONEWIRE_MAX_BUSES];
+#else
+    // Pins are open drain: output latch stays low, line is pulled low by
+    // enabling the output and released by disabling it
+    uint32_t _pin_mask[ONEWIRE_MAX_BUSES] {};
+    // GPIO mask of the selected buses
+    uint32_t _gpio_mask(uint32_t buses);
+    void _write_slot(uint32_t low, uint32_t ones);
+#endif
+    uint8_t _resolution { 0 }; // Highest resolution on the buses, 0 - unknown
+    uint32_t _conversion_latency { 0 }; // us, last finished conversion
+    uint32_t _crc_errors { 0 }; // Corrupted reads
+    const char* TAG = "MultiBus";
+
+    // Clock of the conversion timing, us. Simulated buses have their own.
+    int64_t _now(void);
+    // Master leaves the buses between conversion polls
+    void _pause(uint32_t ms);
+    // Conversion timeout from the scratchpads of the "known" buses
+    void _update_resolution(uint32_t known, const uint8_t (*data)[9]);
+
+public:
+    // =================== Constructor ========================================
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+    // One virtual device on each of "count" buses
+    explicit MultiBus(uint8_t count);
+    SimBus& sim(uint8_t bus) { return _sim[bus]; }
+    // Buses run in parallel, so the time is the one of the slowest bus
+    uint64_t bus_time(void);
+#else
+    // Pins must be GPIO0..GPIO15 with external pull-up, no logic inversion
+    MultiBus(const gpio_num_t* pins, uint8_t count);
+#endif
+    uint8_t count(void) { return _count; }
+
+    // ============ 1-Wire, bit "i" of "buses" selects bus "i" ================
+    // Returns buses with presence pulse
+    uint32_t reset(uint32_t buses);
+    // Same byte to all selected buses
+    void write_byte(uint32_t buses, uint8_t byte);
+    // Own byte for every bus, "bytes" is indexed by bus number
+    void write_bytes(uint32_t buses, const uint8_t* bytes);
+    // One read slot on all selected buses, returns buses which read 1
+    uint32_t read_bits(uint32_t buses);
+    void read_bytes(uint32_t buses, uint8_t* bytes);
+
+    // ================= Temperature ==========================================
+    // SKIP ROM + CONVERT T on all buses, poll until every bus is done.
+    // Returns buses that finished conversion.
+    uint32_t convert_all(void);
+    // Read scratchpads, buses with CRC mismatch are retried together.
+    // Returns buses with valid data.
+    uint32_t read_scratchpads(uint32_t buses, uint8_t (*data)[9]);
+    // Resolution per bus (9 - 12 bit), EEPROM is written on changed buses only
+    esp_err_t set_resolutions(const uint8_t* resolutions);
+    // Convert and read all buses. Per bus status is returned in "results"
+    // if it's not nullptr.
+    esp_err_t get_temps(Temp_NS::q4_t* temperatures, esp_err_t* results = nullptr);
+
+    uint32_t get_conversion_latency(void) { return _conversion_latency; }
+    uint32_t get_crc_errors(void) { return _crc_errors; }
+}; // class MultiBus
+
+} // namespace OneWire
@@ -0,0 +1,292 @@
+#include "onewire_sim.h"
+#include "gpio.h"
+#include <cstring>
+
+namespace OneWire {
+
+// ========================= Virtual device ===================================
+void VirtualDS18B20::init(uint8_t serial)
+{
+    rom[0] = 0x28; // DS18B20 family
+    rom[1] = serial;
+    rom[2] = 0x5A; // Just to have bits different from serial
+    rom[3] = serial ^ 0xA5;
+    rom[7] = crc8(rom, 7);
+
+    eeprom[0] = 0x4B; // TH 75 C
+    eeprom[1] = 0x46; // TL 70 C
+    eeprom[2] = 0x7F; // 12 bit
+    present = true;
+    _random = serial + 1;
+
+    // Power on scratchpad
+    scratchpad[0] = POWER_ON_TEMPERATURE & 0xFF;
+    scratchpad[1] = POWER_ON_TEMPERATURE >> 8;
+    memcpy(&scratchpad[2], eeprom, sizeof(eeprom));
+    scratchpad[5] = 0xFF;
+    scratchpad[6] = 0x0C;
+    scratchpad[7] = 0x10;
+    scratchpad[8] = crc8(scratchpad, 8);
+}
+
+void VirtualDS18B20::reset(uint64_t now)
+{
+    _update_scratchpad(now);
+    _state = state_v::ROM_COMMAND;
+    _receive(state_v::ROM_COMMAND, 8);
+}
+
+bool VirtualDS18B20::alarm(void)
+{
+    int8_t high = static_cast<int8_t>(scratchpad[2]);
+    int8_t low = static_cast<int8_t>(scratchpad[3]);
+    int16_t whole = static_cast<int16_t>(scratchpad[0] | (scratchpad[1] << 8)) >> 4;
+    return whole >= high || whole <= low;
+}
+
+uint8_t VirtualDS18B20::drive(uint64_t now)
+{
+    switch (_state) {
+    case state_v::TRANSMIT:
+        return _flip((_buffer[_bits / 8] >> (_bits % 8)) & 0x01);
+    case state_v::SEARCH: {
+        uint8_t bit = (rom[_bits / 8] >> (_bits % 8)) & 0x01;
+        if (_search_phase == 0) {
+            return _flip(bit);
+        }
+        if (_search_phase == 1) {
+            return _flip(!bit);
+        }
+        return 1;
+    }
+    case state_v::CONVERTING:
+        return now >= _conversion_end ? 1 : 0;
+    default:
+        return 1; // Released
+    }
+}
+
+void VirtualDS18B20::sample(uint8_t level, uint64_t now)
+{
+    switch (_state) {
+    case state_v::ROM_COMMAND:
+    case state_v::FUNCTION_COMMAND:
+    case state_v::MATCH:
+    case state_v::RECEIVE_CONFIG:
+        if (level) {
+            _buffer[_bits / 8] |= 1 << (_bits % 8);
+        }
+        if (++_bits < _length) {
+            return;
+        }
+        if (_state == state_v::MATCH) {
+            if (memcmp(_buffer, rom, sizeof(rom)) == 0) {
+                _receive(state_v::FUNCTION_COMMAND, 8);
+            } else {
+                _state = state_v::INACTIVE;
+            }
+        } else if (_state == state_v::RECEIVE_CONFIG) {
+            memcpy(&scratchpad[2], _buffer, faults.config_locked ? 2 : 3);
+            scratchpad[4] |= 0x1F;
+            scratchpad[8] = crc8(scratchpad, 8);
+            _state = state_v::INACTIVE;
+        } else if (_state == state_v::ROM_COMMAND) {
+            _rom_command(_buffer[0]);
+        } else {
+            _function_command(_buffer[0], now);
+        }
+        return;
+
+    case state_v::TRANSMIT:
+        if (++_bits >= _length) {
+            if (_next_state == state_v::FUNCTION_COMMAND) {
+                _receive(state_v::FUNCTION_COMMAND, 8);
+            } else {
+                _state = _next_state;
+            }
+        }
+        return;
+
+    case state_v::SEARCH: {
+        if (_search_phase < 2) {
+            ++_search_phase;
+            return;
+        }
+        // Master chose direction, devices with the other bit drop out
+        uint8_t bit = (rom[_bits / 8] >> (_bits % 8)) & 0x01;
+        _search_phase = 0;
+        if (bit != level) {
+            _state = state_v::INACTIVE;
+        } else if (++_bits >= 64) {
+            _receive(state_v::FUNCTION_COMMAND, 8);
+        }
+        return;
+    }
+
+    default:
+        return;
+    }
+}
+
+void VirtualDS18B20::_receive(state_v state, uint8_t length)
+{
+    memset(_buffer, 0, sizeof(_buffer));
+    _state = state;
+    _bits = 0;
+    _length = length;
+}
+
+void VirtualDS18B20::_transmit(const uint8_t* data, uint8_t length,
+    state_v next_state)
+{
+    memcpy(_buffer, data, length / 8);
+    _state = state_v::TRANSMIT;
+    _next_state = next_state;
+    _bits = 0;
+    _length = length;
+}
+
+void VirtualDS18B20::_rom_command(uint8_t command)
+{
+    switch (command) {
+    case READ_ROM:
+        _transmit(rom, 64, state_v::FUNCTION_COMMAND);
+        break;
+    case MATCH_ROM:
+        _receive(state_v::MATCH, 64);
+        break;
+    case SKIP_ROM:
+        _receive(state_v::FUNCTION_COMMAND, 8);
+        break;
+    case ALARM_SEARCH:
+        // Only devices with alarm flag take part in the search
+        if (!alarm()) {
+            _state = state_v::INACTIVE;
+            break;
+        }
+        // fall through
+    case SEARCH_ROM:
+        _state = state_v::SEARCH;
+        _bits = 0;
+        _search_phase = 0;
+        break;
+    default:
+        _state = state_v::INACTIVE;
+        break;
+    }
+}
+
+void VirtualDS18B20::_function_command(uint8_t command, uint64_t now)
+{
+    switch (command) {
+    case CONVERT_T: {
+        uint8_t resolution = MIN_RESOLUTION + ((scratchpad[4] >> 5) & 0x03);
+        _conversion_end = now
+            + DS18B20::conversion_time(resolution) * faults.conversion_slowdown;
+        _state = state_v::CONVERTING;
+        break;
+    }
+    case READ_SCRATCHPAD:
+        _update_scratchpad(now);
+        _transmit(scratchpad, 72, state_v::INACTIVE);
+        break;
+    case WRITE_SCRATCHPAD:
+        _receive(state_v::RECEIVE_CONFIG, 24);
+        break;
+    case COPY_SCRATCHPAD:
+        memcpy(eeprom, &scratchpad[2], sizeof(eeprom));
+        _state = state_v::INACTIVE;
+        break;
+    default:
+        _state = state_v::INACTIVE;
+        break;
+    }
+}
+
+// Finished conversion stores the temperature with configured resolution
+void VirtualDS18B20::_update_scratchpad(uint64_t now)
+{
+    if (_conversion_end == 0 || now < _conversion_end) {
+        return;
+    }
+    _conversion_end = 0;
+
+    uint8_t resolution = MIN_RESOLUTION + ((scratchpad[4] >> 5) & 0x03);
+    int16_t raw = temperature & ~((1 << (MAX_RESOLUTION - resolution)) - 1);
+    scratchpad[0] = raw & 0xFF;
+    scratchpad[1] = (raw >> 8) & 0xFF;
+    scratchpad[8] = crc8(scratchpad, 8);
+}
+
+uint8_t VirtualDS18B20::_flip(uint8_t bit)
+{
+    if (faults.bit_flip_rate == 0) {
+        return bit;
+    }
+    // Park-Miller generator, good enough for fault injection
+    _random = static_cast<uint32_t>((static_cast<uint64_t>(_random) * 48271) % 2147483647);
+    return (_random % faults.bit_flip_rate) == 0 ? !bit : bit;
+}
+
+// ============================== Bus =========================================
+SimBus::SimBus(uint8_t count)
+    : _count { count > SIM_MAX_DEVICES ? static_cast<uint8_t>(SIM_MAX_DEVICES) : count }
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        _devices[i].init(i + 1);
+    }
+    ESP_LOGI(TAG, "Simulated bus with %d devices.", _count);
+}
+
+esp_err_t SimBus::reset(void)
+{
+    _clock += SIM_RESET_DURATION;
+    _bus_time += SIM_RESET_DURATION;
+    ++_resets;
+
+    bool presence = false;
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_devices[i].present && !_devices[i].faults.no_presence) {
+            _devices[i].reset(_clock);
+            presence = true;
+        } else {
+            _devices[i].deactivate();
+        }
+    }
+    return presence ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+uint8_t SimBus::touch_bit(uint8_t bit)
+{
+    _clock += SIM_SLOT_DURATION;
+    _bus_time += SIM_SLOT_DURATION;
+    ++_slots;
+
+    // Open drain: line is low if master or any device pulls it
+    uint8_t level = bit;
+    for (uint8_t i = 0; i < _count; i++) {
+        level &= _devices[i].drive(_clock);
+    }
+    for (uint8_t i = 0; i < _count; i++) {
+        _devices[i].sample(level, _clock);
+    }
+    return level;
+}
+
+uint8_t SimBus::touch_byte(uint8_t byte)
+{
+    uint8_t result = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        result |= touch_bit((byte >> i) & 0x01) << i;
+    }
+    return result;
+}
+
+void SimBus::clear_statistics(void)
+{
+    _bus_time = 0;
+    _slots = 0;
+    _resets = 0;
+}
+
+} // namespace OneWire
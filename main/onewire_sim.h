@@ -0,0 +1,109 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_log.h" // IWYU pragma: keep
+#include <cstdint>
+
+// Simulated 1-Wire bus with virtual DS18B20 devices. Used instead of real
+// hardware to run the whole 1-Wire layer without sensors and to count how
+// much bus time every transaction costs. Devices live on the bus clock: it
+// moves with every slot and reset and when the master leaves the bus idle,
+// so conversions take the same simulated time on the target and on a host.
+// ============================ Bus model =====================================
+#define SIM_MAX_DEVICES 8
+#define SIM_RESET_DURATION 900 // Reset pulse + presence + recovery, us
+#define SIM_SLOT_DURATION 75 // One time slot with recovery, us
+#define SIM_DEFAULT_TEMPERATURE 0x0190 // 25 C in 1/16 C
+
+namespace OneWire {
+
+// Faults which could be injected into a virtual device
+struct SimFaults {
+    bool no_presence { false }; // Device doesn't answer reset
+    uint16_t bit_flip_rate { 0 }; // Flip one of N transmitted bits, 0 - off
+    uint8_t conversion_slowdown { 1 }; // Conversion time multiplier
+    bool config_locked { false }; // Writes of the configuration register are lost
+};
+
+class VirtualDS18B20 {
+public:
+    enum class state_v {
+        INACTIVE, // Not selected until next reset
+        ROM_COMMAND, // Receiving ROM command
+        MATCH, // Receiving ROM code
+        SEARCH, // Search ROM triplets
+        FUNCTION_COMMAND, // Receiving function command
+        TRANSMIT, // Sending ROM code or scratchpad
+        RECEIVE_CONFIG, // Receiving TH, TL and configuration
+        CONVERTING // Read slots report conversion status
+    };
+
+    uint8_t rom[8] {};
+    uint8_t scratchpad[9] {};
+    uint8_t eeprom[3] {}; // TH, TL and configuration
+    int16_t temperature { SIM_DEFAULT_TEMPERATURE }; // Measured value, 1/16 C
+    SimFaults faults {};
+    bool present { false };
+
+    void init(uint8_t serial);
+    // "now" is the bus clock, us
+    void reset(uint64_t now);
+    void deactivate(void) { _state = state_v::INACTIVE; }
+    // Bus slot is split in two phases: device drives the line, then it
+    // samples the resulting wired-AND level
+    uint8_t drive(uint64_t now);
+    void sample(uint8_t level, uint64_t now);
+    bool alarm(void);
+
+protected:
+    state_v _state { state_v::INACTIVE };
+    state_v _next_state { state_v::INACTIVE };
+    uint8_t _buffer[9] {};
+    uint8_t _bits { 0 }; // Bits transferred in the current state
+    uint8_t _length { 0 }; // Bits to transfer in the current state
+    uint8_t _search_phase { 0 }; // 0 - bit, 1 - complement, 2 - direction
+    uint64_t _conversion_end { 0 }; // Bus clock, us, 0 - no conversion
+    uint32_t _random { 1 };
+
+    void _receive(state_v state, uint8_t length);
+    void _transmit(const uint8_t* data, uint8_t length, state_v next_state);
+    void _rom_command(uint8_t command);
+    void _function_command(uint8_t command, uint64_t now);
+    void _update_scratchpad(uint64_t now);
+    uint8_t _flip(uint8_t bit);
+};
+
+class SimBus {
+protected:
+    VirtualDS18B20 _devices[SIM_MAX_DEVICES];
+    uint8_t _count { 0 };
+    uint64_t _clock { 1 }; // us, 0 is "no conversion" of the devices
+    uint64_t _bus_time { 0 }; // Simulated bus time, us
+    uint32_t _slots { 0 };
+    uint32_t _resets { 0 };
+    const char* TAG = "OneWireSim";
+
+public:
+    explicit SimBus(uint8_t count = 1);
+
+    esp_err_t init(void) { return ESP_OK; }
+    esp_err_t reset(void);
+    uint8_t touch_bit(uint8_t bit);
+    uint8_t touch_byte(uint8_t byte);
+
+    uint8_t count(void) { return _count; }
+    VirtualDS18B20& device(uint8_t index) { return _devices[index]; }
+
+    // Bus clock, us. It's not cleared with the statistics.
+    uint64_t now(void) { return _clock; }
+    // Master leaves the bus for "duration" us
+    void idle(uint32_t duration) { _clock += duration; }
+
+    // Statistics of simulated time
+    uint64_t bus_time(void) { return _bus_time; }
+    uint32_t slots(void) { return _slots; }
+    uint32_t resets(void) { return _resets; }
+    void clear_statistics(void);
+};
+
+} // namespace OneWire
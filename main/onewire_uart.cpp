@@ -0,0 +1,115 @@
+#include "onewire_uart.h"
+
+namespace OneWire {
+
+// ========================= Initialization ===================================
+UartBus::UartBus(const uart_port_t port)
+    : _port { port }
+{
+}
+
+esp_err_t UartBus::init(void)
+{
+    ESP_LOGI(TAG, "Onewire UART initialization begin.");
+    uart_config_t config = {};
+    config.baud_rate = UART_SLOT_BAUDRATE;
+    config.data_bits = UART_DATA_8_BITS;
+    config.parity = UART_PARITY_DISABLE;
+    config.stop_bits = UART_STOP_BITS_1;
+    config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+
+    esp_err_t status = uart_param_config(_port, &config);
+    if (status == ESP_OK) {
+        // UART1 of ESP8266 has no RX, so only UART0 can be used. Move it to
+        // GPIO13 (RX) / GPIO15 (TX), the console is on UART1 (see gpio.h).
+        if (_port == UART_NUM_0) {
+            uart_enable_swap();
+        }
+        status = uart_driver_install(_port, UART_RX_BUFFER_SIZE, 0, 0, NULL, 0);
+    }
+
+    if (status != ESP_OK) {
+        ESP_LOGE(TAG, "Onewire UART initialization fail.");
+        return status;
+    }
+
+    _is_initialized = true;
+    ESP_LOGI(TAG, "Onewire UART initialization success.");
+    return ESP_OK;
+}
+
+esp_err_t UartBus::_set_baudrate(uint32_t baudrate)
+{
+    // Last frame must leave shift register before the speed is changed
+    uart_wait_tx_done(_port, pdMS_TO_TICKS(UART_READ_TIMEOUT));
+    return uart_set_baudrate(_port, baudrate);
+}
+
+// ========================= 1-Wire ===========================================
+// Reset signal. Devices stretch the low part of 0xF0 frame by presence pulse.
+esp_err_t UartBus::reset(void)
+{
+    if (_is_initialized == false) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    _set_baudrate(UART_RESET_BAUDRATE);
+    uart_flush_input(_port);
+
+    const char frame = UART_RESET_FRAME;
+    uint8_t echo = 0;
+    uart_write_bytes(_port, &frame, 1);
+    int length = uart_read_bytes(_port, &echo, 1, pdMS_TO_TICKS(UART_READ_TIMEOUT));
+
+    _set_baudrate(UART_SLOT_BAUDRATE);
+
+    if (length != 1) {
+        ESP_LOGE(TAG, "Onewire reset fail. No echo, check TX/RX wiring.");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (echo == UART_RESET_FRAME) {
+        return ESP_ERR_TIMEOUT; // Nobody answered
+    }
+    if (echo == 0x00) {
+        ESP_LOGE(TAG, "Onewire reset fail. Bus is busy.");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    return ESP_OK;
+}
+
+uint8_t UartBus::touch_bit(uint8_t bit)
+{
+    const char frame = bit ? UART_WRITE_1_FRAME : UART_WRITE_0_FRAME;
+    uint8_t echo = 0;
+
+    uart_flush_input(_port);
+    uart_write_bytes(_port, &frame, 1);
+    uart_read_bytes(_port, &echo, 1, pdMS_TO_TICKS(UART_READ_TIMEOUT));
+
+    // Any device pulling the line during the slot spoils the echo
+    return echo == UART_WRITE_1_FRAME ? 1 : 0;
+}
+
+uint8_t UartBus::touch_byte(uint8_t byte)
+{
+    char frames[8];
+    uint8_t echo[8] = { 0 };
+
+    for (uint8_t i = 0; i < 8; i++) {
+        frames[i] = (byte >> i) & 0x01 ? UART_WRITE_1_FRAME : UART_WRITE_0_FRAME;
+    }
+
+    uart_flush_input(_port);
+    uart_write_bytes(_port, frames, sizeof(frames));
+    uart_read_bytes(_port, echo, sizeof(echo), pdMS_TO_TICKS(UART_READ_TIMEOUT));
+
+    uint8_t result = 0;
+    for (uint8_t i = 0; i < 8; i++) {
+        if (echo[i] == UART_WRITE_1_FRAME) {
+            result |= 1 << i;
+        }
+    }
+    return result;
+}
+
+} // namespace OneWire
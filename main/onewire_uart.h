@@ -0,0 +1,45 @@
+#pragma once
+
+#include "driver/uart.h"
+#include "esp_err.h"
+#include "esp_log.h" // IWYU pragma: keep
+#include "freertos/FreeRTOS.h" // IWYU pragma: keep
+#include <cstdint>
+
+// UART TX and RX are joined to the 1-Wire line (TX through open drain buffer
+// or diode), so every transmitted frame is read back with the bus state.
+// ============================= Reset ========================================
+#define UART_RESET_BAUDRATE 9600 // 0xF0 frame gives ~520 us low pulse
+#define UART_RESET_FRAME 0xF0
+// ============================ Time slots ====================================
+#define UART_SLOT_BAUDRATE 115200 // One frame is one time slot
+#define UART_WRITE_1_FRAME 0xFF // Start bit only, ~8.7 us low
+#define UART_WRITE_0_FRAME 0x00 // Start bit and data, ~78 us low
+#define UART_READ_TIMEOUT 10 // Waiting for echo, ms
+#define UART_RX_BUFFER_SIZE (UART_FIFO_LEN * 2) // Must be bigger than FIFO
+
+namespace OneWire {
+
+class UartBus {
+protected:
+    const uart_port_t _port;
+    bool _is_initialized { false };
+    const char* TAG = "OneWireUart";
+
+    esp_err_t _set_baudrate(uint32_t baudrate);
+
+public:
+    explicit UartBus(const uart_port_t port);
+
+    esp_err_t init(void);
+    bool is_initialized(void) { return _is_initialized; }
+
+    // Reset pulse, ESP_OK if any device answered with presence
+    esp_err_t reset(void);
+    // Write one slot and read the bus back. Read slot is write 1.
+    uint8_t touch_bit(uint8_t bit);
+    // Eight slots pushed to FIFO at once
+    uint8_t touch_byte(uint8_t byte);
+};
+
+} // namespace OneWire
@@ -0,0 +1,109 @@
+#include "pid.h"
+
+namespace Control_NS {
+
+Pid::Pid(int32_t kp, int32_t ki, int32_t kd, int32_t min_output, int32_t max_output)
+    : _kp(kp)
+    , _ki(ki)
+    , _kd(kd)
+    , _min_output(min_output)
+    , _max_output(max_output)
+{
+}
+
+void Pid::set_gains(int32_t kp, int32_t ki, int32_t kd)
+{
+    _kp = kp;
+    _ki = ki;
+    _kd = kd;
+}
+
+void Pid::set_limits(int32_t min_output, int32_t max_output)
+{
+    _min_output = min_output;
+    _max_output = max_output;
+}
+
+int32_t Pid::update(Temp_NS::q4_t target, Temp_NS::q4_t measurement, uint32_t interval)
+{
+    const int32_t error = measurement - target;
+    if (!_initialized || interval == 0 || interval > PID_MAX_INTERVAL) {
+        _initialized = true;
+        _last_measurement = measurement;
+        interval = 0;
+    }
+
+    // kp * error / 100 C * 256 -> 1/256 %
+    const int32_t proportional = static_cast<int32_t>(static_cast<int64_t>(_kp) * error * 4 / 25);
+
+    // On measurement, so a target change doesn't kick the output
+    int32_t derivative = 0;
+    if (interval > 0) {
+        derivative = static_cast<int32_t>(static_cast<int64_t>(_kd)
+            * (measurement - _last_measurement) * 9600 / static_cast<int64_t>(interval));
+    }
+    _last_measurement = measurement;
+
+    // Anti-windup: the integral doesn't grow while the output is saturated
+    // in the same direction and never leaves the output range by itself
+    const int64_t step = static_cast<int64_t>(_ki) * error * interval;
+    int64_t integral = _integral + step;
+    const int64_t integral_min = static_cast<int64_t>(_min_output) * INTEGRAL_SCALE;
+    const int64_t integral_max = static_cast<int64_t>(_max_output) * INTEGRAL_SCALE;
+    if (integral < integral_min) {
+        integral = integral_min;
+    } else if (integral > integral_max) {
+        integral = integral_max;
+    }
+    int64_t output = proportional + derivative + integral / INTEGRAL_SCALE;
+    if ((output > _max_output && step > 0) || (output < _min_output && step < 0)) {
+        integral = _integral;
+        output = proportional + derivative + integral / INTEGRAL_SCALE;
+    }
+    _integral = integral;
+
+    if (output < _min_output) {
+        output = _min_output;
+    } else if (output > _max_output) {
+        output = _max_output;
+    }
+    _output = static_cast<int32_t>(output);
+    return _output;
+}
+
+int32_t RpmLoop::update(uint32_t target, uint32_t rpm, uint32_t interval)
+{
+    if (_max_rpm == 0) {
+        return _output;
+    }
+    if (interval > PID_MAX_INTERVAL) {
+        interval = 0;
+    }
+    const int64_t feedforward = static_cast<int64_t>(target) * PID_OUTPUT_MAX / _max_rpm;
+    const int64_t error = static_cast<int64_t>(target) - static_cast<int64_t>(rpm);
+    const int64_t step = _ki * error * interval;
+    const int64_t limit = PID_OUTPUT_MAX * CORRECTION_SCALE;
+    int64_t correction = _correction + step;
+    if (correction < -limit) {
+        correction = -limit;
+    } else if (correction > limit) {
+        correction = limit;
+    }
+    // Anti-windup like Pid: no integration further into saturation
+    int64_t output = feedforward + correction / CORRECTION_SCALE;
+    if ((output > PID_OUTPUT_MAX && step > 0) || (output < 0 && step < 0)) {
+        correction = _correction;
+        output = feedforward + correction / CORRECTION_SCALE;
+    }
+    _correction = correction;
+
+    if (output < 0) {
+        output = 0;
+    } else if (output > PID_OUTPUT_MAX) {
+        output = PID_OUTPUT_MAX;
+    }
+    _output = static_cast<int32_t>(output);
+    return _output;
+}
+
+} // namespace Control_NS
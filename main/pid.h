@@ -0,0 +1,76 @@
+#pragma once
+
+#include "temperature.h"
+#include <cstdint>
+
+// Closed-loop fan control, integer math only
+namespace Control_NS {
+
+// Output is fan duty in 1/256 %
+constexpr int32_t PID_OUTPUT_ONE = 256; // 1 %
+constexpr int32_t PID_OUTPUT_MAX = 100 * PID_OUTPUT_ONE;
+// Interval of a reset, the derivative and integral are meaningless after it
+constexpr uint32_t PID_MAX_INTERVAL = 300000; // ms
+
+// Gains are in 1/100 of:
+//  kp - % duty per C above the target,
+//  ki - % duty per C per minute,
+//  kd - % duty per C/min of the temperature rise.
+// The fan cools, so error is measurement - target.
+class Pid {
+protected:
+    int32_t _kp;
+    int32_t _ki;
+    int32_t _kd;
+    int32_t _min_output;
+    int32_t _max_output;
+
+    // Integral term in 1/256 % multiplied by INTEGRAL_SCALE, so small
+    // errors over short intervals aren't truncated away
+    static constexpr int64_t INTEGRAL_SCALE = 100LL * (1 << Temp_NS::Q4_SHIFT) * 60000 / PID_OUTPUT_ONE;
+    int64_t _integral { 0 };
+    Temp_NS::q4_t _last_measurement { 0 };
+    int32_t _output { 0 };
+    bool _initialized { false };
+
+public:
+    Pid(int32_t kp, int32_t ki, int32_t kd,
+        int32_t min_output = 0, int32_t max_output = PID_OUTPUT_MAX);
+
+    void set_gains(int32_t kp, int32_t ki, int32_t kd);
+    void set_limits(int32_t min_output, int32_t max_output);
+    void reset(void) { _initialized = false; }
+
+    // Measurement taken "interval" ms after the previous one. Returns the
+    // new output in 1/256 %.
+    int32_t update(Temp_NS::q4_t target, Temp_NS::q4_t measurement, uint32_t interval);
+    int32_t output(void) const { return _output; }
+};
+
+// Fan speed loop, output in 1/256 % like Pid: the target's share of the full
+// speed plus the integral of the speed error, which takes up the fan's
+// non-linear duty to speed curve.
+// ki is 1/256 % duty per 100 rpm of error per second.
+class RpmLoop {
+protected:
+    uint32_t _max_rpm;
+    int32_t _ki;
+    static constexpr int64_t CORRECTION_SCALE = 100LL * 1000;
+    int64_t _correction { 0 }; // 1/256 % multiplied by CORRECTION_SCALE
+    int32_t _output { 0 };
+
+public:
+    RpmLoop(uint32_t max_rpm, int32_t ki)
+        : _max_rpm(max_rpm)
+        , _ki(ki)
+    {
+    }
+    void set_max_rpm(uint32_t max_rpm) { _max_rpm = max_rpm; }
+    void reset(void) { _correction = 0; }
+
+    // Speed measured "interval" ms after the previous one
+    int32_t update(uint32_t target, uint32_t rpm, uint32_t interval);
+    int32_t output(void) const { return _output; }
+};
+
+} // namespace Control_NS
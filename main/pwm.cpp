@@ -0,0 +1,44 @@
+#include "pwm.h"
+
+namespace Fan_NS {
+
+esp_err_t Output::_configure(uint32_t freq_hz, ledc_timer_bit_t resolution,
+    ledc_timer_t timer, ledc_channel_t channel, int gpio_num, uint32_t duty)
+{
+    // Set timer configuration
+    ledc_timer_config_t timer_conf {};
+    timer_conf.duty_resolution = resolution;
+    timer_conf.freq_hz = freq_hz;
+    timer_conf.speed_mode = LEDC_LOW_SPEED_MODE;
+    timer_conf.timer_num = timer;
+    esp_err_t err = ledc_timer_config(&timer_conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // Set channel configuration
+    ledc_channel_config_t channel_conf {};
+    channel_conf.channel = channel;
+    channel_conf.duty = 0;
+    channel_conf.gpio_num = gpio_num;
+    channel_conf.speed_mode = LEDC_LOW_SPEED_MODE;
+    channel_conf.hpoint = 0;
+    channel_conf.timer_sel = timer;
+    err = ledc_channel_config(&channel_conf);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // Initialize service, a second install by another channel is harmless
+    ledc_fade_func_install(0);
+
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, channel, duty);
+    return ledc_update_duty(LEDC_LOW_SPEED_MODE, channel);
+}
+
+void Output::_fade(ledc_channel_t channel, uint32_t duty)
+{
+    ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, channel, duty, FADE_TIME_MS);
+    ledc_fade_start(LEDC_LOW_SPEED_MODE, channel, LEDC_FADE_NO_WAIT);
+}
+
+} // namespace Fan_NS
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "curve.h"
+#include "driver/ledc.h"
+#include "esp_err.h"
+#include "pid.h"
+#include "temperature.h"
+#include <cstdint>
+
+namespace Fan_NS {
+
+constexpr uint32_t LOW_SPEED_MODE_TIMER = 8000;
+constexpr uint32_t FADE_TIME_MS = 5000; // Slow fade to every new duty
+
+// Duty arithmetic shared by the outputs. With a constexpr "max" the compiler
+// folds it into multiplications by constants.
+namespace Duty {
+    // Full duty of the channel. Above LOW_SPEED_MODE_TIMER (25 kHz fans)
+    // the period factor would be 0, so it's at least 1.
+    constexpr uint32_t full(uint32_t freq_hz, ledc_timer_bit_t resolution)
+    {
+        return (freq_hz && freq_hz < LOW_SPEED_MODE_TIMER ? LOW_SPEED_MODE_TIMER / freq_hz : 1)
+            * (1UL << resolution);
+    }
+    constexpr uint32_t from_percent(uint32_t max, uint32_t percent)
+    {
+        return max * percent / 100;
+    }
+    constexpr uint8_t to_percent(uint32_t max, uint32_t duty)
+    {
+        return static_cast<uint8_t>(duty * 100 / max);
+    }
+    // Control_NS::Curve duty in 1/100 %
+    constexpr uint32_t from_curve(uint32_t max, uint32_t duty)
+    {
+        return max * duty / Control_NS::CURVE_DUTY_MAX;
+    }
+    // Control_NS::Pid and RpmLoop output in 1/256 %
+    constexpr uint32_t from_pid(uint32_t max, int32_t output)
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(max) * output / Control_NS::PID_OUTPUT_MAX);
+    }
+    // Linear from "min_temp" C (0) to "max_temp" C (max). Duty is up to 17
+    // bits, span up to 12 bits - fits into 32 bits.
+    constexpr uint32_t linear(uint32_t max, Temp_NS::q4_t temperature, uint32_t min_temp, uint32_t max_temp)
+    {
+        return temperature <= Temp_NS::from_degrees(min_temp) ? 0
+            : temperature >= Temp_NS::from_degrees(max_temp)
+            ? max
+            : max * static_cast<uint32_t>(temperature - Temp_NS::from_degrees(min_temp))
+                / static_cast<uint32_t>(Temp_NS::from_degrees(max_temp) - Temp_NS::from_degrees(min_temp));
+    }
+} // namespace Duty
+
+// PWM output of one fan on a LEDC channel, duty is 0 .. max_duty()
+class Output {
+protected:
+    ~Output() = default;
+
+    // Timer and channel at "duty", fades are enabled
+    static esp_err_t _configure(uint32_t freq_hz, ledc_timer_bit_t resolution,
+        ledc_timer_t timer, ledc_channel_t channel, int gpio_num, uint32_t duty);
+    static void _fade(ledc_channel_t channel, uint32_t duty);
+
+public:
+    // Starts at full duty
+    virtual esp_err_t init(int gpio_num) = 0;
+    // Fades to "duty" in FADE_TIME_MS
+    virtual void write(uint32_t duty) = 0;
+
+    virtual uint32_t max_duty(void) const = 0;
+    virtual uint32_t from_percent(uint32_t percent) const = 0;
+    virtual uint8_t to_percent(uint32_t duty) const = 0;
+    virtual uint32_t from_curve(uint32_t duty) const = 0;
+    virtual uint32_t from_pid(int32_t output) const = 0;
+    virtual uint32_t linear(Temp_NS::q4_t temperature, uint32_t min_temp, uint32_t max_temp) const = 0;
+};
+
+// Frequency, resolution and channel fixed at compile time, so the full duty
+// and every scale factor are constants
+template <uint32_t Freq, ledc_timer_bit_t Resolution, ledc_channel_t Channel,
+    ledc_timer_t Timer = LEDC_TIMER_0>
+class Pwm final : public Output {
+public:
+    static_assert(Freq > 0, "Frequency must be positive");
+    static constexpr uint32_t MAX_DUTY = Duty::full(Freq, Resolution);
+    static_assert(MAX_DUTY <= (1UL << 17), "Duty math is 32-bit");
+
+    esp_err_t init(int gpio_num) override
+    {
+        return _configure(Freq, Resolution, Timer, Channel, gpio_num, MAX_DUTY);
+    }
+    void write(uint32_t duty) override { _fade(Channel, duty); }
+
+    uint32_t max_duty(void) const override { return MAX_DUTY; }
+    uint32_t from_percent(uint32_t percent) const override { return Duty::from_percent(MAX_DUTY, percent); }
+    uint8_t to_percent(uint32_t duty) const override { return Duty::to_percent(MAX_DUTY, duty); }
+    uint32_t from_curve(uint32_t duty) const override { return Duty::from_curve(MAX_DUTY, duty); }
+    uint32_t from_pid(int32_t output) const override { return Duty::from_pid(MAX_DUTY, output); }
+    uint32_t linear(Temp_NS::q4_t temperature, uint32_t min_temp, uint32_t max_temp) const override
+    {
+        return Duty::linear(MAX_DUTY, temperature, min_temp, max_temp);
+    }
+};
+
+// Frequency and channel known only at run time (NVS)
+class RuntimePwm final : public Output {
+protected:
+    const uint32_t _freq_hz;
+    const ledc_timer_bit_t _resolution;
+    const ledc_channel_t _channel;
+    const ledc_timer_t _timer;
+    const uint32_t _max_duty;
+
+public:
+    RuntimePwm(uint32_t freq_hz, ledc_channel_t channel = LEDC_CHANNEL_0,
+        ledc_timer_t timer = LEDC_TIMER_0, ledc_timer_bit_t resolution = LEDC_TIMER_10_BIT)
+        : _freq_hz(freq_hz)
+        , _resolution(resolution)
+        , _channel(channel)
+        , _timer(timer)
+        , _max_duty(Duty::full(freq_hz, resolution))
+    {
+    }
+
+    esp_err_t init(int gpio_num) override
+    {
+        return _configure(_freq_hz, _resolution, _timer, _channel, gpio_num, _max_duty);
+    }
+    void write(uint32_t duty) override { _fade(_channel, duty); }
+
+    uint32_t max_duty(void) const override { return _max_duty; }
+    uint32_t from_percent(uint32_t percent) const override { return Duty::from_percent(_max_duty, percent); }
+    uint8_t to_percent(uint32_t duty) const override { return Duty::to_percent(_max_duty, duty); }
+    uint32_t from_curve(uint32_t duty) const override { return Duty::from_curve(_max_duty, duty); }
+    uint32_t from_pid(int32_t output) const override { return Duty::from_pid(_max_duty, output); }
+    uint32_t linear(Temp_NS::q4_t temperature, uint32_t min_temp, uint32_t max_temp) const override
+    {
+        return Duty::linear(_max_duty, temperature, min_temp, max_temp);
+    }
+};
+
+} // namespace Fan_NS
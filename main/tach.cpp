@@ -0,0 +1,115 @@
+#include "tach.h"
+
+namespace Tach_NS {
+
+Status status {};
+
+const char* health_name(Health health)
+{
+    switch (health) {
+    case Health::STALL:
+        return "stall";
+    case Health::UNDER_SPEED:
+        return "under_speed";
+    case Health::OK:
+    default:
+        return "ok";
+    }
+}
+
+// =================== Counter ==================
+void IRAM_ATTR Counter::_isr(void* arg)
+{
+    Counter* counter = static_cast<Counter*>(arg);
+    counter->_edges = counter->_edges + 1;
+}
+
+esp_err_t Counter::start(gpio_num_t pin)
+{
+    gpio_config_t config {};
+    config.pin_bit_mask = 1UL << pin;
+    config.mode = GPIO_MODE_INPUT;
+    config.pull_up_en = GPIO_PULLUP_ENABLE;
+    config.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    config.intr_type = GPIO_INTR_NEGEDGE;
+    esp_err_t err = gpio_config(&config);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // Already installed by another user is fine
+    gpio_install_isr_service(0);
+    err = gpio_isr_handler_add(pin, _isr, this);
+    if (err == ESP_OK) {
+        _pin = pin;
+    }
+    return err;
+}
+
+void Counter::stop(void)
+{
+    if (_pin != GPIO_NUM_MAX) {
+        gpio_isr_handler_remove(_pin);
+        _pin = GPIO_NUM_MAX;
+    }
+}
+
+// =================== Meter ==================
+bool Meter::update(uint32_t edges, uint32_t now_us)
+{
+    if (!_started) {
+        _started = true;
+        _edges = edges;
+        _time = now_us;
+        return false;
+    }
+    const uint32_t elapsed = now_us - _time;
+    if (elapsed == 0 || _pulses == 0) {
+        return false;
+    }
+    const uint32_t count = edges - _edges;
+    _edges = edges;
+    _time = now_us;
+    _rpm = static_cast<uint32_t>(static_cast<uint64_t>(count) * 60000000ULL
+        / (static_cast<uint64_t>(_pulses) * elapsed));
+    return true;
+}
+
+// =================== Monitor ==================
+void Monitor::commanded(uint8_t percent, uint32_t now_ms)
+{
+    // Starting and reaching the full speed take time, slowing down doesn't
+    // make a healthy fan look bad
+    if ((_percent < DRIVEN_PERCENT && percent >= DRIVEN_PERCENT)
+        || (_percent < 100 && percent >= 100)) {
+        _changed = now_ms;
+        _spinning_up = true;
+    }
+    _percent = percent;
+}
+
+Health Monitor::update(uint32_t rpm, uint32_t now_ms)
+{
+    if (_spinning_up) {
+        if (now_ms - _changed < SPIN_UP_MS) {
+            return _health;
+        }
+        _spinning_up = false;
+    }
+
+    Health found = Health::OK;
+    if (_percent >= DRIVEN_PERCENT && rpm < _stall_rpm) {
+        found = Health::STALL;
+    } else if (_percent >= 100 && _max_rpm && rpm < _max_rpm * UNDER_SPEED_PERCENT / 100) {
+        found = Health::UNDER_SPEED;
+    }
+
+    if (found == _health) {
+        _windows = 0;
+    } else if (++_windows >= CONFIRM_WINDOWS) {
+        _windows = 0;
+        _health = found;
+    }
+    return _health;
+}
+
+} // namespace Tach_NS
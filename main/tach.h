@@ -0,0 +1,111 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include <cstdint>
+
+// Fan tachometer: edges are counted in the GPIO interrupt, RPM and the fan
+// health are calculated by the control task once a window
+namespace Tach_NS {
+
+// Open collector tach output with the internal pull-up. GPIO14 is the 4th
+// 1-Wire bus, so 4 buses need another pin.
+#ifndef FAN_TACH_GPIO
+#define FAN_TACH_GPIO 14
+#endif
+
+constexpr uint32_t WINDOW_MS = 1000; // RPM measurement window
+constexpr uint8_t CONFIRM_WINDOWS = 3; // Windows in a row to change the health
+constexpr uint32_t SPIN_UP_MS = 10000; // Duty fade and fan spin-up
+constexpr uint8_t DRIVEN_PERCENT = 20; // Below it the fan may stop
+constexpr uint8_t UNDER_SPEED_PERCENT = 70; // Of the full speed at 100 % duty
+
+enum class Health : uint8_t {
+    OK = 0,
+    STALL = 1, // Driven, but doesn't turn
+    UNDER_SPEED = 2 // Full duty, but far below the full speed
+};
+const char* health_name(Health health);
+
+// Falling edges of the tach pin. The ISR is the only writer of one aligned
+// word, so the control task reads it without a lock.
+class Counter {
+protected:
+    volatile uint32_t _edges { 0 };
+    gpio_num_t _pin { GPIO_NUM_MAX };
+
+    static void IRAM_ATTR _isr(void* arg);
+
+public:
+    esp_err_t start(gpio_num_t pin);
+    void stop(void);
+    uint32_t edges(void) const { return _edges; }
+};
+
+// RPM of the last window from two readings of the edge counter
+class Meter {
+protected:
+    uint8_t _pulses; // Per revolution
+    uint32_t _edges { 0 };
+    uint32_t _time { 0 }; // us
+    uint32_t _rpm { 0 };
+    bool _started { false };
+
+public:
+    explicit Meter(uint8_t pulses = 2)
+        : _pulses(pulses)
+    {
+    }
+    void set_pulses(uint8_t pulses) { _pulses = pulses; }
+    void reset(void) { _started = false; }
+
+    // Counter and time at the end of a window, both may wrap. The first
+    // call only starts the window. Returns true if the RPM is updated.
+    bool update(uint32_t edges, uint32_t now_us);
+    uint32_t rpm(void) const { return _rpm; }
+};
+
+// Stall and under-speed detection from the measured RPM and the commanded
+// duty. The state changes after CONFIRM_WINDOWS windows in a row and isn't
+// judged for SPIN_UP_MS after the fan is started or sent to full duty.
+class Monitor {
+protected:
+    uint32_t _stall_rpm;
+    uint32_t _max_rpm; // At 100 % duty, 0 - unknown
+    uint8_t _percent { 0 }; // Commanded duty
+    uint32_t _changed { 0 }; // ms of the last spin-up
+    bool _spinning_up { false };
+    uint8_t _windows { 0 }; // Windows in a row with another health
+    Health _health { Health::OK };
+
+public:
+    Monitor(uint32_t stall_rpm = 0, uint32_t max_rpm = 0)
+        : _stall_rpm(stall_rpm)
+        , _max_rpm(max_rpm)
+    {
+    }
+    void set_limits(uint32_t stall_rpm, uint32_t max_rpm)
+    {
+        _stall_rpm = stall_rpm;
+        _max_rpm = max_rpm;
+    }
+
+    // Duty in % sent to the fan at now_ms
+    void commanded(uint8_t percent, uint32_t now_ms);
+    // RPM of a window ended at now_ms
+    Health update(uint32_t rpm, uint32_t now_ms);
+    Health health(void) const { return _health; }
+};
+
+// Written by the fan task, read by MQTT
+struct Status {
+    volatile uint32_t rpm;
+    volatile uint32_t target; // RPM mode, 0 - none
+    volatile Health health;
+    volatile uint32_t alerts; // Changes to STALL or UNDER_SPEED
+    volatile uint32_t windows; // Measured windows
+};
+extern Status status;
+
+} // namespace Tach_NS
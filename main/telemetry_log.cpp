@@ -0,0 +1,278 @@
+#include "telemetry_log.h"
+#include "esp_log.h"
+#include "gpio.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Telemetry_NS {
+
+QueueHandle_t log_queue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(Record));
+static std::atomic<uint32_t> _queue_drops { 0 };
+
+BinaryLog telemetry_log("/spiffs");
+
+static uint8_t record_crc(const Record& record)
+{
+    return OneWire::crc8(reinterpret_cast<const uint8_t*>(&record), sizeof(Record) - 1);
+}
+
+bool record(uint8_t series, uint32_t time, int16_t value)
+{
+    Record record { time, value, series, 0 };
+    if (xQueueSend(log_queue, &record, 0) != pdPASS) {
+        ++_queue_drops;
+        return false;
+    }
+    return true;
+}
+
+uint32_t queue_drops(void)
+{
+    return _queue_drops.load();
+}
+
+// "log00042.bin", SPIFFS names are limited to 32 characters with the path
+static bool parse_segment_name(const char* name, uint32_t& segment)
+{
+    char* end = nullptr;
+    if (strncmp(name, "log", 3) != 0) {
+        return false;
+    }
+    segment = strtoul(name + 3, &end, 10);
+    return end != name + 3 && strcmp(end, ".bin") == 0;
+}
+
+// ========================= BinaryLog ========================================
+BinaryLog::BinaryLog(const char* base_path)
+{
+    strncpy(_base_path, base_path, sizeof(_base_path) - 1);
+    _base_path[sizeof(_base_path) - 1] = '\0';
+}
+
+BinaryLog::~BinaryLog(void)
+{
+    close();
+}
+
+void BinaryLog::_segment_path(char* path, size_t size, uint32_t segment) const
+{
+    snprintf(path, size, "%s/log%05u.bin", _base_path, segment);
+}
+
+// Pages touched by a write at "offset" of "length" bytes
+void BinaryLog::_account(uint32_t offset, uint32_t length)
+{
+    const uint32_t first_page = offset / FLASH_PAGE_SIZE;
+    const uint32_t last_page = (offset + length - 1) / FLASH_PAGE_SIZE;
+    const uint32_t programmed = (last_page - first_page + 1) * FLASH_PAGE_SIZE;
+
+    _stats.payload_bytes += length;
+    _stats.flash_bytes += programmed;
+    _block_fill += programmed;
+    while (_block_fill >= FLASH_BLOCK_SIZE) {
+        _block_fill -= FLASH_BLOCK_SIZE;
+        ++_stats.erases;
+    }
+}
+
+esp_err_t BinaryLog::open(void)
+{
+    DIR* dir = opendir(_base_path);
+    if (dir == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", _base_path);
+        return ESP_FAIL;
+    }
+    bool found = false;
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    uint32_t count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        uint32_t segment = 0;
+        if (!parse_segment_name(entry->d_name, segment)) {
+            continue;
+        }
+        found = true;
+        ++count;
+        if (segment < first) {
+            first = segment;
+        }
+        if (segment > last) {
+            last = segment;
+        }
+    }
+    closedir(dir);
+
+    _boot = 0;
+    if (found) {
+        // Power could be lost in the middle of a record, it's left as is,
+        // readers stop at the first bad one
+        uint32_t valid_bytes = 0;
+        SegmentHeader header {};
+        char path[48];
+        _segment_path(path, sizeof(path), last);
+        FILE* file = fopen(path, "rb");
+        if (file != nullptr) {
+            if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == SEGMENT_MAGIC) {
+                _boot = header.boot + 1;
+            }
+            fclose(file);
+        }
+        read_segment(last, nullptr, nullptr, &valid_bytes);
+        struct stat file_stat;
+        if (stat(path, &file_stat) == 0 && static_cast<uint32_t>(file_stat.st_size) > valid_bytes) {
+            _stats.torn_bytes = file_stat.st_size - valid_bytes;
+            ESP_LOGW(TAG, "Segment %u ends with %u bad bytes", last, _stats.torn_bytes);
+        }
+        _first_segment = first;
+        _segment = last + 1;
+    } else {
+        count = 0;
+        _first_segment = 0;
+        _segment = 0;
+    }
+    _stats.segments = count;
+    ESP_LOGI(TAG, "Segments %u..%u, boot %u", _first_segment, _segment, _boot);
+    return _open_segment();
+}
+
+esp_err_t BinaryLog::_open_segment(void)
+{
+    char path[48];
+
+    // Make room for the new segment, missing numbers are skipped
+    while (_stats.segments >= SEGMENT_COUNT && _first_segment < _segment) {
+        _segment_path(path, sizeof(path), _first_segment++);
+        if (unlink(path) == 0) {
+            --_stats.segments;
+        }
+    }
+
+    _segment_path(path, sizeof(path), _segment);
+    _file = fopen(path, "wb");
+    if (_file == nullptr) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return ESP_FAIL;
+    }
+    const SegmentHeader header { SEGMENT_MAGIC, SEGMENT_VERSION, _boot, _segment };
+    if (fwrite(&header, sizeof(header), 1, _file) != 1) {
+        ESP_LOGE(TAG, "Failed to write header of %s", path);
+        fclose(_file);
+        _file = nullptr;
+        return ESP_FAIL;
+    }
+    _account(0, sizeof(header));
+    _file_size = sizeof(header);
+    _segment_records = 0;
+    ++_stats.segments;
+    return ESP_OK;
+}
+
+void BinaryLog::close(void)
+{
+    if (_file != nullptr) {
+        flush();
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+esp_err_t BinaryLog::append(uint8_t series, uint32_t time, int16_t value)
+{
+    Record& record = _batch[_batched];
+    record.time = time;
+    record.value = value;
+    record.series = series;
+    record.crc = record_crc(record);
+    if (++_batched < FLUSH_EVERY) {
+        return ESP_OK;
+    }
+    return flush();
+}
+
+esp_err_t BinaryLog::_write_batch(void)
+{
+    uint8_t written = 0;
+    while (written < _batched) {
+        if (_file == nullptr || _segment_records >= SEGMENT_RECORDS) {
+            if (_file != nullptr) {
+                fclose(_file);
+                _file = nullptr;
+                ++_segment;
+            }
+            if (_open_segment() != ESP_OK) {
+                _stats.dropped += _batched - written;
+                return ESP_FAIL;
+            }
+        }
+        // Whole batch or the rest of the segment
+        uint32_t count = _batched - written;
+        if (count > static_cast<uint32_t>(SEGMENT_RECORDS - _segment_records)) {
+            count = SEGMENT_RECORDS - _segment_records;
+        }
+        const size_t done = fwrite(&_batch[written], sizeof(Record), count, _file);
+        _account(_file_size, done * sizeof(Record));
+        _file_size += done * sizeof(Record);
+        _segment_records += done;
+        _stats.records += done;
+        written += done;
+        if (done != count) {
+            ESP_LOGE(TAG, "Failed to write segment %u", _segment);
+            _stats.dropped += _batched - written;
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t BinaryLog::flush(void)
+{
+    if (_batched == 0) {
+        return ESP_OK;
+    }
+    esp_err_t ret = _write_batch();
+    _batched = 0;
+    // Record data leaves the stdio and SPIFFS caches
+    if (_file != nullptr && (fflush(_file) != 0 || fsync(fileno(_file)) != 0)) {
+        ESP_LOGE(TAG, "Failed to sync segment %u", _segment);
+        ret = ESP_FAIL;
+    }
+    ++_stats.flushes;
+    return ret;
+}
+
+esp_err_t BinaryLog::read_segment(uint32_t segment, RecordVisitor visitor, void* context,
+    uint32_t* valid_bytes) const
+{
+    char path[48];
+    _segment_path(path, sizeof(path), segment);
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t valid = 0;
+    SegmentHeader header {};
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == SEGMENT_MAGIC
+        && header.version == SEGMENT_VERSION) {
+        valid = sizeof(header);
+        Record record;
+        while (fread(&record, sizeof(record), 1, file) == 1 && record.crc == record_crc(record)) {
+            valid += sizeof(record);
+            if (visitor != nullptr && !visitor(header, record, context)) {
+                break;
+            }
+        }
+    }
+    fclose(file);
+    if (valid_bytes != nullptr) {
+        *valid_bytes = valid;
+    }
+    return ESP_OK;
+}
+
+} // namespace Telemetry_NS
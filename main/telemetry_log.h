@@ -0,0 +1,121 @@
+#pragma once
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h" // IWYU pragma: keep
+#include "freertos/queue.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Append-only binary log of temperatures and fan duty on the storage
+// partition. Records are fixed size, collected in RAM and written in
+// batches to the open segment file. Every boot starts a new segment, the
+// oldest segments are deleted when there are too many of them.
+namespace Telemetry_NS {
+
+constexpr uint16_t SEGMENT_RECORDS = 4096; // 32 KB segment
+constexpr uint8_t SEGMENT_COUNT = 16; // Half of the storage partition
+constexpr uint8_t FLUSH_EVERY = 32; // Records in the RAM batch
+constexpr uint32_t FLUSH_PERIOD_MS = 60000; // Partial batch is written after
+constexpr uint8_t LOG_QUEUE_LENGTH = 16;
+
+// SPIFFS geometry for write estimates
+constexpr size_t FLASH_PAGE_SIZE = 256;
+constexpr size_t FLASH_BLOCK_SIZE = 4096;
+
+constexpr uint32_t SEGMENT_MAGIC = 0x474F4C48; // "HLOG"
+constexpr uint16_t SEGMENT_VERSION = 1;
+
+// Series ids are the ones of History_NS
+struct Record {
+    uint32_t time; // s since boot
+    int16_t value; // Q12.4 temperature or duty %
+    uint8_t series;
+    uint8_t crc; // CRC8 of the bytes before, a torn record fails it
+};
+static_assert(sizeof(Record) == 8, "Record is stored as is");
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t boot; // Boots since the log was created
+    uint32_t sequence; // Number of the segment, also in the file name
+};
+static_assert(sizeof(SegmentHeader) == 12, "SegmentHeader is stored as is");
+
+// Since boot. Flash writes are estimates: SPIFFS programs whole pages and
+// rewrites the last partial page on every flush.
+struct Stats {
+    uint32_t records { 0 }; // Written to the file
+    uint32_t dropped { 0 }; // Lost in a failed write
+    uint32_t flushes { 0 };
+    uint32_t payload_bytes { 0 }; // Records and headers
+    uint32_t flash_bytes { 0 }; // Pages programmed
+    uint32_t erases { 0 }; // Blocks filled by programmed pages
+    uint32_t segments { 0 }; // Segments kept
+    uint32_t torn_bytes { 0 }; // Bad tail of the last segment at start
+
+    // Flash bytes per payload byte, x100
+    uint32_t amplification(void) const
+    {
+        return payload_bytes ? static_cast<uint32_t>(100ULL * flash_bytes / payload_bytes) : 0;
+    }
+};
+
+// Return false to stop the iteration
+typedef bool (*RecordVisitor)(const SegmentHeader& header, const Record& record, void* context);
+
+class BinaryLog {
+protected:
+    char _base_path[16];
+    FILE* _file { nullptr };
+    uint32_t _first_segment { 0 };
+    uint32_t _segment { 0 }; // Open one
+    uint16_t _boot { 0 };
+    uint16_t _segment_records { 0 };
+    uint32_t _file_size { 0 }; // Bytes of the open segment
+    uint32_t _block_fill { 0 }; // Flash bytes since the last counted erase
+
+    Record _batch[FLUSH_EVERY];
+    uint8_t _batched { 0 };
+    Stats _stats;
+
+    void _segment_path(char* path, size_t size, uint32_t segment) const;
+    void _account(uint32_t offset, uint32_t length);
+    esp_err_t _open_segment(void);
+    esp_err_t _write_batch(void);
+
+public:
+    BinaryLog(const char* base_path);
+    ~BinaryLog(void);
+
+    // Finds existing segments and starts a new one
+    esp_err_t open(void);
+    void close(void);
+
+    esp_err_t append(uint8_t series, uint32_t time, int16_t value);
+    // Writes the batch and syncs the file
+    esp_err_t flush(void);
+
+    // Valid records of one segment, reading stops at the first bad one.
+    // Returns ESP_ERR_NOT_FOUND if the segment is missing.
+    esp_err_t read_segment(uint32_t segment, RecordVisitor visitor, void* context,
+        uint32_t* valid_bytes = nullptr) const;
+    uint32_t first_segment(void) const { return _first_segment; }
+    uint32_t last_segment(void) const { return _segment; }
+
+    const Stats& stats(void) const { return _stats; }
+
+    constexpr static const char* TAG = "TelemetryLog";
+};
+
+// Samples for the log task, producers never wait
+extern QueueHandle_t log_queue;
+// Puts a record into log_queue, false if it is full
+bool record(uint8_t series, uint32_t time, int16_t value);
+// Records lost on a full log_queue since boot
+uint32_t queue_drops(void);
+
+extern BinaryLog telemetry_log;
+
+} // namespace Telemetry_NS
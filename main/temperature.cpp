@@ -0,0 +1,41 @@
+#include "temperature.h"
+
+namespace Temp_NS {
+
+size_t format(char* buffer, size_t size, q4_t value)
+{
+    char text[FORMAT_SIZE];
+    size_t length = 0;
+
+    int32_t magnitude = value < 0 ? -static_cast<int32_t>(value) : value;
+    // Hundredths of degree, rounded half up
+    uint32_t hundredths = (magnitude * 100 + Q4_ONE / 2) >> Q4_SHIFT;
+    uint32_t degrees = hundredths / 100;
+    hundredths %= 100;
+
+    // Digits are written backwards
+    text[length++] = '0' + hundredths % 10;
+    text[length++] = '0' + hundredths / 10;
+    text[length++] = '.';
+    do {
+        text[length++] = '0' + degrees % 10;
+        degrees /= 10;
+    } while (degrees);
+    if (value < 0) {
+        text[length++] = '-';
+    }
+
+    if (length + 1 > size) {
+        if (size) {
+            buffer[0] = '\0';
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        buffer[i] = text[length - 1 - i];
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+} // namespace Temp_NS
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Temperatures are carried in DS18B20 native Q12.4 format: int16_t in
+// 1/16 C. ESP8266 has no FPU, so the pipeline from the 1-Wire read to the
+// fan duty and MQTT text is integer only.
+namespace Temp_NS {
+
+typedef int16_t q4_t;
+constexpr uint8_t Q4_SHIFT = 4;
+constexpr q4_t Q4_ONE = 1 << Q4_SHIFT; // 1 C
+
+// Whole degrees to Q12.4
+constexpr q4_t from_degrees(int32_t degrees)
+{
+    return static_cast<q4_t>(degrees * Q4_ONE);
+}
+// Whole degrees rounded down, -0.5 C gives -1
+constexpr int16_t floor_degrees(q4_t value)
+{
+    return value >> Q4_SHIFT;
+}
+
+// Longest text is "-2048.00"
+constexpr size_t FORMAT_SIZE = 9;
+// Decimal text with two rounded digits after the point, 0x0191 -> "25.06".
+// Returns text length, 0 if the buffer is too small.
+size_t format(char* buffer, size_t size, q4_t value);
+
+} // namespace Temp_NS
@@ -0,0 +1,183 @@
+#include "zone.h"
+#include "onewire_multi.h"
+#include "secrets.h"
+#include "tach.h"
+#include <cstdio>
+
+namespace Fan_NS {
+
+ZoneMap zone_map {};
+
+const char* mode_name(aggregation_mode mode)
+{
+    switch (mode) {
+    case aggregation_mode::WEIGHTED:
+        return "weighted";
+    case aggregation_mode::CURVES:
+        return "curves";
+    case aggregation_mode::MAX:
+    default:
+        return "max";
+    }
+}
+
+// =================== ZoneMap ==================
+// What holds the pin so it can't drive a fan, nullptr - it's free
+static const char* pin_owner(uint32_t gpio)
+{
+    if (gpio > 15) {
+        return "no PWM"; // GPIO16 is an RTC pin
+    }
+    if (gpio >= 6 && gpio <= 11) {
+        return "SPI flash";
+    }
+    if (gpio == FAN_TACH_GPIO) {
+        return "fan tach";
+    }
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+    // UART0 is swapped to GPIO13 (RX) / GPIO15 (TX), the console is on UART1
+    if (gpio == 13 || gpio == 15) {
+        return "1-Wire UART";
+    }
+    if (gpio == 2) {
+        return "UART1 console";
+    }
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO && ONEWIRE_BUS_COUNT > 1
+    const gpio_num_t bus_pins[ONEWIRE_MAX_BUSES] = ONEWIRE_BUS_PINS;
+    for (uint8_t i = 0; i < ONEWIRE_BUS_COUNT; i++) {
+        if (gpio == static_cast<uint32_t>(bus_pins[i])) {
+            return "1-Wire bus";
+        }
+    }
+#elif ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+    if (gpio == ONEWIRE_GPIO_PIN) {
+        return "1-Wire bus";
+    }
+#endif
+    return nullptr;
+}
+
+esp_err_t ZoneMap::load(Nvs_NS::Nvs& nvs)
+{
+    uint32_t requested = ZONE_COUNT;
+    uint32_t common_mode = FAN_MODE;
+    nvs.read_u32(ZONE_COUNT_KEY, &requested, &requested);
+    nvs.read_u32(FAN_MODE_KEY, &common_mode, &common_mode);
+    if (requested == 0 || requested > MAX_ZONES) {
+        ESP_LOGE(ZoneManager::TAG, "%u zones, using 1 .. %u", requested, MAX_ZONES);
+        requested = requested ? MAX_ZONES : 1;
+    }
+
+    count = 0;
+    for (uint8_t i = 0; i < requested; i++) {
+        char key[16] = { 0 };
+        uint32_t gpio = i == 0 ? FAN_GPIO : static_cast<uint32_t>(GPIO_NUM_MAX); // No default pin
+        uint32_t sensors = ALL_SENSORS;
+        uint32_t mode = common_mode;
+        snprintf(key, sizeof(key), "%s%d", ZONE_GPIO_KEY, i);
+        nvs.read_u32(key, &gpio, &gpio);
+        snprintf(key, sizeof(key), "%s%d", ZONE_SENSORS_KEY, i);
+        nvs.read_u32(key, &sensors, &sensors);
+        if (i != 0) {
+            snprintf(key, sizeof(key), "%s%d", ZONE_MODE_KEY, i);
+            nvs.read_u32(key, &mode, &mode);
+        }
+
+        // A pin drives one fan
+        const char* owner = pin_owner(gpio);
+        for (uint8_t j = 0; j < count && owner == nullptr; j++) {
+            owner = zones[j].gpio == gpio ? "another zone" : nullptr;
+        }
+        if (owner != nullptr) {
+            ESP_LOGE(ZoneManager::TAG, "Zone %d: GPIO%u can't drive a fan (%s), zone is off", i, gpio,
+                owner);
+            continue;
+        }
+        Zone& zone = zones[count++];
+        zone.id = i;
+        zone.gpio = static_cast<uint8_t>(gpio);
+        zone.sensors = static_cast<uint8_t>(sensors);
+        zone.mode = mode > static_cast<uint32_t>(aggregation_mode::CURVES)
+            ? aggregation_mode::MAX
+            : static_cast<aggregation_mode>(mode);
+        ESP_LOGI(ZoneManager::TAG, "Zone %d: channel %d, GPIO%u, drives 0x%02x, %s", i,
+            count - 1, zone.gpio, zone.sensors, mode_name(zone.mode));
+    }
+    return count ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+// =================== ZoneManager ==================
+ZoneManager::ZoneManager(const SensorChannel_t* sensor_channel)
+    : _sensor_channel { sensor_channel }
+    , _sensor_cursor { sensor_channel->subscribe() }
+{
+}
+
+esp_err_t ZoneManager::add(FanPWM* fan)
+{
+    if (fan == nullptr || _count >= MAX_ZONES) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    _fans[_count++] = fan;
+    return ESP_OK;
+}
+
+void ZoneManager::start(void)
+{
+    // The fans follow estimates only
+    const uint32_t skipped = _sensor_cursor.skipped;
+    uint32_t published[SENSOR_CHANNEL_LENGTH]; // For the actuation latency
+    uint8_t samples = 0;
+    while (_sensor_channel->read(_sensor_cursor, _sensor_data)) {
+        if (_sensor_data.kind != SENSOR_ESTIMATED) {
+            continue;
+        }
+        if (_sensor_data.sensor_id >= SENSOR_COUNT) {
+            ESP_LOGE(TAG, "Unknown sensor %d.", _sensor_data.sensor_id);
+            continue;
+        }
+        bool used = false;
+        for (uint8_t i = 0; i < _count; i++) {
+            used |= _fans[i]->push(_sensor_data);
+        }
+        if (used && samples < SENSOR_CHANNEL_LENGTH) {
+            published[samples++] = _sensor_data.published;
+        }
+        char text[Temp_NS::FORMAT_SIZE];
+        Temp_NS::format(text, sizeof(text), _sensor_data.temperature);
+        ESP_LOGI(TAG, "Sensor %d temperature %s, seq %u, flags 0x%02x", _sensor_data.sensor_id,
+            text, _sensor_data.seq, _sensor_data.flags);
+    }
+    if (_sensor_cursor.skipped != skipped) {
+        ESP_LOGW(TAG, "Skipped %u samples", _sensor_cursor.skipped - skipped);
+    }
+
+    // Every zone, a sample counts once however many fans it moved
+    bool actuated = false;
+    for (uint8_t i = 0; i < _count; i++) {
+        actuated |= _fans[i]->control();
+    }
+    if (!actuated) {
+        return;
+    }
+    const uint32_t now = Latency_NS::now_us();
+    for (uint8_t i = 0; i < samples; i++) {
+        Latency_NS::stages[Latency_NS::STAGE_ACTUATION].add(now - published[i]);
+    }
+}
+
+void ZoneManager::tach(void)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        _fans[i]->tach();
+    }
+}
+
+void ZoneManager::full_power(void)
+{
+    for (uint8_t i = 0; i < _count; i++) {
+        _fans[i]->full_power();
+    }
+}
+
+} // namespace Fan_NS
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "driver/ledc.h"
+#include "esp_err.h"
+#include "fan.h"
+#include "gpio.h"
+#include "mqtt.h"
+#include "nvs.h"
+#include <cstdint>
+
+// Fan zones: every fan has its own LEDC channel, drives, aggregation and
+// curve. One control pass of the fan task updates all of them.
+namespace Fan_NS {
+
+constexpr uint8_t MAX_ZONES = LEDC_CHANNEL_MAX; // One LEDC channel each
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_UART
+constexpr uint8_t FAN_GPIO = 12; // Fan of zone 0, GPIO13 is the 1-Wire UART RX
+#else
+constexpr uint8_t FAN_GPIO = 13; // Fan of zone 0
+#endif
+constexpr uint8_t ALL_SENSORS = 0xFF; // Drive mask of a zone, bit N - sensor N
+static_assert(SENSOR_COUNT <= 8, "Drive mask of a zone is 8 bits");
+
+// Zone as it's stored in NVS
+struct Zone {
+    uint8_t id; // <N> of the NVS keys and MQTT topics
+    uint8_t gpio; // Fan PWM pin
+    uint8_t sensors; // Drives the fan cools
+    aggregation_mode mode;
+};
+
+// Zones loaded once at boot, read by the fan and MQTT tasks. "zone_count"
+// zones, zone N is "zone_gpio<N>" and "zone_sensors<N>". Zone 0 keeps
+// "fan_mode" and "fan_curve", other zones have "zone_mode<N>" and
+// "zone_curve<N>". A zone without a usable pin is left out, the next ones
+// take its LEDC channel. Usable is GPIO0..GPIO15 without the SPI flash, the
+// 1-Wire bus, the tach input and another zone's fan.
+struct ZoneMap {
+    uint8_t count { 0 };
+    Zone zones[MAX_ZONES] {};
+
+    esp_err_t load(Nvs_NS::Nvs& nvs);
+};
+extern ZoneMap zone_map;
+
+const char* mode_name(aggregation_mode mode);
+
+// Fans of all zones behind one cursor of the sensor channel. Every sample
+// is decoded once and given to the zones which have its drive.
+class ZoneManager {
+protected:
+    const SensorChannel_t* _sensor_channel;
+    Broadcast_NS::Cursor _sensor_cursor;
+    SensorData_t _sensor_data {};
+    FanPWM* _fans[MAX_ZONES] {};
+    uint8_t _count { 0 };
+
+public:
+    explicit ZoneManager(const SensorChannel_t* sensor_channel);
+
+    // Fan of the next zone, it lives as long as the manager
+    esp_err_t add(FanPWM* fan);
+    uint8_t count(void) const { return _count; }
+    FanPWM& fan(uint8_t zone) { return *_fans[zone]; }
+
+    // New samples are waiting in the channel
+    bool pending(void) const { return !_sensor_channel->empty(_sensor_cursor); }
+
+    // Take all waiting measurements and run the pass of every zone
+    void start(void);
+    // Tach windows of the fans which have one
+    void tach(void);
+    // All fans at full duty
+    void full_power(void);
+
+    constexpr static const char* TAG = "Zones";
+};
+
+} // namespace Fan_NS
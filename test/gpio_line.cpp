@@ -0,0 +1,184 @@
+#include "gpio_line.h"
+#include <cstring>
+
+namespace Line_NS {
+
+struct Line {
+    OneWire::SimBus* bus;
+    bool low; // Master pulls the line low
+    bool read_pending; // Short slot the master may sample
+    uint64_t low_since; // Falling edge of the last master pulse
+    uint64_t device_low_until; // A device answers 0 until then
+    uint64_t presence_start;
+    uint64_t presence_end;
+    Statistics counters;
+};
+
+static Line lines[GPIO_NUM_16];
+static uint64_t line_clock = 1; // 0 is "no conversion" of the devices
+static uint32_t out = 0;
+static uint32_t enable = 0;
+
+static bool device_low(const Line& line)
+{
+    return line_clock < line.device_low_until
+        || (line_clock >= line.presence_start && line_clock < line.presence_end);
+}
+
+// Master released the line: the pulse width decides what the devices saw
+static void release(Line& line)
+{
+    const uint64_t width = line_clock - line.low_since;
+    OneWire::SimBus& bus = *line.bus;
+
+    if (width >= LINE_RESET_MIN) {
+        ++line.counters.resets;
+        bool presence = false;
+        for (uint8_t i = 0; i < bus.count(); i++) {
+            OneWire::VirtualDS18B20& device = bus.device(i);
+            if (device.present && !device.faults.no_presence) {
+                device.reset(line_clock);
+                presence = true;
+            } else {
+                device.deactivate();
+            }
+        }
+        if (presence) {
+            line.presence_start = line_clock + LINE_PRESENCE_WAIT;
+            line.presence_end = line.presence_start + LINE_PRESENCE;
+        }
+        return;
+    }
+    if (width == 0 || width > LINE_SLOT_MAX
+        || (width >= LINE_WRITE_1_MAX && width < LINE_WRITE_0_MIN)) {
+        ++line.counters.bad_pulses;
+        return;
+    }
+
+    // Devices put their bit on the line at the falling edge, it's wired-AND
+    // with the bit of the master
+    ++line.counters.slots;
+    const bool short_pulse = width < LINE_WRITE_1_MAX;
+    uint8_t level = short_pulse ? 1 : 0;
+    for (uint8_t i = 0; i < bus.count(); i++) {
+        level &= bus.device(i).drive(line.low_since);
+    }
+    for (uint8_t i = 0; i < bus.count(); i++) {
+        bus.device(i).sample(level, line_clock);
+    }
+    if (short_pulse && level == 0) {
+        line.device_low_until = line.low_since + LINE_READ_VALID + 1;
+    }
+    line.read_pending = short_pulse;
+}
+
+// Edges of all lines changed by one register write
+static void update(void)
+{
+    const uint32_t driven_low = enable & ~out;
+    uint32_t falling = 0;
+    for (uint8_t pin = 0; pin < GPIO_NUM_16; pin++) {
+        Line& line = lines[pin];
+        const bool low = (driven_low >> pin) & 0x01;
+        if (line.bus == nullptr || low == line.low) {
+            continue;
+        }
+        line.low = low;
+        if (low) {
+            line.low_since = line_clock;
+            line.read_pending = false;
+            falling |= 1UL << pin;
+        } else {
+            release(line);
+        }
+    }
+    for (uint8_t pin = 0; pin < GPIO_NUM_16; pin++) {
+        if (((falling >> pin) & 0x01) && (falling & ~(1UL << pin))) {
+            ++lines[pin].counters.shared;
+        }
+    }
+}
+
+static void write_reg(uint32_t offset, uint32_t value)
+{
+    switch (offset) {
+    case 0x04:
+        out |= value;
+        break;
+    case 0x08:
+        out &= ~value;
+        break;
+    case 0x10:
+        enable |= value;
+        break;
+    case 0x14:
+        enable &= ~value;
+        break;
+    default:
+        return;
+    }
+    update();
+}
+
+static uint32_t read_reg(uint32_t offset)
+{
+    if (offset != 0x18) {
+        return 0;
+    }
+    uint32_t level = ~(enable & ~out);
+    for (uint8_t pin = 0; pin < GPIO_NUM_16; pin++) {
+        Line& line = lines[pin];
+        if (line.bus == nullptr || ((enable >> pin) & 0x01)) {
+            continue;
+        }
+        if (device_low(line)) {
+            level &= ~(1UL << pin);
+        }
+        if (line.read_pending && line_clock - line.low_since < LINE_WRITE_0_MIN) {
+            line.read_pending = false;
+            if (line_clock - line.low_since > LINE_READ_VALID) {
+                ++line.counters.late_reads;
+            }
+        }
+    }
+    return level;
+}
+
+static void delay(uint32_t us)
+{
+    line_clock += us;
+}
+
+static int64_t timer(void)
+{
+    return static_cast<int64_t>(line_clock);
+}
+
+void attach(gpio_num_t pin, OneWire::SimBus* bus)
+{
+    lines[pin].bus = bus;
+    gpio_host_regs() = GpioHostRegs { write_reg, read_reg };
+    host_clock() = HostClock { delay, timer };
+}
+
+uint64_t now(void)
+{
+    return line_clock;
+}
+
+Statistics& statistics(gpio_num_t pin)
+{
+    return lines[pin].counters;
+}
+
+void reset(void)
+{
+    memset(lines, 0, sizeof(lines));
+    line_clock = 1;
+    out = 0;
+    enable = 0;
+    gpio_host_regs() = GpioHostRegs {};
+    host_clock() = HostClock {};
+}
+
+} // namespace Line_NS
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "driver/gpio.h"
+#include "onewire_sim.h"
+
+// Open drain GPIO lines with simulated devices behind the registers of
+// onewire_fast.h and the gpio level calls. The GPIO backends run on them as
+// they are: every register write is an edge, the width of each low pulse
+// tells a reset from a time slot, and ets_delay_us(), os_delay_us() and
+// vTaskDelay() move the line clock.
+// ============================ Datasheet timing, us ==========================
+#define LINE_RESET_MIN 480 // Shorter low pulses are time slots
+#define LINE_SLOT_MAX 120
+#define LINE_WRITE_1_MAX 15 // Devices sample 15..60 us after the falling edge
+#define LINE_WRITE_0_MIN 60
+#define LINE_READ_VALID 15 // Device data is valid until then
+#define LINE_PRESENCE_WAIT 30 // Release of the reset pulse to presence pulse
+#define LINE_PRESENCE 120
+
+namespace Line_NS {
+
+struct Statistics {
+    uint32_t resets;
+    uint32_t slots;
+    uint32_t shared; // Resets and slots begun by the same write as other lines
+    uint32_t bad_pulses; // Low pulses which are neither a slot nor a reset
+    uint32_t late_reads; // Read slots sampled after LINE_READ_VALID
+};
+
+// Devices of "bus" on "pin", nullptr - only the pull-up resistor
+void attach(gpio_num_t pin, OneWire::SimBus* bus);
+// Line clock, us
+uint64_t now(void);
+Statistics& statistics(gpio_num_t pin);
+// Detach the lines, clear the registers, the clock and the statistics
+void reset(void);
+
+} // namespace Line_NS
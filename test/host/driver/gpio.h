@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../sdk_host.h"
+
+// Pins exist, nothing is driven: tach pulses are fed to the registered
+// interrupt handler by gpio_host_edge(). The registers of onewire_fast.h and
+// the level calls go to hooks a test may install (test/gpio_line.h), without
+// them every pin reads high.
+typedef enum {
+    GPIO_NUM_0 = 0,
+    GPIO_NUM_1,
+    GPIO_NUM_2,
+    GPIO_NUM_3,
+    GPIO_NUM_4,
+    GPIO_NUM_5,
+    GPIO_NUM_6,
+    GPIO_NUM_7,
+    GPIO_NUM_8,
+    GPIO_NUM_9,
+    GPIO_NUM_10,
+    GPIO_NUM_11,
+    GPIO_NUM_12,
+    GPIO_NUM_13,
+    GPIO_NUM_14,
+    GPIO_NUM_15,
+    GPIO_NUM_16,
+    GPIO_NUM_MAX
+} gpio_num_t;
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+    GPIO_MODE_OUTPUT_OD
+} gpio_mode_t;
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0,
+    GPIO_PULLDOWN_ENABLE
+} gpio_pulldown_t;
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE
+} gpio_int_type_t;
+typedef struct {
+    uint32_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+typedef void (*gpio_isr_t)(void*);
+
+// GPIO register block, "offset" from PERIPHS_GPIO_BASEADDR
+struct GpioHostRegs {
+    void (*write)(uint32_t offset, uint32_t value);
+    uint32_t (*read)(uint32_t offset);
+};
+inline GpioHostRegs& gpio_host_regs(void)
+{
+    static GpioHostRegs regs {};
+    return regs;
+}
+struct GpioHostReg {
+    uint32_t offset;
+
+    GpioHostReg& operator=(uint32_t value)
+    {
+        if (gpio_host_regs().write != nullptr) {
+            gpio_host_regs().write(offset, value);
+        }
+        return *this;
+    }
+    operator uint32_t() const
+    {
+        return gpio_host_regs().read != nullptr ? gpio_host_regs().read(offset) : UINT32_MAX;
+    }
+};
+#define ONEWIRE_GPIO_REG(offset) (GpioHostReg { static_cast<uint32_t>(offset) })
+
+inline esp_err_t gpio_config(const gpio_config_t*) { return ESP_OK; }
+inline esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    const bool output = mode == GPIO_MODE_OUTPUT || mode == GPIO_MODE_OUTPUT_OD;
+    ONEWIRE_GPIO_REG(output ? 0x10 : 0x14) = 1UL << pin; // ENABLE_W1TS/W1TC
+    return ESP_OK;
+}
+inline esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    ONEWIRE_GPIO_REG(level ? 0x04 : 0x08) = 1UL << pin; // OUT_W1TS/W1TC
+    return ESP_OK;
+}
+inline int gpio_get_level(gpio_num_t pin) { return (ONEWIRE_GPIO_REG(0x18) >> pin) & 0x01; }
+inline esp_err_t gpio_install_isr_service(int) { return ESP_OK; }
+
+// Handlers of the pins, gpio_host_edge() runs one like the interrupt would
+struct GpioHostIsr {
+    gpio_isr_t handler;
+    void* arg;
+};
+inline GpioHostIsr* gpio_host_isrs(void)
+{
+    static GpioHostIsr isrs[GPIO_NUM_MAX] {};
+    return isrs;
+}
+inline esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t handler, void* arg)
+{
+    gpio_host_isrs()[pin] = GpioHostIsr { handler, arg };
+    return ESP_OK;
+}
+inline esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    gpio_host_isrs()[pin] = GpioHostIsr {};
+    return ESP_OK;
+}
+inline void gpio_host_edge(gpio_num_t pin)
+{
+    const GpioHostIsr& isr = gpio_host_isrs()[pin];
+    if (isr.handler != nullptr) {
+        isr.handler(isr.arg);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../sdk_host.h"
+
+// Configuration is accepted, the duty is only remembered
+typedef enum {
+    LEDC_LOW_SPEED_MODE = 0
+} ledc_mode_t;
+typedef enum {
+    LEDC_TIMER_1_BIT = 1,
+    LEDC_TIMER_8_BIT = 8,
+    LEDC_TIMER_10_BIT = 10,
+    LEDC_TIMER_13_BIT = 13
+} ledc_timer_bit_t;
+typedef enum {
+    LEDC_TIMER_0 = 0,
+    LEDC_TIMER_1,
+    LEDC_TIMER_2,
+    LEDC_TIMER_3
+} ledc_timer_t;
+typedef enum {
+    LEDC_CHANNEL_0 = 0,
+    LEDC_CHANNEL_1,
+    LEDC_CHANNEL_2,
+    LEDC_CHANNEL_3,
+    LEDC_CHANNEL_4,
+    LEDC_CHANNEL_5,
+    LEDC_CHANNEL_6,
+    LEDC_CHANNEL_7,
+    LEDC_CHANNEL_MAX
+} ledc_channel_t;
+typedef enum {
+    LEDC_FADE_NO_WAIT = 0,
+    LEDC_FADE_WAIT_DONE
+} ledc_fade_mode_t;
+typedef struct {
+    ledc_mode_t speed_mode;
+    ledc_timer_bit_t duty_resolution;
+    ledc_timer_t timer_num;
+    uint32_t freq_hz;
+} ledc_timer_config_t;
+typedef struct {
+    int gpio_num;
+    ledc_mode_t speed_mode;
+    ledc_channel_t channel;
+    int intr_type;
+    ledc_timer_t timer_sel;
+    uint32_t duty;
+    int hpoint;
+} ledc_channel_config_t;
+
+inline esp_err_t ledc_timer_config(const ledc_timer_config_t*) { return ESP_OK; }
+inline esp_err_t ledc_channel_config(const ledc_channel_config_t*) { return ESP_OK; }
+inline esp_err_t ledc_fade_func_install(int) { return ESP_OK; }
+
+// Last duty set on every channel, for the tests
+inline uint32_t* ledc_host_duties(void)
+{
+    static uint32_t duties[LEDC_CHANNEL_MAX] {};
+    return duties;
+}
+inline esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t channel, uint32_t duty)
+{
+    ledc_host_duties()[channel] = duty;
+    return ESP_OK;
+}
+inline esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t) { return ESP_OK; }
+inline esp_err_t ledc_set_fade_with_time(ledc_mode_t, ledc_channel_t channel, uint32_t duty, int)
+{
+    ledc_host_duties()[channel] = duty;
+    return ESP_OK;
+}
+inline esp_err_t ledc_fade_start(ledc_mode_t, ledc_channel_t, ledc_fade_mode_t) { return ESP_OK; }
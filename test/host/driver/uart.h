@@ -0,0 +1,49 @@
+#pragma once
+
+#include "../sdk_host.h"
+
+// UART driver API used by the UART 1-Wire backend. It's implemented by the
+// loopback stand-in of the tests (uart_loopback.cpp).
+typedef enum {
+    UART_NUM_0 = 0,
+    UART_NUM_1,
+    UART_NUM_MAX
+} uart_port_t;
+typedef enum {
+    UART_DATA_5_BITS = 0,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS
+} uart_word_length_t;
+typedef enum {
+    UART_PARITY_DISABLE = 0,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD = 3
+} uart_parity_t;
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5,
+    UART_STOP_BITS_2
+} uart_stop_bits_t;
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE = 0
+} uart_hw_flowcontrol_t;
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+} uart_config_t;
+#define UART_FIFO_LEN 128
+
+esp_err_t uart_param_config(uart_port_t uart_num, uart_config_t* uart_conf);
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+    int queue_size, QueueHandle_t* uart_queue, int no_use);
+esp_err_t uart_enable_swap(void);
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate);
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+int uart_write_bytes(uart_port_t uart_num, const char* src, size_t size);
+int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t ticks_to_wait);
@@ -0,0 +1,3 @@
+#pragma once
+
+#include "sdk_host.h"
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+// The part of the ESP8266 RTOS SDK used by the modules under test. Tasks
+// never block on the host: delays return at once and locks always succeed.
+// A test may put its own clock under the delays (test/gpio_line.h).
+// ============================== Errors ======================================
+typedef int32_t esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+#define ESP_ERR_INVALID_MAC 0x10B
+#define ESP_ERROR_CHECK(x) (void)(x)
+inline const char* esp_err_to_name(esp_err_t) { return "ERROR"; }
+
+// ============================== Log =========================================
+#define ESP_LOGE(tag, format, ...) printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) (void)(tag)
+#define ESP_LOGV(tag, format, ...) (void)(tag)
+
+// ============================== Time ========================================
+#define IRAM_ATTR
+// Clock of the delays and esp_timer_get_time(), none - monotonic clock and
+// delays return at once
+struct HostClock {
+    void (*delay)(uint32_t us);
+    int64_t (*now)(void);
+};
+inline HostClock& host_clock(void)
+{
+    static HostClock clock {};
+    return clock;
+}
+inline int64_t esp_timer_get_time(void)
+{
+    if (host_clock().now != nullptr) {
+        return host_clock().now();
+    }
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+inline void ets_delay_us(uint32_t us)
+{
+    if (host_clock().delay != nullptr) {
+        host_clock().delay(us);
+    }
+}
+inline void os_delay_us(uint16_t us) { ets_delay_us(us); }
+
+// ============================== FreeRTOS ====================================
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef void* QueueHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+#define portTICK_PERIOD_MS 10
+#define pdMS_TO_TICKS(ms) (static_cast<TickType_t>(ms) / portTICK_PERIOD_MS)
+#define portMAX_DELAY 0xFFFFFFFFU
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+inline void vTaskDelay(TickType_t ticks) { ets_delay_us(ticks * portTICK_PERIOD_MS * 1000); }
+inline TickType_t xTaskGetTickCount(void) { return 0; }
+inline void taskENTER_CRITICAL(void) { }
+inline void taskEXIT_CRITICAL(void) { }
+#define portENTER_CRITICAL() taskENTER_CRITICAL()
+#define portEXIT_CRITICAL() taskEXIT_CRITICAL()
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex(void) { return reinterpret_cast<SemaphoreHandle_t>(1); }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+inline void vSemaphoreDelete(SemaphoreHandle_t) { }
+
+inline QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) { return nullptr; }
+inline BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t) { return pdFALSE; }
+inline BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t) { return 0; }
+inline void vQueueDelete(QueueHandle_t) { }
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "sdk_host.h"
+
+// Console on UART1, as the UART 1-Wire backend needs it
+#define CONFIG_CONSOLE_UART_CUSTOM 1
+#define CONFIG_CONSOLE_UART_CUSTOM_NUM_1 1
+#define CONFIG_CONSOLE_UART_NUM 1
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks of the host tests. A failed check is printed and counted, main()
+// returns the count, so ctest reports the test as failed.
+namespace Test_NS {
+
+inline int& failures(void)
+{
+    static int count = 0;
+    return count;
+}
+
+inline int result(const char* name)
+{
+    printf("%s: %s, %d failed checks\n", name, failures() ? "FAIL" : "OK", failures());
+    return failures();
+}
+
+} // namespace Test_NS
+
+#define CHECK(condition)                                                   \
+    do {                                                                   \
+        if (!(condition)) {                                                \
+            ++Test_NS::failures();                                         \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+        }                                                                  \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                         \
+    do {                                                                   \
+        const long long _actual = static_cast<long long>(actual);          \
+        const long long _expected = static_cast<long long>(expected);      \
+        if (_actual != _expected) {                                        \
+            ++Test_NS::failures();                                         \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, \
+                #actual, _actual, _expected);                              \
+        }                                                                  \
+    } while (0)
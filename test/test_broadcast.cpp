@@ -0,0 +1,164 @@
+#include "broadcast.h"
+#include "test.h"
+#include <atomic>
+#include <thread>
+
+// Broadcast channel: order and skips of every consumer, sequence wrap and a
+// producer racing two consumers
+using Broadcast_NS::Cursor;
+
+struct Sample {
+    uint32_t seq;
+    uint32_t words[7]; // All derived from "seq", a torn read mixes them
+};
+
+static Sample sample_of(uint32_t seq)
+{
+    Sample sample;
+    sample.seq = seq;
+    for (uint32_t i = 0; i < 7; i++) {
+        sample.words[i] = seq * 2654435761U + i;
+    }
+    return sample;
+}
+
+static bool intact(const Sample& sample)
+{
+    for (uint32_t i = 0; i < 7; i++) {
+        if (sample.words[i] != sample.seq * 2654435761U + i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T, size_t N>
+class TestChannel : public Broadcast_NS::Channel<T, N> {
+public:
+    void start_at(uint32_t seq) { this->_head.store(seq); }
+};
+
+static void test_consumers(void)
+{
+    Broadcast_NS::Channel<uint32_t, 4> channel;
+    Cursor early = channel.subscribe();
+    channel.publish(1);
+    Cursor late = channel.subscribe(); // Sees only what comes after it
+    channel.publish(2);
+
+    uint32_t value = 0;
+    CHECK(channel.read(early, value));
+    CHECK_EQ(value, 1);
+    CHECK(channel.read(late, value));
+    CHECK_EQ(value, 2);
+    CHECK(channel.empty(late));
+    CHECK(!channel.empty(early));
+
+    // Slow consumer skips to the oldest kept value, the other one is not
+    // disturbed
+    for (uint32_t i = 3; i <= 9; i++) {
+        channel.publish(i);
+    }
+    CHECK(channel.read(early, value));
+    CHECK_EQ(value, 6);
+    CHECK_EQ(early.skipped, 4);
+    uint32_t expected = 7;
+    while (channel.read(early, value)) {
+        CHECK_EQ(value, expected++);
+    }
+    CHECK_EQ(expected, 10);
+    CHECK(!channel.read(early, value));
+}
+
+static void test_wrap(void)
+{
+    TestChannel<uint32_t, 8> channel;
+    channel.start_at(UINT32_MAX - 3);
+    Cursor cursor = channel.subscribe();
+    for (uint32_t i = 0; i < 12; i++) {
+        channel.publish(i);
+    }
+    uint32_t value = 0;
+    uint32_t expected = 4;
+    while (channel.read(cursor, value)) {
+        CHECK_EQ(value, expected++);
+    }
+    CHECK_EQ(expected, 12);
+    CHECK_EQ(cursor.skipped, 4);
+}
+
+// Readers never see a torn value and never go back, the producer never
+// waits for them
+static void test_race(void)
+{
+    static Broadcast_NS::Channel<Sample, 16> channel;
+    const uint32_t count = 20000;
+    std::atomic<bool> done { false };
+    std::atomic<uint8_t> started { 0 };
+
+    struct Consumer {
+        Cursor cursor;
+        uint32_t read { 0 };
+        uint32_t torn { 0 };
+        uint32_t backwards { 0 };
+    };
+    Consumer fast;
+    Consumer slow;
+    fast.cursor = channel.subscribe();
+    slow.cursor = channel.subscribe();
+
+    auto consume = [&done, &started](Consumer& consumer, bool lazy) {
+        ++started;
+        Sample sample;
+        uint32_t last = 0;
+        bool first = true;
+        for (;;) {
+            const bool finished = done.load();
+            while (channel.read(consumer.cursor, sample)) {
+                consumer.torn += !intact(sample);
+                consumer.backwards += !first && sample.seq <= last;
+                last = sample.seq;
+                first = false;
+                ++consumer.read;
+                if (lazy) {
+                    std::this_thread::yield();
+                }
+            }
+            if (finished) {
+                return;
+            }
+        }
+    };
+    std::thread fast_thread(consume, std::ref(fast), false);
+    std::thread slow_thread(consume, std::ref(slow), true);
+    while (started.load() < 2) {
+        std::this_thread::yield();
+    }
+    // Now and then the producer lets the consumers catch up
+    for (uint32_t seq = 1; seq <= count; seq++) {
+        channel.publish(sample_of(seq));
+        if (seq % 8 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    done.store(true);
+    fast_thread.join();
+    slow_thread.join();
+
+    printf("Race: fast read %u skipped %u, slow read %u skipped %u of %u\n", fast.read,
+        fast.cursor.skipped, slow.read, slow.cursor.skipped, count);
+    const Consumer* consumers[] = { &fast, &slow };
+    for (const Consumer* consumer : consumers) {
+        CHECK_EQ(consumer->torn, 0);
+        CHECK_EQ(consumer->backwards, 0);
+        CHECK_EQ(consumer->read + consumer->cursor.skipped, count);
+    }
+}
+
+int main(void)
+{
+    test_consumers();
+    test_wrap();
+    test_race();
+    return Test_NS::result("broadcast");
+}
@@ -0,0 +1,133 @@
+#include "gpio.h"
+#include "test.h"
+#include <chrono>
+#include <cstring>
+
+// Dallas/Maxim CRC8 of the 1-Wire layer against the bitwise definition, and
+// cost per byte of the bitwise, nibble table (firmware) and byte table forms
+static uint8_t crc8_bitwise(const uint8_t* data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        uint8_t byte = *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            const uint8_t mix = (crc ^ byte) & 0x01;
+            crc >>= 1;
+            if (mix) {
+                crc ^= 0x8C; // x^8 + x^5 + x^4 + 1, reflected
+            }
+            byte >>= 1;
+        }
+    }
+    return crc;
+}
+
+static uint8_t crc8_table[256];
+static uint8_t crc8_bytewise(const uint8_t* data, uint8_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        crc = crc8_table[crc ^ *data++];
+    }
+    return crc;
+}
+
+static void test_vectors(void)
+{
+    // Example ROM code of the Maxim application note 27
+    const uint8_t rom[8] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2 };
+    CHECK_EQ(OneWire::crc8(rom, 7), 0xA2);
+    CHECK_EQ(OneWire::crc8(rom, 8), 0); // CRC over data and CRC is zero
+    CHECK(OneWire::check_rom(rom));
+
+    uint8_t corrupted[8];
+    memcpy(corrupted, rom, sizeof(rom));
+    corrupted[3] ^= 0x10;
+    CHECK(!OneWire::check_rom(corrupted));
+    const uint8_t shorted[8] = {};
+    CHECK(!OneWire::check_rom(shorted)); // Valid CRC, but no device
+
+    for (uint16_t i = 0; i < 256; i++) {
+        const uint8_t byte = static_cast<uint8_t>(i);
+        crc8_table[i] = crc8_bitwise(&byte, 1);
+        CHECK_EQ(OneWire::crc8(&byte, 1), crc8_table[i]);
+    }
+}
+
+static void test_decode(void)
+{
+    // 12 bit DS18B20 scratchpad, +25.0625 C
+    uint8_t data[9] = { 0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0F, 0x10, 0 };
+    data[8] = OneWire::crc8(data, 8);
+    Temp_NS::q4_t temperature = 0;
+    CHECK_EQ(OneWire::decode_temp(0x28, data, temperature), ESP_OK);
+    CHECK_EQ(temperature, 0x0191);
+
+    // 85 C power on value is not a measurement
+    data[0] = POWER_ON_TEMPERATURE & 0xFF;
+    data[1] = POWER_ON_TEMPERATURE >> 8;
+    CHECK_EQ(OneWire::decode_temp(0x28, data, temperature), ESP_ERR_INVALID_RESPONSE);
+}
+
+// Corrupted scratchpads are retried, the reading never gets a wrong value
+static void test_retry(void)
+{
+    OneWire::DS18B20 bus { 1 };
+    OneWire::VirtualDS18B20& device = bus.sim().device(0);
+    device.temperature = 0x0191;
+    device.faults.bit_flip_rate = 200; // About one of three scratchpads
+
+    uint32_t good = 0;
+    for (uint8_t i = 0; i < 50; i++) {
+        Temp_NS::q4_t temperature = 0;
+        if (bus.get_temp(device.rom, temperature) == ESP_OK) {
+            CHECK_EQ(temperature, 0x0191);
+            ++good;
+        }
+    }
+    printf("Bit flips: %u of 50 readings, %u CRC errors\n", good, bus.get_crc_errors());
+    CHECK(bus.get_crc_errors() > 0);
+    CHECK(good > 40); // Three attempts rarely fail together
+}
+
+typedef uint8_t (*Crc8)(const uint8_t*, uint8_t);
+static double ns_per_byte(Crc8 crc8)
+{
+    static uint8_t data[250];
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    const uint32_t rounds = 20000;
+    volatile uint8_t sink = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; i++) {
+        data[0] = static_cast<uint8_t>(i);
+        sink = sink ^ crc8(data, sizeof(data));
+    }
+    const auto time = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(time).count() / rounds / sizeof(data);
+}
+
+static void benchmark(void)
+{
+    uint8_t data[64];
+    for (uint8_t i = 0; i < sizeof(data); i++) {
+        data[i] = static_cast<uint8_t>(i * 73 + 5);
+    }
+    CHECK_EQ(OneWire::crc8(data, sizeof(data)), crc8_bitwise(data, sizeof(data)));
+    CHECK_EQ(crc8_bytewise(data, sizeof(data)), crc8_bitwise(data, sizeof(data)));
+
+    // Host numbers, only the ratio says something about the target
+    printf("CRC8 per byte: bitwise %.2f ns, nibble tables %.2f ns (32 bytes), "
+           "byte table %.2f ns (256 bytes)\n",
+        ns_per_byte(crc8_bitwise), ns_per_byte(OneWire::crc8), ns_per_byte(crc8_bytewise));
+}
+
+int main(void)
+{
+    test_vectors();
+    test_decode();
+    test_retry();
+    benchmark();
+    return Test_NS::result("crc");
+}
@@ -0,0 +1,198 @@
+#include "curve.h"
+#include "test.h"
+#include <chrono>
+#include <cstdlib>
+
+// Fan curve table against the points it's built from, its text form,
+// hysteresis at a curve point and duty coalescing
+using namespace Control_NS;
+
+// Duty of the points at "temperature", linear between them, 1/100 %
+static int32_t reference(const uint8_t* temperatures, const uint8_t* duties, uint8_t count,
+    Temp_NS::q4_t temperature)
+{
+    if (temperature <= Temp_NS::from_degrees(temperatures[0])) {
+        return duties[0] * 100;
+    }
+    for (uint8_t i = 1; i < count; i++) {
+        const int32_t high = Temp_NS::from_degrees(temperatures[i]);
+        if (temperature <= high) {
+            const int32_t low = Temp_NS::from_degrees(temperatures[i - 1]);
+            return duties[i - 1] * 100 + (duties[i] - duties[i - 1]) * 100 * (temperature - low) / (high - low);
+        }
+    }
+    return duties[count - 1] * 100;
+}
+
+// Every temperature a DS18B20 gives: the table entry is the duty at the
+// start of its 1/4 C step
+static void test_table(void)
+{
+    const uint8_t temperatures[] = { 30, 35, 40, 45, 60 };
+    const uint8_t duties[] = { 10, 30, 60, 100, 40 };
+    Curve curve;
+    CHECK(curve.empty());
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(50)), 0);
+    CHECK_EQ(curve.set_points(temperatures, duties, 5), ESP_OK);
+    CHECK(!curve.empty());
+
+    const int32_t step = 1 << CURVE_STEP_SHIFT;
+    for (Temp_NS::q4_t temperature = -55 * 16; temperature <= 125 * 16; temperature++) {
+        const int32_t start = temperature - (temperature - Temp_NS::from_degrees(30)) % step;
+        const int32_t expected = temperature < Temp_NS::from_degrees(30)
+            ? reference(temperatures, duties, 5, temperature)
+            : reference(temperatures, duties, 5, static_cast<Temp_NS::q4_t>(start));
+        CHECK_EQ(curve.duty(temperature), expected);
+    }
+    // The points themselves are exact
+    for (uint8_t i = 0; i < 5; i++) {
+        CHECK_EQ(curve.duty(Temp_NS::from_degrees(temperatures[i])), duties[i] * 100);
+    }
+
+    // 64 C from the first point fills the table
+    const uint8_t wide[] = { 20, 83 };
+    const uint8_t too_wide[] = { 20, 84 };
+    const uint8_t ramp[] = { 0, 100 };
+    CHECK_EQ(curve.set_points(wide, ramp, 2), ESP_OK);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(83)), CURVE_DUTY_MAX);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(100)), CURVE_DUTY_MAX);
+    CHECK_EQ(curve.set_points(too_wide, ramp, 2), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(83)), CURVE_DUTY_MAX); // Kept
+
+    // One point is a constant duty
+    const uint8_t single[] = { 40 };
+    const uint8_t half[] = { 50 };
+    CHECK_EQ(curve.set_points(single, half, 1), ESP_OK);
+    CHECK_EQ(curve.duty(0), 5000);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(90)), 5000);
+    curve.clear();
+    CHECK(curve.empty());
+
+    // Lookup cost of the control pass
+    CHECK_EQ(curve.set_points(temperatures, duties, 5), ESP_OK);
+    const uint32_t lookups = 10000000;
+    uint32_t sum = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < lookups; i++) {
+        sum += curve.duty(static_cast<Temp_NS::q4_t>(400 + i % 800));
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("lookup: %.2f ns (sum %u)\n", seconds * 1e9 / lookups, sum);
+}
+
+static void test_parse(void)
+{
+    Curve curve;
+    CHECK_EQ(curve.parse("30:0,35:30,40:60,45:100"), ESP_OK);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(35)), 3000);
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(42) + 8), 8000);
+    CHECK_EQ(curve.parse("0:100"), ESP_OK);
+    CHECK_EQ(curve.parse("1:1,2:2,3:3,4:4,5:5,6:6,7:7,8:8"), ESP_OK);
+
+    const char* bad[] = {
+        "",                                   // No points
+        "1:1,2:2,3:3,4:4,5:5,6:6,7:7,8:8,9:9", // Too many
+        "30:0,30:50",                         // Not rising
+        "40:0,30:50",
+        "30:101",                             // Out of range
+        "126:50",
+        "-1:50",
+        "30:-5",
+        "30",                                 // Broken
+        "30:",
+        ":50",
+        "30:50,",
+        "30:50;40:60",
+        "30:50,40",
+        "a:b",
+    };
+    for (const char* text : bad) {
+        const esp_err_t ret = curve.parse(text);
+        CHECK(ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_INVALID_SIZE);
+        if (ret == ESP_OK) {
+            printf("Accepted \"%s\"\n", text);
+        }
+    }
+    // A rejected curve leaves the last one
+    CHECK_EQ(curve.duty(Temp_NS::from_degrees(5)), 500);
+}
+
+// Drive sitting on a curve point with a step of noise: the held value
+// doesn't follow the noise, real changes pass the band
+static void test_hysteresis(void)
+{
+    Curve curve;
+    CHECK_EQ(curve.parse("30:0,35:30,40:60,45:100"), ESP_OK);
+    Hysteresis hysteresis(5, 10);
+    srand(21);
+    uint32_t raw_changes = 0;
+    uint32_t held_changes = 0;
+    uint16_t raw_last = 0;
+    uint16_t held_last = 0;
+    const Temp_NS::q4_t point = Temp_NS::from_degrees(40);
+    for (uint32_t i = 0; i < 1000; i++) {
+        const Temp_NS::q4_t reading = static_cast<Temp_NS::q4_t>(point + rand() % 3 - 1);
+        const uint16_t raw = curve.duty(reading);
+        const uint16_t held = curve.duty(hysteresis.update(reading));
+        raw_changes += i && raw != raw_last;
+        held_changes += i && held != held_last;
+        raw_last = raw;
+        held_last = held;
+    }
+    printf("noise at a point: %u duty changes, %u with hysteresis\n", raw_changes, held_changes);
+    CHECK(raw_changes > 300);
+    CHECK_EQ(held_changes, 0);
+
+    hysteresis.reset();
+    CHECK_EQ(hysteresis.update(point), point);
+    CHECK_EQ(hysteresis.update(point + 5), point); // Band is inclusive
+    CHECK_EQ(hysteresis.update(point + 6), point + 6);
+    CHECK_EQ(hysteresis.update(point - 4), point + 6);
+    CHECK_EQ(hysteresis.update(point - 5), point - 5);
+    hysteresis.set_bands(0, 0);
+    CHECK_EQ(hysteresis.update(point - 4), point - 4);
+    CHECK_EQ(hysteresis.value(), point - 4);
+}
+
+// Small steps wait until they add up, off and full duty are never held back
+static void test_coalesce(void)
+{
+    const uint32_t max_duty = 1024;
+    const uint32_t step = 20; // 2 %
+    actuation_stats = ActuationStats {};
+    CHECK(!actuate(500, 500, step, max_duty));
+    CHECK_EQ(actuation_stats.unchanged, 1);
+    CHECK(!actuate(519, 500, step, max_duty));
+    CHECK(!actuate(481, 500, step, max_duty));
+    CHECK_EQ(actuation_stats.coalesced, 2);
+    CHECK(actuate(520, 500, step, max_duty));
+    CHECK(actuate(480, 500, step, max_duty));
+    CHECK(actuate(0, 10, step, max_duty));
+    CHECK(actuate(max_duty, max_duty - 1, step, max_duty));
+    CHECK(actuate(501, 500, 0, max_duty));
+    CHECK_EQ(actuation_stats.unchanged, 1);
+    CHECK_EQ(actuation_stats.coalesced, 2);
+
+    // A slow ramp by one unit per pass writes every step-th duty
+    actuation_stats = ActuationStats {};
+    uint32_t last = 0;
+    uint32_t writes = 0;
+    for (uint32_t duty = 1; duty <= max_duty; duty++) {
+        if (actuate(duty, last, step, max_duty)) {
+            last = duty;
+            ++writes;
+        }
+    }
+    CHECK_EQ(last, max_duty);
+    CHECK_EQ(writes, max_duty / step + 1);
+    CHECK_EQ(actuation_stats.coalesced, max_duty - writes);
+}
+
+int main(void)
+{
+    test_table();
+    test_parse();
+    test_hysteresis();
+    test_coalesce();
+    return Test_NS::result("test_curve");
+}
@@ -0,0 +1,98 @@
+#include "estimator.h"
+#include "filters.h"
+#include "test.h"
+#include <cstdlib>
+
+// Replay of a drive heating under a scrub: the predictive estimator against
+// the trimmed mean the fan followed before
+using Filter_NS::TrendKalman;
+
+static const uint32_t INTERVAL = KALMAN_NOMINAL_INTERVAL; // ms
+static const uint32_t HORIZON = 60; // s
+static const Temp_NS::q4_t THRESHOLD = 40 * 16;
+
+// Drive at 35 C, heats 1 C per minute from 5 to 15 minutes, then stays at
+// 45 C. Readings are DS18B20 steps with one step of noise.
+static double trace(double seconds)
+{
+    if (seconds < 300) {
+        return 35.0;
+    }
+    if (seconds < 900) {
+        return 35.0 + (seconds - 300) / 60.0;
+    }
+    return 45.0;
+}
+
+static Temp_NS::q4_t reading(double seconds)
+{
+    return static_cast<Temp_NS::q4_t>(trace(seconds) * 16 + rand() % 3 - 1);
+}
+
+static void test_replay(void)
+{
+    srand(12);
+    TrendKalman estimator;
+    Filter_NS::TrimmedMean<6, 1, Temp_NS::q4_t, int32_t> average;
+    double estimate_crossed = 0;
+    double average_crossed = 0;
+    int32_t steady_error = 0;
+    int32_t heating_rate = 0;
+
+    for (uint32_t n = 0; n < 1200 * 1000 / INTERVAL; n++) {
+        const double seconds = n * INTERVAL / 1000.0;
+        const Temp_NS::q4_t measured = reading(seconds);
+        estimator.update(measured, INTERVAL);
+        average.push(measured);
+        const Temp_NS::q4_t estimate = estimator.predict(HORIZON);
+
+        if (estimate_crossed == 0 && estimate >= THRESHOLD) {
+            estimate_crossed = seconds;
+        }
+        if (average_crossed == 0 && average.value() >= THRESHOLD) {
+            average_crossed = seconds;
+        }
+        if (seconds > 800 && seconds < 880) {
+            heating_rate = estimator.rate();
+        }
+        if (seconds > 1150) {
+            const int32_t error = estimate - 45 * 16;
+            steady_error = error < 0 ? -error : error;
+        }
+    }
+
+    // 40 C is reached at 10 minutes
+    printf("40 C: trimmed mean at %.0f s, %u s prediction at %.0f s, %.1f s ahead\n",
+        average_crossed, HORIZON, estimate_crossed, average_crossed - estimate_crossed);
+    CHECK(average_crossed >= 600);
+    CHECK(estimate_crossed < 600);
+    CHECK(average_crossed - estimate_crossed > HORIZON / 2);
+
+    // Rate is found while heating, prediction settles on the plateau
+    const int32_t expected = (1L << TrendKalman::RATE_SHIFT) / 60;
+    printf("Rate while heating %d / 65536 C/s, expected %d\n", heating_rate, expected);
+    CHECK(heating_rate > expected * 8 / 10 && heating_rate < expected * 12 / 10);
+    CHECK(steady_error <= 4); // 0.25 C
+}
+
+static void test_restart(void)
+{
+    TrendKalman estimator;
+    CHECK(!estimator.initialized());
+    CHECK_EQ(estimator.update(500, INTERVAL), 500); // First reading is taken as is
+    for (uint8_t i = 0; i < 50; i++) {
+        estimator.update(static_cast<Temp_NS::q4_t>(500 + i), INTERVAL);
+    }
+    CHECK(estimator.rate() > 0);
+    // Long pause restarts the filter, the old rate is gone
+    CHECK_EQ(estimator.update(300, KALMAN_MAX_INTERVAL + 1), 300);
+    CHECK_EQ(estimator.rate(), 0);
+    CHECK_EQ(estimator.predict(HORIZON), 300);
+}
+
+int main(void)
+{
+    test_replay();
+    test_restart();
+    return Test_NS::result("estimator");
+}
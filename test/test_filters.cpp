@@ -0,0 +1,209 @@
+#include "filters.h"
+#include "temperature.h"
+#include "test.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+// Streaming filters against sorting the window on every sample, the way the
+// median of 3 and the trimmed mean used to be computed
+using namespace Filter_NS;
+
+// Sorted copy of the last "size" of "history"
+template <size_t N>
+static size_t window(const int16_t* history, size_t count, int16_t (&sorted)[N])
+{
+    const size_t size = count < N ? count : N;
+    std::copy(history + count - size, history + count, sorted);
+    std::sort(sorted, sorted + size);
+    return size;
+}
+
+static void test_ring(void)
+{
+    RingBuffer<int, 3> ring;
+    CHECK_EQ(ring.push(1), 0);
+    CHECK_EQ(ring.push(2), 0);
+    CHECK(!ring.full());
+    CHECK_EQ(ring.push(3), 0);
+    CHECK(ring.full());
+    CHECK_EQ(ring.push(4), 1); // Oldest is pushed out
+    CHECK_EQ(ring.oldest(), 2);
+    CHECK_EQ(ring.newest(), 4);
+    CHECK_EQ(ring[1], 3);
+    ring.clear();
+    CHECK_EQ(ring.size(), 0);
+}
+
+template <size_t N>
+static void check_window(uint32_t seed, int16_t spread)
+{
+    srand(seed);
+    SortedWindow<int16_t, N> filter;
+    int16_t history[1000];
+    for (size_t i = 0; i < 1000; i++) {
+        history[i] = static_cast<int16_t>(rand() % spread - spread / 2);
+        filter.push(history[i]);
+        int16_t sorted[N];
+        const size_t size = window(history, i + 1, sorted);
+        CHECK_EQ(filter.size(), size);
+        for (size_t j = 0; j < size; j++) {
+            CHECK_EQ(filter.sorted(j), sorted[j]);
+        }
+    }
+}
+
+static void test_sorted_window(void)
+{
+    check_window<3>(2, 4); // Many equal values
+    check_window<3>(3, 1000);
+    check_window<6>(4, 30);
+    check_window<31>(5, 1000);
+}
+
+static void test_median(void)
+{
+    MedianFilter<3, Temp_NS::q4_t> median;
+    CHECK_EQ(median.value(), 0);
+    CHECK_EQ(median.push(400), 400);
+    CHECK_EQ(median.push(410), 405); // Mean of the two middle values
+    CHECK_EQ(median.push(1360), 410); // 85 C spike is dropped
+    CHECK_EQ(median.push(405), 410);
+    CHECK_EQ(median.push(402), 405);
+
+    // Same as the median of the sorted last three
+    srand(6);
+    int16_t history[500];
+    MedianFilter<3, Temp_NS::q4_t> filter;
+    for (size_t i = 0; i < 500; i++) {
+        history[i] = static_cast<int16_t>(400 + rand() % 64);
+        const Temp_NS::q4_t value = filter.push(history[i]);
+        if (i >= 2) {
+            int16_t sorted[3];
+            window(history, i + 1, sorted);
+            CHECK_EQ(value, sorted[1]);
+        }
+    }
+}
+
+static void test_trimmed_mean(void)
+{
+    // Trimmed mean of 6 without the smallest and the largest
+    srand(7);
+    int16_t history[500];
+    TrimmedMean<6, 1, Temp_NS::q4_t, int32_t> filter;
+    for (size_t i = 0; i < 500; i++) {
+        history[i] = static_cast<int16_t>(300 + rand() % 400);
+        filter.push(history[i]);
+        int16_t sorted[6];
+        const size_t size = window(history, i + 1, sorted);
+        int32_t sum = 0;
+        const size_t trim = size > 2 ? 1 : 0;
+        for (size_t j = trim; j < size - trim; j++) {
+            sum += sorted[j];
+        }
+        CHECK_EQ(filter.value(), sum / static_cast<int32_t>(size - 2 * trim));
+    }
+
+    // Float sums are recounted, rounding doesn't accumulate
+    TrimmedMean<4, 0> mean;
+    for (uint32_t i = 0; i < 100000; i++) {
+        mean.push(i % 2 ? 0.1f : 1000.3f);
+    }
+    CHECK(mean.value() > 500.19f && mean.value() < 500.21f);
+}
+
+// Fixed point average against the same one in double, and it settles on a
+// steady input where whole units would stop Den / Num short of it
+template <uint16_t Num, uint16_t Den>
+static void check_ema(uint32_t seed)
+{
+    srand(seed);
+    Ema<Num, Den, Temp_NS::q4_t> fixed;
+    Ema<Num, Den, double> reference;
+    CHECK(!fixed.initialized());
+    // Rounding to whole units plus the rounded steps piling up in the fraction
+    const double slack = 0.5 + Den / (2.0 * Num) / (1 << EMA_FRACTION_BITS);
+    for (size_t i = 0; i < 5000; i++) {
+        // Noisy steps between -55 C and 125 C
+        const Temp_NS::q4_t value = static_cast<Temp_NS::q4_t>(
+            (i / 500 % 2 ? 1200 : -400) + rand() % 161 - 80);
+        const Temp_NS::q4_t average = fixed.push(value);
+        const double expected = reference.push(value);
+        CHECK(average >= expected - slack && average <= expected + slack);
+    }
+    for (size_t i = 0; i < 100 * Den / Num; i++) {
+        fixed.push(-0x00A2);
+    }
+    CHECK_EQ(fixed.value(), -0x00A2);
+    for (size_t i = 0; i < 100 * Den / Num; i++) {
+        fixed.push(2000);
+    }
+    CHECK_EQ(fixed.value(), 2000);
+    fixed.clear();
+    CHECK_EQ(fixed.push(400), 400); // First value initializes
+}
+
+static void test_ema(void)
+{
+    check_ema<1, 1>(9);
+    check_ema<1, 4>(10);
+    check_ema<1, 16>(11);
+    check_ema<3, 100>(12);
+    check_ema<1, 1000>(13);
+
+    Ema<1, 2> mean;
+    CHECK_EQ(mean.push(10.0f), 10.0f);
+    CHECK_EQ(mean.push(20.0f), 15.0f);
+}
+
+// Push cost of the sorted window against sorting a copy of the ring
+template <size_t N>
+static void benchmark(void)
+{
+    const size_t samples = 200000;
+    static int16_t values[samples];
+    srand(8);
+    for (size_t i = 0; i < samples; i++) {
+        values[i] = static_cast<int16_t>(rand() % 1600);
+    }
+
+    volatile int32_t sink = 0;
+    SortedWindow<int16_t, N> filter;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples; i++) {
+        filter.push(values[i]);
+        sink = sink + filter.sorted(filter.size() / 2);
+    }
+    const double streaming = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / samples;
+
+    RingBuffer<int16_t, N> ring;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples; i++) {
+        ring.push(values[i]);
+        int16_t sorted[N];
+        for (size_t j = 0; j < ring.size(); j++) {
+            sorted[j] = ring[j];
+        }
+        std::sort(sorted, sorted + ring.size());
+        sink = sink + sorted[ring.size() / 2];
+    }
+    const double sorting = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / samples;
+    printf("Window of %2zu: sorted window %.1f ns, sort per sample %.1f ns\n", N, streaming,
+        sorting);
+}
+
+int main(void)
+{
+    test_ring();
+    test_sorted_window();
+    test_median();
+    test_trimmed_mean();
+    test_ema();
+    benchmark<3>();
+    benchmark<6>();
+    benchmark<31>();
+    return Test_NS::result("filters");
+}
@@ -0,0 +1,146 @@
+#include "gpio.h"
+#include "gpio_line.h"
+#include "test.h"
+#include <cstring>
+
+// GPIO backend on a simulated line: the slot code of the firmware, FastPin
+// registers or with ONEWIRE_FAST_GPIO=0 the gpio driver calls, drives the
+// virtual devices edge by edge on the clock of its own delays
+using OneWire::DS18B20;
+using OneWire::SimBus;
+
+static const gpio_num_t PIN = ONEWIRE_GPIO_PIN;
+
+// Every low pulse was a reset or a time slot, every read slot was sampled
+// while the device data was valid
+static void check_timing(void)
+{
+    const Line_NS::Statistics& line = Line_NS::statistics(PIN);
+    CHECK_EQ(line.bad_pulses, 0);
+    CHECK_EQ(line.late_reads, 0);
+}
+
+static void test_reset(void)
+{
+    Line_NS::reset();
+    SimBus empty { 0 };
+    Line_NS::attach(PIN, &empty);
+    DS18B20 bus { PIN };
+    CHECK_EQ(bus.reset(), ESP_ERR_TIMEOUT);
+
+    SimBus devices { 2 };
+    Line_NS::attach(PIN, &devices);
+    CHECK_EQ(bus.reset(), ESP_OK);
+    devices.device(0).faults.no_presence = true;
+    CHECK_EQ(bus.reset(), ESP_OK); // One device is enough
+    devices.device(1).faults.no_presence = true;
+    CHECK_EQ(bus.reset(), ESP_ERR_TIMEOUT);
+    CHECK_EQ(Line_NS::statistics(PIN).resets, 4);
+    CHECK_EQ(Line_NS::statistics(PIN).slots, 0);
+    check_timing();
+}
+
+// Byte is 8 slots of the datasheet length
+static void test_slots(void)
+{
+    Line_NS::reset();
+    SimBus devices { 1 };
+    Line_NS::attach(PIN, &devices);
+    DS18B20 bus { PIN };
+    CHECK_EQ(bus.reset(), ESP_OK);
+
+    uint64_t start = Line_NS::now();
+    bus.write_byte(READ_ROM);
+    const uint64_t write = Line_NS::now() - start;
+    CHECK_EQ(write, BUS_RECOVERY_DURATION + 8 * (PAUSE_BETWEEN_TIME_SLOTS + MASTER_WRITE_0_PULSE_DURATION + MASTER_WRITE_0_RECOVERY_DURATION));
+    uint8_t rom[8];
+    start = Line_NS::now();
+    for (uint8_t i = 0; i < sizeof(rom); i++) {
+        rom[i] = bus.read_byte();
+    }
+    const uint64_t read = Line_NS::now() - start;
+    CHECK_EQ(read, 8 * 8 * (BUS_RECOVERY_DURATION + MASTER_READ_PULSE_DURATION + MASTER_READ_SAMPLE + MASTER_READ_RECOVERY_DURATION));
+    CHECK_EQ(memcmp(rom, devices.device(0).rom, sizeof(rom)), 0);
+    CHECK_EQ(Line_NS::statistics(PIN).slots, 8 + 64);
+    CHECK_EQ(Line_NS::statistics(PIN).shared, 0);
+    check_timing();
+    printf("Slots, us: write byte %llu, read byte %llu\n", static_cast<unsigned long long>(write),
+        static_cast<unsigned long long>(read / 8));
+}
+
+static void test_search(void)
+{
+    Line_NS::reset();
+    SimBus devices { SIM_MAX_DEVICES };
+    Line_NS::attach(PIN, &devices);
+    DS18B20 bus { PIN };
+    uint8_t addresses[SIM_MAX_DEVICES][8];
+    uint8_t count = 0;
+    CHECK_EQ(bus.search_rom(addresses, SIM_MAX_DEVICES, count), ESP_OK);
+    CHECK_EQ(count, SIM_MAX_DEVICES);
+    uint32_t found = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        for (uint8_t device = 0; device < devices.count(); device++) {
+            if (memcmp(addresses[i], devices.device(device).rom, 8) == 0) {
+                found |= 1UL << device;
+            }
+        }
+    }
+    CHECK_EQ(found, (1UL << SIM_MAX_DEVICES) - 1); // Every device once
+    check_timing();
+}
+
+// Conversion timed by esp_timer_get_time() on the line clock, the devices
+// hold read slots low until they are done
+static void test_conversion(void)
+{
+    Line_NS::reset();
+    SimBus devices { 2 };
+    Line_NS::attach(PIN, &devices);
+    OneWire::VirtualDS18B20& device = devices.device(0);
+    device.temperature = 0x0198; // 25.5 C
+    devices.device(1).temperature = -0x00A2; // -10.125 C
+    DS18B20 bus { PIN };
+
+    CHECK_EQ(bus.convert_all(), ESP_OK);
+    CHECK(bus.poll_conversion() == OneWire::conversion_state::CONVERTING);
+    CHECK_EQ(bus.wait_for_conversion(), ESP_OK);
+    uint32_t latency = bus.get_conversion_latency();
+    CHECK(latency >= DS18B20::conversion_time(12));
+    CHECK(latency < DS18B20::conversion_time(12) + CONVERSION_POLL_INTERVAL * 1000 + 1000);
+    Temp_NS::q4_t temperature = 0;
+    CHECK_EQ(bus.read_temp(device.rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, 0x0198);
+    CHECK_EQ(bus.read_temp(devices.device(1).rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, -0x00A2);
+
+    // 9 bits: 93.75 ms, the value is rounded to 0.5 C
+    CHECK_EQ(bus.set_resolution(device.rom, 9), ESP_OK);
+    CHECK_EQ(bus.set_resolution(devices.device(1).rom, 9), ESP_OK);
+    CHECK_EQ(device.eeprom[2], 0x1F);
+    device.temperature = 0x019F;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, 0x0198);
+    latency = bus.get_conversion_latency();
+    CHECK(latency >= DS18B20::conversion_time(9));
+    CHECK(latency < DS18B20::conversion_time(9) + CONVERSION_POLL_INTERVAL * 1000 + 1000);
+
+    // Slow device runs into the timeout
+    device.faults.conversion_slowdown = 2;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_ERR_TIMEOUT);
+    check_timing();
+}
+
+int main(void)
+{
+    test_reset();
+    test_slots();
+    test_search();
+    test_conversion();
+    Line_NS::reset();
+#if ONEWIRE_FAST_GPIO
+    return Test_NS::result("gpio");
+#else
+    return Test_NS::result("gpio driver");
+#endif
+}
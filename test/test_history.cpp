@@ -0,0 +1,182 @@
+#include "history.h"
+#include "test.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Varint/zig-zag codec, raw blocks and rollups of the history store, and
+// how much RAM an hour of data takes
+using namespace History_NS;
+
+static const uint32_t SAMPLE_PERIOD = 6; // s, one median of three sweeps
+
+static Store store; // Too big for the stack
+
+static void test_codec(void)
+{
+    const int32_t values[] = { 0, 1, -1, 63, -64, 64, 8191, -8192, INT16_MAX, INT16_MIN,
+        INT32_MAX, INT32_MIN };
+    for (int32_t value : values) {
+        CHECK_EQ(zigzag_decode(zigzag_encode(value)), value);
+        uint8_t buffer[VARINT_MAX_SIZE];
+        const size_t size = varint_write(buffer, zigzag_encode(value));
+        uint32_t decoded = 0;
+        CHECK_EQ(varint_read(buffer, buffer + size, decoded), size);
+        CHECK_EQ(zigzag_decode(decoded), value);
+        // Cut value is not read
+        CHECK_EQ(varint_read(buffer, buffer + size - 1, decoded), 0);
+    }
+    // Small steps of both signs take one byte
+    CHECK_EQ(zigzag_encode(-1), 1);
+    CHECK_EQ(zigzag_encode(1), 2);
+    uint8_t buffer[VARINT_MAX_SIZE];
+    CHECK_EQ(varint_write(buffer, zigzag_encode(-64)), 1);
+    CHECK_EQ(varint_write(buffer, zigzag_encode(64)), 2);
+    CHECK_EQ(varint_write(buffer, UINT32_MAX), VARINT_MAX_SIZE);
+}
+
+struct Collected {
+    Point points[2048];
+    uint32_t count;
+};
+
+static bool collect(const Point& point, void* context)
+{
+    Collected& collected = *static_cast<Collected*>(context);
+    if (collected.count < 2048) {
+        collected.points[collected.count++] = point;
+    }
+    return true;
+}
+
+// Drive temperature, a slow wave with DS18B20 steps of noise
+static int16_t temperature_at(uint32_t time)
+{
+    return static_cast<int16_t>(600 + 40 * ((time / 300) % 2 ? 1 : -1) + rand() % 3 - 1);
+}
+
+// Raw points come back exactly, the newest ones are kept
+static void test_raw(void)
+{
+    srand(18);
+    static Point appended[4000];
+    uint32_t count = 0;
+    for (uint32_t time = 100; count < 4000; time += SAMPLE_PERIOD + (count % 10 == 0)) {
+        appended[count] = Point { time, temperature_at(time) };
+        CHECK_EQ(store.append(0, time, appended[count].value), ESP_OK);
+        ++count;
+    }
+    CHECK_EQ(store.point_count(0), count);
+    CHECK_EQ(store.append(0, 50, 0), ESP_ERR_INVALID_ARG); // Older than the last
+    CHECK_EQ(store.append(SERIES_COUNT, 50, 0), ESP_ERR_INVALID_ARG);
+
+    static Collected collected;
+    collected.count = 0;
+    CHECK_EQ(store.for_each_point(0, 0, collect, &collected), ESP_OK);
+    CHECK(collected.count > 0);
+    const uint32_t kept = collected.count;
+    const Point* first = appended + count - kept;
+    for (uint32_t i = 0; i < kept; i++) {
+        CHECK_EQ(collected.points[i].time, first[i].time);
+        CHECK_EQ(collected.points[i].value, first[i].value);
+    }
+
+    // "since" skips older points
+    const uint32_t since = appended[count - 10].time;
+    collected.count = 0;
+    store.for_each_point(0, since, collect, &collected);
+    CHECK_EQ(collected.count, 10);
+
+    // Footprint of the raw tier
+    const size_t bytes = store.raw_bytes(0);
+    const double minutes = (appended[count - 1].time - first[0].time) / 60.0;
+    const double bytes_per_point = static_cast<double>(bytes) / kept;
+    printf("Raw: %u points of %u kept in %zu bytes, %.2f bytes per point, %.1f minutes\n",
+        kept, count, bytes, bytes_per_point, minutes);
+    CHECK(bytes_per_point < 2.5);
+    printf("Store: %zu bytes for %u series, %.0f bytes per series and hour at one point "
+           "in %u s\n",
+        sizeof(Store), SERIES_COUNT, bytes_per_point * 3600 / SAMPLE_PERIOD, SAMPLE_PERIOD);
+}
+
+struct Rollups {
+    uint32_t start[128];
+    Rollup rollup[128];
+    uint32_t count;
+};
+
+static bool collect_rollup(uint32_t start, const Rollup& rollup, void* context)
+{
+    Rollups& rollups = *static_cast<Rollups*>(context);
+    rollups.start[rollups.count] = start;
+    rollups.rollup[rollups.count++] = rollup;
+    return true;
+}
+
+static void test_rollups(void)
+{
+    // Minute 0: 10, 20, 30. Minute 1 has no points. Minute 2: -5 once.
+    store.append(1, 0, 10);
+    store.append(1, 20, 20);
+    store.append(1, 59, 30);
+    store.append(1, 130, -5);
+
+    static Rollups rollups;
+    rollups.count = 0;
+    CHECK_EQ(store.for_each_rollup(1, Tier::MINUTE, collect_rollup, &rollups), ESP_OK);
+    CHECK_EQ(rollups.count, 2); // Empty minute is left out
+    CHECK_EQ(rollups.start[0], 0);
+    CHECK_EQ(rollups.rollup[0].min, 10);
+    CHECK_EQ(rollups.rollup[0].max, 30);
+    CHECK_EQ(rollups.rollup[0].avg, 20);
+    CHECK_EQ(rollups.start[1], 120); // Current minute comes last
+    CHECK_EQ(rollups.rollup[1].avg, -5);
+
+    rollups.count = 0;
+    store.for_each_rollup(1, Tier::QUARTER, collect_rollup, &rollups);
+    CHECK_EQ(rollups.count, 1);
+    CHECK_EQ(rollups.rollup[0].min, -5);
+    CHECK_EQ(rollups.rollup[0].max, 30);
+    CHECK_EQ(rollups.rollup[0].avg, 13); // 55 / 4
+
+    // The ring keeps MINUTE_ROLLUPS periods with the current one
+    for (uint32_t minute = 3; minute < 3 + 2 * MINUTE_ROLLUPS; minute++) {
+        store.append(1, minute * 60, static_cast<int16_t>(minute));
+    }
+    rollups.count = 0;
+    store.for_each_rollup(1, Tier::MINUTE, collect_rollup, &rollups);
+    CHECK_EQ(rollups.count, MINUTE_ROLLUPS);
+    CHECK_EQ(rollups.rollup[rollups.count - 1].avg, 2 + 2 * MINUTE_ROLLUPS);
+    CHECK_EQ(rollups.rollup[0].avg, 3 + MINUTE_ROLLUPS);
+}
+
+static bool append_text(const char* text, size_t length, void* context)
+{
+    static_cast<std::string*>(context)->append(text, length);
+    return true;
+}
+
+static void test_json(void)
+{
+    store.append(SERIES_DUTY, 10, 40);
+    store.append(SERIES_DUTY, 16, 45);
+    store.append(2, 10, 0x0191);
+
+    std::string duty;
+    CHECK_EQ(write_points_json(store, SERIES_DUTY, 0, append_text, &duty), ESP_OK);
+    CHECK(duty.find("\"series\":8") != std::string::npos);
+    CHECK(duty.find("\"points\":[[10,40],[16,45]]") != std::string::npos);
+
+    std::string temperature;
+    write_points_json(store, 2, 0, append_text, &temperature);
+    CHECK(temperature.find("[[10,25.06]]") != std::string::npos);
+}
+
+int main(void)
+{
+    test_codec();
+    test_raw();
+    test_rollups();
+    test_json();
+    return Test_NS::result("history");
+}
@@ -0,0 +1,228 @@
+#include "onewire_multi.h"
+#include "test.h"
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_GPIO
+#include "gpio_line.h"
+#endif
+
+// Parallel buses with one device each. The SIM build runs the bus protocol
+// on the simulated buses, the GPIO build runs the register mask slots on
+// simulated lines.
+using OneWire::MultiBus;
+
+static const uint8_t BUSES = ONEWIRE_MAX_BUSES;
+
+#if ONEWIRE_BACKEND == ONEWIRE_BACKEND_SIM
+
+static void test_read(void)
+{
+    MultiBus buses { BUSES };
+    for (uint8_t i = 0; i < BUSES; i++) {
+        buses.sim(i).device(0).temperature = static_cast<int16_t>(30 * 16 + i);
+    }
+
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    esp_err_t results[BUSES] = {};
+    CHECK_EQ(buses.get_temps(temperatures, results), ESP_OK);
+    // Every bus ran the same transaction. Whether their slots share the
+    // time is up to the GPIO masks, test_interleaving() checks that.
+    for (uint8_t i = 0; i < BUSES; i++) {
+        CHECK_EQ(results[i], ESP_OK);
+        CHECK_EQ(temperatures[i], 30 * 16 + i);
+        CHECK_EQ(buses.sim(i).slots(), buses.sim(0).slots());
+        CHECK_EQ(buses.sim(i).resets(), buses.sim(0).resets());
+    }
+    CHECK(buses.get_conversion_latency() >= OneWire::DS18B20::conversion_time(MAX_RESOLUTION));
+}
+
+// A broken bus fails alone
+static void test_faults(void)
+{
+    MultiBus buses { BUSES };
+    buses.sim(1).device(0).faults.no_presence = true;
+    buses.sim(2).device(0).faults.conversion_slowdown = 2;
+
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    esp_err_t results[BUSES] = {};
+    CHECK(buses.get_temps(temperatures, results) != ESP_OK);
+    CHECK_EQ(results[0], ESP_OK);
+    CHECK_EQ(results[1], ESP_ERR_NOT_FOUND);
+    CHECK_EQ(results[2], ESP_ERR_TIMEOUT);
+    CHECK_EQ(results[3], ESP_OK);
+    CHECK_EQ(temperatures[3], SIM_DEFAULT_TEMPERATURE);
+
+    // Corrupted scratchpads are read again on their bus only
+    MultiBus noisy { BUSES };
+    noisy.sim(3).device(0).faults.bit_flip_rate = 100;
+    uint32_t good = 0;
+    for (uint8_t n = 0; n < 20; n++) {
+        CHECK(noisy.get_temps(temperatures, results) == ESP_OK || results[3] != ESP_OK);
+        CHECK_EQ(results[0], ESP_OK);
+        good += results[3] == ESP_OK;
+        if (results[3] == ESP_OK) {
+            CHECK_EQ(temperatures[3], SIM_DEFAULT_TEMPERATURE);
+        }
+    }
+    CHECK(noisy.get_crc_errors() > 0);
+    CHECK(good > 10);
+    CHECK(noisy.sim(3).resets() > noisy.sim(0).resets());
+}
+
+// Broadcast conversion lasts as long as the highest resolution
+static void test_resolutions(void)
+{
+    MultiBus buses { BUSES };
+    const uint8_t resolutions[BUSES] = { 9, 9, 10, 9 };
+    CHECK_EQ(buses.set_resolutions(resolutions), ESP_OK);
+    for (uint8_t i = 0; i < BUSES; i++) {
+        buses.sim(i).device(0).temperature = 0x0197; // 25.4375 C
+    }
+
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    CHECK_EQ(buses.get_temps(temperatures), ESP_OK);
+    CHECK_EQ(temperatures[0], 0x0190); // 0.5 C steps
+    CHECK_EQ(temperatures[2], 0x0194); // 0.25 C steps
+    const uint32_t latency = buses.get_conversion_latency();
+    CHECK(latency >= OneWire::DS18B20::conversion_time(10));
+    CHECK(latency < OneWire::DS18B20::conversion_time(10) + 2 * CONVERSION_POLL_INTERVAL * 1000);
+
+    // A bus whose device keeps 12 bit sets the timeout
+    MultiBus locked { BUSES };
+    locked.sim(1).device(0).faults.config_locked = true;
+    const uint8_t fast[BUSES] = { 9, 9, 9, 9 };
+    CHECK_EQ(locked.set_resolutions(fast), ESP_FAIL);
+    esp_err_t results[BUSES] = {};
+    CHECK_EQ(locked.get_temps(temperatures, results), ESP_OK);
+    CHECK_EQ(results[1], ESP_OK);
+    CHECK(locked.get_conversion_latency() >= OneWire::DS18B20::conversion_time(12));
+}
+
+int main(void)
+{
+    test_read();
+    test_faults();
+    test_resolutions();
+    return Test_NS::result("multibus");
+}
+
+#else
+static const gpio_num_t PINS[ONEWIRE_MAX_BUSES] = ONEWIRE_BUS_PINS;
+
+// Lines with one virtual device each, numbered like the SIM MultiBus does
+struct Lines {
+    OneWire::SimBus sim[BUSES];
+
+    explicit Lines(uint8_t count)
+    {
+        Line_NS::reset();
+        for (uint8_t i = 0; i < count; i++) {
+            sim[i].device(0).init(i + 1);
+            sim[i].device(0).temperature = static_cast<int16_t>(30 * 16 + i);
+            Line_NS::attach(PINS[i], &sim[i]);
+        }
+    }
+    const Line_NS::Statistics& line(uint8_t bus) { return Line_NS::statistics(PINS[bus]); }
+};
+
+// Every pulse was a reset or a slot and read slots were sampled in time
+static void check_timing(Lines& lines, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK_EQ(lines.line(i).bad_pulses, 0);
+        CHECK_EQ(lines.line(i).late_reads, 0);
+    }
+}
+
+// Bus time of reading a scratchpad on "count" buses
+static uint64_t scratchpad_time(uint8_t count)
+{
+    Lines lines { count };
+    MultiBus buses { PINS, count };
+    const uint32_t all = (1UL << count) - 1;
+    uint8_t data[BUSES][9] = {};
+    const uint64_t start = Line_NS::now();
+    CHECK_EQ(buses.read_scratchpads(all, data), all);
+    const uint64_t time = Line_NS::now() - start;
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK_EQ(data[i][0], 0x50); // Power on 85 C
+        CHECK_EQ(lines.line(i).resets, 1);
+        CHECK_EQ(lines.line(i).slots, 2 * 8 + 9 * 8);
+    }
+    check_timing(lines, count);
+    return time;
+}
+
+// Slots of all buses begin with the same register write, so N buses cost
+// the line time of one
+static void test_interleaving(void)
+{
+    const uint64_t one = scratchpad_time(1);
+    const uint64_t all = scratchpad_time(BUSES);
+    printf("Scratchpad read: %llu us on one bus, %llu us on %d buses\n",
+        static_cast<unsigned long long>(one), static_cast<unsigned long long>(all), BUSES);
+    CHECK_EQ(all, one);
+
+    Lines lines { BUSES };
+    MultiBus buses { PINS, BUSES };
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    esp_err_t results[BUSES] = {};
+    CHECK_EQ(buses.get_temps(temperatures, results), ESP_OK);
+    for (uint8_t i = 0; i < BUSES; i++) {
+        CHECK_EQ(results[i], ESP_OK);
+        CHECK_EQ(temperatures[i], 30 * 16 + i);
+        // Devices finish together, so no bus ever has a slot of its own
+        CHECK_EQ(lines.line(i).slots, lines.line(0).slots);
+        CHECK_EQ(lines.line(i).shared, lines.line(i).slots + lines.line(i).resets);
+    }
+    const uint32_t latency = buses.get_conversion_latency();
+    CHECK(latency >= OneWire::DS18B20::conversion_time(MAX_RESOLUTION));
+    CHECK(latency < OneWire::DS18B20::conversion_time(MAX_RESOLUTION) + 2 * CONVERSION_POLL_INTERVAL * 1000);
+    check_timing(lines, BUSES);
+}
+
+// Own byte per bus: ones and zeros released by different writes of one slot
+static void test_write_bytes(void)
+{
+    Lines lines { BUSES };
+    MultiBus buses { PINS, BUSES };
+    const uint8_t resolutions[BUSES] = { 9, 10, 11, 12 };
+    CHECK_EQ(buses.set_resolutions(resolutions), ESP_OK);
+    for (uint8_t i = 0; i < BUSES; i++) {
+        CHECK_EQ(lines.sim[i].device(0).eeprom[2], ((resolutions[i] - MIN_RESOLUTION) << 5) | 0x1F);
+        lines.sim[i].device(0).temperature = 0x0197; // 25.4375 C
+    }
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    CHECK_EQ(buses.get_temps(temperatures), ESP_OK);
+    CHECK_EQ(temperatures[0], 0x0190); // 0.5 C steps
+    CHECK_EQ(temperatures[1], 0x0194); // 0.25 C steps
+    CHECK_EQ(temperatures[2], 0x0196);
+    CHECK_EQ(temperatures[3], 0x0197);
+    check_timing(lines, BUSES);
+}
+
+// A bus without device or pull-up fails alone
+static void test_faults(void)
+{
+    Lines lines { BUSES };
+    lines.sim[1].device(0).faults.no_presence = true;
+    Line_NS::attach(PINS[3], nullptr); // Pin reads high, nobody answers
+    MultiBus buses { PINS, BUSES };
+    Temp_NS::q4_t temperatures[BUSES] = {};
+    esp_err_t results[BUSES] = {};
+    CHECK(buses.get_temps(temperatures, results) != ESP_OK);
+    CHECK_EQ(results[0], ESP_OK);
+    CHECK_EQ(results[1], ESP_ERR_NOT_FOUND);
+    CHECK_EQ(results[2], ESP_OK);
+    CHECK_EQ(results[3], ESP_ERR_NOT_FOUND);
+    CHECK_EQ(temperatures[2], 30 * 16 + 2);
+    check_timing(lines, BUSES);
+}
+
+int main(void)
+{
+    test_interleaving();
+    test_write_bytes();
+    test_faults();
+    Line_NS::reset();
+    return Test_NS::result("multibus gpio");
+}
+#endif
@@ -0,0 +1,207 @@
+#include "pid.h"
+#include "pwm.h"
+#include "test.h"
+#include <cmath>
+#include <cstdlib>
+
+// PID loop in a closed loop with a simulated drive against the linear
+// min/max map the fan used before, then clamping and anti-windup alone
+using namespace Control_NS;
+
+static const uint32_t MAX_DUTY = Fan_NS::Duty::full(25000, LEDC_TIMER_10_BIT);
+static const uint32_t INTERVAL = 6000; // ms, median of three sweeps
+static const uint32_t PHASE = 3600; // s of one load
+static const uint32_t TARGET = 40; // C
+static const uint32_t MIN_TEMP = 30; // C, the map of the defaults
+static const uint32_t MAX_TEMP = 45;
+static const uint32_t DUTY_STEP = 2; // %, FanPWM::_update_duty() coalescing
+
+// Drive in a case at 25 C: heat capacity 600 J/C, the airflow takes
+// 0.4 .. 2 W/C from stopped to full fan. Load alternates between idle and
+// a scrub.
+struct Drive {
+    double temperature { 35 };
+
+    void step(double seconds, uint32_t duty, double power)
+    {
+        const double conductance = 0.4 + 1.6 * duty / MAX_DUTY;
+        temperature += (power - conductance * (temperature - 25)) / 600 * seconds;
+    }
+    // DS18B20 steps with one step of noise
+    Temp_NS::q4_t reading(void) const
+    {
+        return static_cast<Temp_NS::q4_t>(lround(temperature * 16) + rand() % 3 - 1);
+    }
+};
+
+static double power_at(uint32_t seconds)
+{
+    return (seconds / PHASE) % 2 ? 20 : 12; // W
+}
+
+// Map of FanPWM::start() before the PID: the truncated scale factor and a
+// new duty written on every pass
+static uint32_t old_map(Temp_NS::q4_t reading)
+{
+    const float result = reading / 16.0f;
+    if (result <= MIN_TEMP) {
+        return 0;
+    }
+    if (result >= MAX_TEMP) {
+        return MAX_DUTY;
+    }
+    return static_cast<uint32_t>(static_cast<uint32_t>(MAX_DUTY / (MAX_TEMP - MIN_TEMP)) * (result - MIN_TEMP));
+}
+
+struct Run {
+    double steady_error; // Mean |temperature - target| in the second half of every load, C
+    double worst_error; // The same, largest
+    uint32_t changes; // Duty writes which changed the duty
+};
+
+enum class Controller { MAP, MAP_COALESCED, PID };
+
+static Run run(Controller controller)
+{
+    srand(20);
+    Drive drive;
+    Pid pid(1000, 100, 0); // README defaults
+    uint32_t duty = MAX_DUTY;
+    Run result {};
+    double error_sum = 0;
+    uint32_t error_count = 0;
+    for (uint32_t seconds = 0; seconds < 6 * PHASE; seconds += INTERVAL / 1000) {
+        const Temp_NS::q4_t reading = drive.reading();
+        uint32_t next = 0;
+        uint32_t step = 0;
+        switch (controller) {
+        case Controller::MAP:
+            next = old_map(reading);
+            break;
+        case Controller::MAP_COALESCED:
+            next = Fan_NS::Duty::linear(MAX_DUTY, reading, MIN_TEMP, MAX_TEMP);
+            step = Fan_NS::Duty::from_percent(MAX_DUTY, DUTY_STEP);
+            break;
+        case Controller::PID:
+            next = Fan_NS::Duty::from_pid(MAX_DUTY, pid.update(Temp_NS::from_degrees(TARGET), reading, INTERVAL));
+            step = Fan_NS::Duty::from_percent(MAX_DUTY, DUTY_STEP);
+            break;
+        }
+        const uint32_t delta = next > duty ? next - duty : duty - next;
+        if (next != duty && (delta >= step || next == 0 || next == MAX_DUTY)) {
+            duty = next;
+            ++result.changes;
+        }
+        drive.step(INTERVAL / 1000.0, duty, power_at(seconds));
+        if (seconds % PHASE >= PHASE / 2) {
+            const double error = fabs(drive.temperature - TARGET);
+            error_sum += error;
+            ++error_count;
+            result.worst_error = error > result.worst_error ? error : result.worst_error;
+        }
+    }
+    result.steady_error = error_sum / error_count;
+    return result;
+}
+
+static void test_closed_loop(void)
+{
+    const Run map = run(Controller::MAP);
+    const Run coalesced = run(Controller::MAP_COALESCED);
+    const Run pid = run(Controller::PID);
+    printf("old map:        steady error %.2f C (worst %.2f), %u duty changes\n", map.steady_error,
+        map.worst_error, map.changes);
+    printf("map, %u%% step:  steady error %.2f C (worst %.2f), %u duty changes\n", DUTY_STEP,
+        coalesced.steady_error, coalesced.worst_error, coalesced.changes);
+    printf("pid, %u%% step:  steady error %.2f C (worst %.2f), %u duty changes\n", DUTY_STEP,
+        pid.steady_error, pid.worst_error, pid.changes);
+    // The map settles where the drive and the line meet, the loop at the target
+    CHECK(pid.steady_error < 0.25);
+    CHECK(map.steady_error > 1.0);
+    CHECK(pid.steady_error * 5 < coalesced.steady_error);
+    CHECK(pid.changes * 5 < map.changes);
+}
+
+static const Temp_NS::q4_t target = Temp_NS::from_degrees(TARGET);
+
+// Proportional and integral scales of the gains, output stays in the limits
+static void test_gains(void)
+{
+    Pid pid(1000, 0, 0);
+    CHECK_EQ(pid.update(target, target + 16, INTERVAL), 10 * PID_OUTPUT_ONE); // 10 % per C
+    CHECK_EQ(pid.update(target, target + 160, INTERVAL), PID_OUTPUT_MAX);
+    CHECK_EQ(pid.update(target, target - 16, INTERVAL), 0);
+
+    pid.set_limits(20 * PID_OUTPUT_ONE, 80 * PID_OUTPUT_ONE);
+    CHECK_EQ(pid.update(target, target - 16, INTERVAL), 20 * PID_OUTPUT_ONE);
+    CHECK_EQ(pid.update(target, target + 160, INTERVAL), 80 * PID_OUTPUT_ONE);
+
+    // 1 % per C per minute
+    Pid integral(0, 100, 0);
+    integral.update(target, target + 16, INTERVAL); // First one sets the state only
+    for (uint32_t i = 0; i < 60000 / INTERVAL; i++) {
+        integral.update(target, target + 16, INTERVAL);
+    }
+    CHECK_EQ(integral.output(), PID_OUTPUT_ONE);
+
+    // Long gap, the integral restarts
+    CHECK_EQ(integral.update(target, target + 16, PID_MAX_INTERVAL + 1), PID_OUTPUT_ONE);
+    integral.reset();
+    CHECK_EQ(integral.update(target, target + 16, INTERVAL), PID_OUTPUT_ONE);
+}
+
+// Hours above the target at full duty, then the drive cools: the output
+// leaves full duty on the first sample below the target
+static void test_windup(void)
+{
+    Pid pid(1000, 100, 0);
+    for (uint32_t i = 0; i < 3600000 / INTERVAL; i++) {
+        pid.update(target, target + 160, INTERVAL);
+    }
+    CHECK_EQ(pid.output(), PID_OUTPUT_MAX);
+    CHECK(pid.update(target, target - 8, INTERVAL) < PID_OUTPUT_MAX);
+
+    // The same below the target at 0
+    for (uint32_t i = 0; i < 3600000 / INTERVAL; i++) {
+        pid.update(target, target - 160, INTERVAL);
+    }
+    CHECK_EQ(pid.output(), 0);
+    CHECK(pid.update(target, target + 8, INTERVAL) > 0);
+}
+
+// Derivative is on the measurement: a new target moves the output by the
+// proportional term only, a rising temperature adds to it
+static void test_derivative(void)
+{
+    Pid pid(1000, 0, 100);
+    pid.update(target, target + 16, INTERVAL);
+    const int32_t before = pid.output();
+    const int32_t after = pid.update(target - 16, target + 16, INTERVAL);
+    CHECK_EQ(after - before, 10 * PID_OUTPUT_ONE);
+    // 1 C/min rise, 1 % per C/min
+    CHECK_EQ(pid.update(target - 16, target + 16 + 1, 3750) - after, 10 * PID_OUTPUT_ONE / 16 + PID_OUTPUT_ONE);
+}
+
+// Speed loop: the target's share of the full speed, the error integrated
+static void test_rpm_loop(void)
+{
+    RpmLoop loop(2000, 10);
+    CHECK_EQ(loop.update(1000, 1000, 1000), PID_OUTPUT_MAX / 2);
+    // Slower than asked, the duty grows until the speed is reached
+    const int32_t first = loop.update(1000, 800, 1000);
+    CHECK(first > PID_OUTPUT_MAX / 2);
+    CHECK(loop.update(1000, 800, 1000) > first);
+    CHECK_EQ(loop.update(2000, 0, PID_MAX_INTERVAL), PID_OUTPUT_MAX);
+    // A step past 0 isn't integrated, the correction left is tiny
+    CHECK(loop.update(0, 2000, 1000) < PID_OUTPUT_ONE);
+}
+
+int main(void)
+{
+    test_closed_loop();
+    test_gains();
+    test_windup();
+    test_derivative();
+    test_rpm_loop();
+    return Test_NS::result("test_pid");
+}
@@ -0,0 +1,131 @@
+#include "pwm.h"
+#include "test.h"
+#include <chrono>
+
+// Compile-time Pwm against RuntimePwm for every DS18B20 temperature, and
+// both against the duty math of FanPWM before them
+using namespace Fan_NS;
+
+// FanPWM before Output: max duty and the linear map
+static uint32_t old_max_duty(uint32_t freq_hz, uint32_t resolution)
+{
+    return (LOW_SPEED_MODE_TIMER / freq_hz) * (2 << (resolution - 1));
+}
+
+static uint32_t old_linear(uint32_t max_duty, Temp_NS::q4_t temperature, uint32_t min_temp, uint32_t max_temp)
+{
+    const float result = temperature / 16.0f;
+    if (result <= min_temp) {
+        return 0;
+    }
+    if (result >= max_temp) {
+        return max_duty;
+    }
+    return static_cast<uint32_t>(static_cast<uint32_t>(max_duty / (max_temp - min_temp)) * (result - min_temp));
+}
+
+struct Range {
+    uint32_t min_temp;
+    uint32_t max_temp;
+};
+static const Range ranges[] = { { 30, 45 }, { 20, 60 }, { 0, 100 }, { 40, 41 }, { 35, 125 } };
+
+template <uint32_t Freq, ledc_timer_bit_t Resolution>
+static void compare(void)
+{
+    Pwm<Freq, Resolution, LEDC_CHANNEL_1> fixed;
+    RuntimePwm runtime(Freq, LEDC_CHANNEL_2, LEDC_TIMER_0, Resolution);
+    const Output& output = fixed; // Through the interface FanPWM uses
+    const uint32_t max_duty = Pwm<Freq, Resolution, LEDC_CHANNEL_1>::MAX_DUTY;
+    CHECK_EQ(runtime.max_duty(), max_duty);
+    CHECK_EQ(output.max_duty(), max_duty);
+    if (Freq < LOW_SPEED_MODE_TIMER) {
+        CHECK_EQ(old_max_duty(Freq, Resolution), max_duty);
+    } else {
+        CHECK_EQ(max_duty, 1UL << Resolution); // The old one was 0
+    }
+
+    uint32_t mismatches = 0;
+    uint32_t worst = 0; // Above the old map, duty units
+    for (const Range& range : ranges) {
+        const uint32_t span = range.max_temp - range.min_temp;
+        for (Temp_NS::q4_t temperature = -55 * 16; temperature <= 125 * 16; temperature++) {
+            const uint32_t duty = output.linear(temperature, range.min_temp, range.max_temp);
+            mismatches += duty != runtime.linear(temperature, range.min_temp, range.max_temp);
+            // Same max duty, no truncated scale factor: never below the old
+            // map, at most the remainder of max / span above it
+            const uint32_t old = old_linear(max_duty, temperature, range.min_temp, range.max_temp);
+            CHECK(duty >= old);
+            CHECK(duty - old <= max_duty % span);
+            worst = duty - old > worst ? duty - old : worst;
+        }
+        CHECK_EQ(output.linear(Temp_NS::from_degrees(range.min_temp), range.min_temp, range.max_temp), 0);
+        CHECK_EQ(output.linear(Temp_NS::from_degrees(range.max_temp), range.min_temp, range.max_temp), max_duty);
+    }
+    CHECK_EQ(mismatches, 0);
+
+    for (uint32_t percent = 0; percent <= 100; percent++) {
+        CHECK_EQ(output.from_percent(percent), runtime.from_percent(percent));
+        CHECK_EQ(output.to_percent(output.from_percent(percent)), runtime.to_percent(runtime.from_percent(percent)));
+    }
+    for (uint32_t duty = 0; duty <= Control_NS::CURVE_DUTY_MAX; duty += 7) {
+        CHECK_EQ(output.from_curve(duty), runtime.from_curve(duty));
+    }
+    for (int32_t pid = 0; pid <= Control_NS::PID_OUTPUT_MAX; pid += 13) {
+        CHECK_EQ(output.from_pid(pid), runtime.from_pid(pid));
+    }
+    CHECK_EQ(output.from_curve(Control_NS::CURVE_DUTY_MAX), max_duty);
+    CHECK_EQ(output.from_pid(Control_NS::PID_OUTPUT_MAX), max_duty);
+
+    // Each one on its own channel, full duty at start
+    CHECK_EQ(fixed.init(13), ESP_OK);
+    CHECK_EQ(runtime.init(12), ESP_OK);
+    CHECK_EQ(ledc_host_duties()[LEDC_CHANNEL_1], max_duty);
+    CHECK_EQ(ledc_host_duties()[LEDC_CHANNEL_2], max_duty);
+    fixed.write(max_duty / 3);
+    runtime.write(max_duty / 4);
+    CHECK_EQ(ledc_host_duties()[LEDC_CHANNEL_1], max_duty / 3);
+    CHECK_EQ(ledc_host_duties()[LEDC_CHANNEL_2], max_duty / 4);
+
+    printf("%u Hz, %u bit: max duty %u, old map up to %u below\n", Freq, Resolution, max_duty, worst);
+}
+
+// Temperature to duty of a control pass, constants against members
+static void test_speed(void)
+{
+    Pwm<25000, LEDC_TIMER_10_BIT, LEDC_CHANNEL_0> fixed;
+    RuntimePwm runtime(25000);
+    const uint32_t rounds = 2000;
+    volatile uint32_t min_temp = 30; // Read like the NVS values
+    volatile uint32_t max_temp = 45;
+    uint32_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (Temp_NS::q4_t temperature = 400; temperature < 800; temperature++) {
+            sum += fixed.linear(temperature, min_temp, max_temp);
+        }
+    }
+    const double fixed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (Temp_NS::q4_t temperature = 400; temperature < 800; temperature++) {
+            sum -= runtime.linear(temperature, min_temp, max_temp);
+        }
+    }
+    const double runtime_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQ(sum, 0);
+    printf("linear: Pwm %.2f ns, RuntimePwm %.2f ns\n", fixed_ns / (rounds * 400), runtime_ns / (rounds * 400));
+}
+
+int main(void)
+{
+    compare<25000, LEDC_TIMER_10_BIT>(); // The default fan
+    compare<8000, LEDC_TIMER_10_BIT>();
+    compare<1000, LEDC_TIMER_10_BIT>();
+    compare<100, LEDC_TIMER_10_BIT>();
+    compare<1000, LEDC_TIMER_8_BIT>();
+    compare<1000, LEDC_TIMER_13_BIT>();
+    compare<7999, LEDC_TIMER_1_BIT>();
+    test_speed();
+    return Test_NS::result("test_pwm");
+}
@@ -0,0 +1,287 @@
+#include "gpio.h"
+#include "test.h"
+#include <cstring>
+#include <initializer_list>
+
+// 1-Wire layer on the simulated bus: reset, match, search and conversion
+// paths, injected faults and the simulated time of every transaction
+using OneWire::DS18B20;
+
+// Index of the virtual device with the ROM code, -1 - no such device
+static int device_of(DS18B20& bus, const uint8_t (&rom)[8])
+{
+    for (uint8_t i = 0; i < bus.sim().count(); i++) {
+        if (memcmp(rom, bus.sim().device(i).rom, 8) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void test_reset(void)
+{
+    DS18B20 empty { 0 };
+    CHECK_EQ(empty.reset(), ESP_ERR_TIMEOUT);
+
+    DS18B20 bus { 2 };
+    CHECK_EQ(bus.reset(), ESP_OK);
+    bus.sim().device(0).faults.no_presence = true;
+    CHECK_EQ(bus.reset(), ESP_OK); // One device is enough
+    bus.sim().device(1).faults.no_presence = true;
+    CHECK_EQ(bus.reset(), ESP_ERR_TIMEOUT);
+}
+
+static void test_search(void)
+{
+    DS18B20 bus { SIM_MAX_DEVICES };
+    uint8_t addresses[SIM_MAX_DEVICES][8];
+    uint8_t count = 0;
+    CHECK_EQ(bus.search_rom(addresses, SIM_MAX_DEVICES, count), ESP_OK);
+    CHECK_EQ(count, SIM_MAX_DEVICES);
+    uint32_t found = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        const int device = device_of(bus, addresses[i]);
+        CHECK(device >= 0);
+        found |= 1UL << device;
+    }
+    CHECK_EQ(found, (1UL << SIM_MAX_DEVICES) - 1); // Every device once
+
+    // "max_count" stops the search
+    CHECK_EQ(bus.search_rom(addresses, 3, count), ESP_OK);
+    CHECK_EQ(count, 3);
+
+    // A device without presence doesn't take part
+    bus.sim().device(4).faults.no_presence = true;
+    CHECK_EQ(bus.search_rom(addresses, SIM_MAX_DEVICES, count), ESP_OK);
+    CHECK_EQ(count, SIM_MAX_DEVICES - 1);
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK(device_of(bus, addresses[i]) != 4);
+    }
+}
+
+// Corrupted passes are retried along the last good path: whatever is found
+// is a real device, found once
+static void test_search_retry(void)
+{
+    uint32_t retried = 0;
+    for (uint16_t rate = 1000; rate <= 10000; rate += 1000) {
+        DS18B20 bus { SIM_MAX_DEVICES };
+        for (uint8_t i = 0; i < SIM_MAX_DEVICES; i++) {
+            bus.sim().device(i).faults.bit_flip_rate = rate;
+        }
+        uint8_t addresses[SIM_MAX_DEVICES][8];
+        uint8_t count = 0;
+        const esp_err_t status = bus.search_rom(addresses, SIM_MAX_DEVICES, count);
+        CHECK(status == ESP_OK || status == ESP_ERR_INVALID_CRC);
+        uint32_t found = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            const int device = device_of(bus, addresses[i]);
+            CHECK(device >= 0);
+            CHECK(device < 0 || !(found & (1UL << device)));
+            found |= 1UL << device;
+        }
+        if (status == ESP_OK && bus.get_crc_errors() > 0) {
+            CHECK_EQ(count, SIM_MAX_DEVICES);
+            ++retried;
+        }
+    }
+    printf("Search with bit flips: %u of 10 searches retried and finished\n", retried);
+    CHECK(retried > 0);
+}
+
+// Sensor slots of the NVS cache merged with a search result
+static void test_merge_roms(void)
+{
+    const uint8_t a[8] = { 0x28, 1 }, b[8] = { 0x28, 2 }, c[8] = { 0x28, 3 }, d[8] = { 0x28, 4 };
+    uint8_t known[4][8];
+    uint8_t found[4][8];
+    const auto set = [](uint8_t (*roms)[8], std::initializer_list<const uint8_t*> list) {
+        uint8_t i = 0;
+        for (const uint8_t* rom : list) {
+            memcpy(roms[i++], rom, 8);
+        }
+    };
+
+    // Missing sensor keeps its slot, the new one is added after
+    set(known, { a, b });
+    set(found, { c, b });
+    CHECK_EQ(OneWire::merge_roms(known, 2, found, 2, 4), 3);
+    CHECK(memcmp(known[0], a, 8) == 0 && memcmp(known[1], b, 8) == 0 && memcmp(known[2], c, 8) == 0);
+    // Nothing new, nothing moves
+    CHECK_EQ(OneWire::merge_roms(known, 3, found, 2, 4), 3);
+    CHECK(memcmp(known[0], a, 8) == 0 && memcmp(known[2], c, 8) == 0);
+
+    // Defaults which aren't there are dropped
+    set(known, { a, b });
+    set(found, { c, b });
+    CHECK_EQ(OneWire::merge_roms(known, 2, found, 2, 4, false), 2);
+    CHECK(memcmp(known[0], b, 8) == 0 && memcmp(known[1], c, 8) == 0);
+
+    // All slots taken: a replacement takes the slot of the missing sensor
+    set(known, { a, b, c });
+    set(found, { a, d, c });
+    CHECK_EQ(OneWire::merge_roms(known, 3, found, 3, 3), 3);
+    CHECK(memcmp(known[0], a, 8) == 0 && memcmp(known[1], d, 8) == 0 && memcmp(known[2], c, 8) == 0);
+    // No missing sensor, no room
+    set(found, { a, d, c, b });
+    CHECK_EQ(OneWire::merge_roms(known, 3, found, 4, 3), 3);
+    CHECK(memcmp(known[1], d, 8) == 0);
+}
+
+static void test_match(void)
+{
+    DS18B20 bus { 3 };
+    OneWire::VirtualDS18B20& device = bus.sim().device(1);
+    device.temperature = -0x00A2; // -10.125 C
+    Temp_NS::q4_t temperature = 0;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, -0x00A2);
+
+    // Nobody answers an unknown ROM code
+    uint8_t unknown[8];
+    memcpy(unknown, device.rom, sizeof(unknown));
+    unknown[1] = 0x7E;
+    unknown[7] = OneWire::crc8(unknown, 7);
+    CHECK(bus.read_temp(unknown, temperature) != ESP_OK);
+}
+
+static void test_conversion(void)
+{
+    DS18B20 bus { 2 };
+    OneWire::VirtualDS18B20& device = bus.sim().device(0);
+    device.temperature = 0x0198; // 25.5 C
+
+    // Polls of the state machine
+    CHECK(bus.poll_conversion() == OneWire::conversion_state::IDLE);
+    CHECK_EQ(bus.wait_for_conversion(), ESP_ERR_INVALID_STATE);
+    CHECK_EQ(bus.convert_all(), ESP_OK);
+    CHECK(bus.poll_conversion() == OneWire::conversion_state::CONVERTING);
+    CHECK_EQ(bus.wait_for_conversion(), ESP_OK);
+    CHECK(bus.poll_conversion() == OneWire::conversion_state::DONE);
+
+    // 9 bits: 93.75 ms, the value is rounded to 0.5 C
+    CHECK_EQ(bus.set_resolution(device.rom, 9), ESP_OK);
+    CHECK_EQ(bus.set_resolution(bus.sim().device(1).rom, 9), ESP_OK);
+    Temp_NS::q4_t temperature = 0;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, 0x0198);
+    device.temperature = 0x019F;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_OK);
+    CHECK_EQ(temperature, 0x0198);
+    const uint32_t latency = bus.get_conversion_latency();
+    CHECK(latency >= DS18B20::conversion_time(9));
+    CHECK(latency < DS18B20::conversion_time(9) + CONVERSION_POLL_INTERVAL * 1000 + 1000);
+
+    // Slow device runs into the timeout
+    device.faults.conversion_slowdown = 2;
+    CHECK_EQ(bus.get_temp(device.rom, temperature), ESP_ERR_TIMEOUT);
+    CHECK_EQ(bus.get_conversion_state(), OneWire::conversion_state::TIMEOUT);
+}
+
+// Bus timeout follows the resolution every device runs at, also the ones
+// which weren't changed
+static void test_resolution_timeout(void)
+{
+    DS18B20 bus { 3 };
+    CHECK_EQ(bus.conversion_timeout(), DS18B20::conversion_time(12) / 3 * 4); // Unknown
+    CHECK_EQ(bus.set_resolution(bus.sim().device(0).rom, 10), ESP_OK);
+    CHECK_EQ(bus.conversion_timeout(), DS18B20::conversion_time(10) / 3 * 4);
+
+    // Configuration isn't taken, the device stays at 12 bit
+    OneWire::VirtualDS18B20& locked = bus.sim().device(1);
+    locked.faults.config_locked = true;
+    CHECK_EQ(bus.set_resolution(locked.rom, 10), ESP_FAIL);
+    CHECK_EQ(bus.conversion_timeout(), DS18B20::conversion_time(12) / 3 * 4);
+    Temp_NS::q4_t temperature = 0;
+    CHECK_EQ(bus.get_temp(locked.rom, temperature), ESP_OK);
+
+    // DS18S20 converts in 750 ms whatever is asked
+    DS18B20 mixed { 2 };
+    CHECK_EQ(mixed.set_resolution(mixed.sim().device(0).rom, 9), ESP_OK);
+    OneWire::VirtualDS18B20& old = mixed.sim().device(1);
+    old.rom[0] = 0x10;
+    old.rom[7] = OneWire::crc8(old.rom, 7);
+    CHECK_EQ(mixed.set_resolution(old.rom, 9), ESP_ERR_NOT_SUPPORTED);
+    CHECK_EQ(mixed.conversion_timeout(), DS18B20::conversion_time(12) / 3 * 4);
+    CHECK(mixed.convert_all() == ESP_OK && mixed.wait_for_conversion() == ESP_OK);
+
+    // Bad resolution leaves the device as it is
+    DS18B20 unchanged { 2 };
+    CHECK_EQ(unchanged.set_resolution(unchanged.sim().device(0).rom, 9), ESP_OK);
+    CHECK_EQ(unchanged.set_resolution(unchanged.sim().device(1).rom, 13), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(unchanged.conversion_timeout(), DS18B20::conversion_time(12) / 3 * 4);
+}
+
+static void test_alarm_search(void)
+{
+    DS18B20 bus { 4 };
+    for (uint8_t i = 0; i < 4; i++) {
+        OneWire::VirtualDS18B20& device = bus.sim().device(i);
+        device.temperature = 40 * 16;
+        CHECK_EQ(bus.set_alarms(device.rom, 41, 39), ESP_OK);
+    }
+    bus.sim().device(2).temperature = 45 * 16;
+
+    Temp_NS::q4_t temperatures[4] = {};
+    esp_err_t results[4] = {};
+    bool alarms[4] = {};
+    uint8_t addresses[4][8];
+    for (uint8_t i = 0; i < 4; i++) {
+        memcpy(addresses[i], bus.sim().device(i).rom, 8);
+    }
+    CHECK_EQ(bus.get_alarm_temps(addresses, 4, temperatures, results, alarms), ESP_OK);
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK_EQ(alarms[i], i == 2);
+    }
+    CHECK_EQ(results[2], ESP_OK);
+    CHECK_EQ(temperatures[2], 45 * 16);
+}
+
+// Simulated time of the transactions, the numbers the bus budget is made of
+static void test_costs(void)
+{
+    DS18B20 bus { 1 };
+    OneWire::SimBus& sim = bus.sim();
+    uint8_t (&rom)[8] = sim.device(0).rom;
+    uint8_t data[9];
+
+    sim.clear_statistics();
+    bus.reset();
+    const uint64_t reset = sim.bus_time();
+    CHECK_EQ(reset, SIM_RESET_DURATION);
+
+    sim.clear_statistics();
+    bus.match_rom(rom);
+    const uint64_t match = sim.bus_time();
+    CHECK_EQ(match, SIM_RESET_DURATION + 9 * 8 * SIM_SLOT_DURATION);
+
+    sim.clear_statistics();
+    CHECK_EQ(bus.read_scratchpad(rom, data), ESP_OK);
+    const uint64_t scratchpad = sim.bus_time();
+    CHECK_EQ(scratchpad, match + 10 * 8 * SIM_SLOT_DURATION);
+
+    uint8_t addresses[1][8];
+    uint8_t count = 0;
+    sim.clear_statistics();
+    CHECK_EQ(bus.search_rom(addresses, 1, count), ESP_OK);
+    const uint64_t search = sim.bus_time();
+    CHECK_EQ(search, SIM_RESET_DURATION + (8 + 64 * 3) * SIM_SLOT_DURATION);
+
+    printf("Bus time, us: reset %llu, match %llu, scratchpad read %llu, search of one %llu\n",
+        static_cast<unsigned long long>(reset), static_cast<unsigned long long>(match),
+        static_cast<unsigned long long>(scratchpad), static_cast<unsigned long long>(search));
+}
+
+int main(void)
+{
+    test_reset();
+    test_search();
+    test_search_retry();
+    test_match();
+    test_merge_roms();
+    test_conversion();
+    test_resolution_timeout();
+    test_alarm_search();
+    test_costs();
+    return Test_NS::result("sim");
+}
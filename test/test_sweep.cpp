@@ -0,0 +1,68 @@
+#include "gpio.h"
+#include "test.h"
+#include <cstring>
+
+// Bus sweep of N sensors: broadcast conversion against one conversion per
+// sensor, in simulated time
+using OneWire::DS18B20;
+
+static void addresses_of(DS18B20& bus, uint8_t (*addresses)[8])
+{
+    for (uint8_t i = 0; i < bus.sim().count(); i++) {
+        memcpy(addresses[i], bus.sim().device(i).rom, 8);
+        bus.sim().device(i).temperature = static_cast<int16_t>(400 + 16 * i); // 25 C + i
+    }
+}
+
+static uint64_t per_sensor_sweep(uint8_t count)
+{
+    DS18B20 bus { count };
+    uint8_t addresses[SIM_MAX_DEVICES][8];
+    addresses_of(bus, addresses);
+
+    const uint64_t start = bus.sim().now();
+    for (uint8_t i = 0; i < count; i++) {
+        Temp_NS::q4_t temperature = 0;
+        CHECK_EQ(bus.get_temp(addresses[i], temperature), ESP_OK);
+        CHECK_EQ(temperature, 400 + 16 * i);
+    }
+    return bus.sim().now() - start;
+}
+
+static uint64_t broadcast_sweep(uint8_t count)
+{
+    DS18B20 bus { count };
+    uint8_t addresses[SIM_MAX_DEVICES][8];
+    addresses_of(bus, addresses);
+
+    Temp_NS::q4_t temperatures[SIM_MAX_DEVICES] = {};
+    esp_err_t results[SIM_MAX_DEVICES] = {};
+    const uint64_t start = bus.sim().now();
+    CHECK_EQ(bus.get_temps(addresses, count, temperatures, results), ESP_OK);
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK_EQ(results[i], ESP_OK);
+        CHECK_EQ(temperatures[i], 400 + 16 * i);
+    }
+    return bus.sim().now() - start;
+}
+
+int main(void)
+{
+    const uint32_t conversion = DS18B20::conversion_time(MAX_RESOLUTION);
+    for (uint8_t count = 1; count <= SIM_MAX_DEVICES; count *= 2) {
+        const uint64_t per_sensor = per_sensor_sweep(count);
+        const uint64_t broadcast = broadcast_sweep(count);
+        printf("%d sensors: per sensor %llu us, broadcast %llu us\n", count,
+            static_cast<unsigned long long>(per_sensor), static_cast<unsigned long long>(broadcast));
+
+        // One conversion whatever the count, rounded up to the poll interval.
+        // Addressed read of a scratchpad is 145 slots and a reset, ~12 ms.
+        CHECK(per_sensor >= static_cast<uint64_t>(count) * conversion);
+        CHECK(broadcast >= conversion);
+        CHECK(broadcast < conversion + 2 * CONVERSION_POLL_INTERVAL * 1000 + count * 12000);
+        if (count > 1) {
+            CHECK(broadcast * 3 / 2 < per_sensor);
+        }
+    }
+    return Test_NS::result("sweep");
+}
@@ -0,0 +1,182 @@
+#include "tach.h"
+#include "test.h"
+#include <chrono>
+#include <cstring>
+
+// Tach edges through the interrupt handler, RPM of the windows from a
+// synthetic fan and the stall and under-speed decisions
+using namespace Tach_NS;
+
+static const gpio_num_t PIN = static_cast<gpio_num_t>(FAN_TACH_GPIO);
+
+// Fan turning at "rpm" with "pulses" edges per revolution, edges are given
+// to the pin as time goes
+struct Fan {
+    uint32_t rpm;
+    uint8_t pulses;
+    uint64_t time_us;
+    uint64_t edges; // Given so far
+
+    void run(uint32_t us)
+    {
+        time_us += us;
+        const uint64_t due = time_us * rpm * pulses / 60000000ULL;
+        for (; edges < due; edges++) {
+            gpio_host_edge(PIN);
+        }
+    }
+};
+
+static void test_counter(void)
+{
+    Counter counter;
+    CHECK_EQ(counter.start(PIN), ESP_OK);
+    for (uint32_t i = 0; i < 1000; i++) {
+        gpio_host_edge(PIN);
+    }
+    CHECK_EQ(counter.edges(), 1000);
+    counter.stop();
+    gpio_host_edge(PIN);
+    CHECK_EQ(counter.edges(), 1000);
+
+    // Cost of an edge in the interrupt
+    CHECK_EQ(counter.start(PIN), ESP_OK);
+    const uint32_t edges = 10000000;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < edges; i++) {
+        gpio_host_edge(PIN);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQ(counter.edges(), 1000 + edges);
+    printf("edge: %.2f ns\n", seconds * 1e9 / edges);
+    counter.stop();
+}
+
+// Windows of WINDOW_MS read the counter: the RPM is within one edge of the
+// truth for the speeds of PC fans and both pulse counts
+static void test_meter(void)
+{
+    const uint32_t speeds[] = { 0, 300, 733, 1200, 1999, 3000, 6500 };
+    const uint8_t pulse_counts[] = { 1, 2 };
+    for (uint8_t pulses : pulse_counts) {
+        for (uint32_t rpm : speeds) {
+            Counter counter;
+            counter.start(PIN);
+            Fan fan { rpm, pulses, 0, 0 };
+            Meter meter(pulses);
+            CHECK(!meter.update(counter.edges(), 0)); // Starts the window
+            const uint32_t resolution = 60000 / (pulses * WINDOW_MS);
+            for (uint32_t window = 0; window < 10; window++) {
+                fan.run(WINDOW_MS * 1000);
+                CHECK(meter.update(counter.edges(), static_cast<uint32_t>(fan.time_us)));
+                CHECK(meter.rpm() + resolution >= rpm && meter.rpm() <= rpm + resolution);
+            }
+            counter.stop();
+        }
+    }
+
+    // Counter and clock wrap
+    Meter meter(2);
+    meter.update(UINT32_MAX - 10, UINT32_MAX - 500000);
+    CHECK(meter.update(89, 500000 - 1)); // 100 edges in 1 s
+    CHECK_EQ(meter.rpm(), 3000);
+    // No time passed, no pulse count: the last RPM stays
+    CHECK(!meter.update(200, 500000 - 1));
+    meter.set_pulses(0);
+    CHECK(!meter.update(200, 1500000));
+    CHECK_EQ(meter.rpm(), 3000);
+    meter.set_pulses(2);
+    meter.reset();
+    CHECK(!meter.update(0, 0));
+}
+
+// Monitor fed once a window, "now" in ms
+static Health feed(Monitor& monitor, uint32_t rpm, uint32_t& now, uint8_t windows)
+{
+    Health health = monitor.health();
+    for (uint8_t i = 0; i < windows; i++) {
+        now += WINDOW_MS;
+        health = monitor.update(rpm, now);
+    }
+    return health;
+}
+
+static void test_monitor(void)
+{
+    Monitor monitor(300, 2000);
+    uint32_t now = 0;
+    monitor.commanded(50, now);
+    // Spin-up isn't judged
+    CHECK(feed(monitor, 0, now, SPIN_UP_MS / WINDOW_MS - 1) == Health::OK);
+    // A stall is confirmed after CONFIRM_WINDOWS in a row
+    CHECK(feed(monitor, 0, now, CONFIRM_WINDOWS - 1) == Health::OK);
+    CHECK(feed(monitor, 0, now, 1) == Health::STALL);
+    // One good window doesn't clear it, CONFIRM_WINDOWS do
+    CHECK(feed(monitor, 1000, now, CONFIRM_WINDOWS - 1) == Health::STALL);
+    CHECK(feed(monitor, 0, now, 1) == Health::STALL);
+    CHECK(feed(monitor, 1000, now, CONFIRM_WINDOWS) == Health::OK);
+    // A glitch shorter than the confirmation is ignored
+    CHECK(feed(monitor, 0, now, CONFIRM_WINDOWS - 1) == Health::OK);
+    CHECK(feed(monitor, 1000, now, 1) == Health::OK);
+    CHECK(feed(monitor, 0, now, CONFIRM_WINDOWS - 1) == Health::OK);
+
+    // A stopped fan at a low duty is fine
+    monitor.commanded(DRIVEN_PERCENT - 1, now);
+    CHECK(feed(monitor, 0, now, 10) == Health::OK);
+
+    // Full duty: spin-up again, then under-speed below 70 % of the full speed
+    monitor.commanded(100, now);
+    CHECK(feed(monitor, 1000, now, SPIN_UP_MS / WINDOW_MS - 1) == Health::OK);
+    CHECK(feed(monitor, 1000, now, CONFIRM_WINDOWS - 1) == Health::OK);
+    CHECK(feed(monitor, 1000, now, 1) == Health::UNDER_SPEED);
+    CHECK(feed(monitor, 2000 * UNDER_SPEED_PERCENT / 100, now, CONFIRM_WINDOWS) == Health::OK);
+    // Slowing down isn't a spin-up
+    monitor.commanded(50, now);
+    CHECK(feed(monitor, 0, now, CONFIRM_WINDOWS) == Health::STALL);
+    CHECK(strcmp(health_name(monitor.health()), "stall") == 0);
+
+    // Full speed unknown, no under-speed
+    Monitor unknown(300, 0);
+    now = 0;
+    unknown.commanded(100, now);
+    CHECK(feed(unknown, 400, now, 20) == Health::OK);
+}
+
+// The fan of the meter test stopping in the middle of a run at 60 %
+static void test_stall(void)
+{
+    Counter counter;
+    counter.start(PIN);
+    Fan fan { 1500, 2, 0, 0 };
+    Meter meter(2);
+    Monitor monitor(300, 2000);
+    monitor.commanded(60, 0);
+    meter.update(counter.edges(), 0);
+    uint32_t stalled_at = 0;
+    uint32_t detected_at = 0;
+    for (uint32_t window = 1; window <= 40; window++) {
+        if (window == 20) {
+            fan.rpm = 0;
+            stalled_at = (window - 1) * WINDOW_MS; // Start of the window
+        }
+        fan.run(WINDOW_MS * 1000);
+        const uint32_t now = window * WINDOW_MS;
+        meter.update(counter.edges(), now * 1000);
+        if (monitor.update(meter.rpm(), now) == Health::STALL && detected_at == 0) {
+            detected_at = now;
+        }
+    }
+    printf("stall detected after %u ms\n", detected_at - stalled_at);
+    CHECK(detected_at > stalled_at);
+    CHECK_EQ(detected_at - stalled_at, CONFIRM_WINDOWS * WINDOW_MS);
+    counter.stop();
+}
+
+int main(void)
+{
+    test_counter();
+    test_meter();
+    test_monitor();
+    test_stall();
+    return Test_NS::result("test_tach");
+}
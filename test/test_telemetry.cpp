@@ -0,0 +1,251 @@
+#include "telemetry_log.h"
+#include "test.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+
+// Binary telemetry log on a temporary directory standing in for the SPIFFS
+// partition: batching, segment rotation, reopening after a reboot or a torn
+// write, and the flash wear estimates
+using namespace Telemetry_NS;
+
+static char base_path[] = "/tmp/tlogXXXXXX"; // Fits BinaryLog::_base_path
+
+static void remove_segments(void)
+{
+    DIR* dir = opendir(base_path);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] != '.') {
+            char path[sizeof(base_path) + sizeof(entry->d_name)];
+            snprintf(path, sizeof(path), "%s/%s", base_path, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+static void segment_path(char* path, size_t size, uint32_t segment)
+{
+    snprintf(path, size, "%s/log%05u.bin", base_path, segment);
+}
+
+struct Collected {
+    Record records[64];
+    uint32_t count;
+    uint16_t boot;
+};
+
+static bool collect(const SegmentHeader& header, const Record& record, void* context)
+{
+    Collected& collected = *static_cast<Collected*>(context);
+    collected.boot = header.boot;
+    if (collected.count < 64) {
+        collected.records[collected.count] = record;
+    }
+    ++collected.count;
+    return true;
+}
+
+static int16_t value_at(uint32_t time)
+{
+    return static_cast<int16_t>(600 + time % 50);
+}
+
+// Records wait in RAM until the batch is full or flushed, then read back
+// the same in the next boot
+static void test_batch(void)
+{
+    remove_segments();
+    {
+        BinaryLog log(base_path);
+        CHECK_EQ(log.open(), ESP_OK);
+        CHECK_EQ(log.first_segment(), 0);
+        CHECK_EQ(log.last_segment(), 0);
+        CHECK_EQ(log.stats().segments, 1);
+
+        for (uint32_t time = 0; time < FLUSH_EVERY - 1; time++) {
+            CHECK_EQ(log.append(time % 3, time, value_at(time)), ESP_OK);
+        }
+        CHECK_EQ(log.stats().records, 0);
+        CHECK_EQ(log.stats().flushes, 0);
+        CHECK_EQ(log.append((FLUSH_EVERY - 1) % 3, FLUSH_EVERY - 1, value_at(FLUSH_EVERY - 1)), ESP_OK);
+        CHECK_EQ(log.stats().records, FLUSH_EVERY);
+        CHECK_EQ(log.stats().flushes, 1);
+
+        // Partial batch on flush, nothing to do on the second one
+        for (uint32_t time = FLUSH_EVERY; time < FLUSH_EVERY + 5; time++) {
+            log.append(time % 3, time, value_at(time));
+        }
+        CHECK_EQ(log.flush(), ESP_OK);
+        CHECK_EQ(log.flush(), ESP_OK);
+        CHECK_EQ(log.stats().records, FLUSH_EVERY + 5);
+        CHECK_EQ(log.stats().flushes, 2);
+        CHECK_EQ(log.stats().dropped, 0);
+        CHECK_EQ(log.stats().payload_bytes, sizeof(SegmentHeader) + (FLUSH_EVERY + 5) * sizeof(Record));
+
+        // Batched records are written on close
+        log.append(1, 100, -55 * 16);
+    }
+
+    Collected collected {};
+    BinaryLog log(base_path);
+    CHECK_EQ(log.open(), ESP_OK);
+    CHECK_EQ(log.first_segment(), 0);
+    CHECK_EQ(log.last_segment(), 1); // Every boot starts a segment
+    CHECK_EQ(log.stats().segments, 2);
+    CHECK_EQ(log.stats().torn_bytes, 0);
+    CHECK_EQ(log.read_segment(0, collect, &collected), ESP_OK);
+    CHECK_EQ(collected.count, FLUSH_EVERY + 6);
+    CHECK_EQ(collected.boot, 0);
+    for (uint32_t time = 0; time < FLUSH_EVERY + 5; time++) {
+        const Record& record = collected.records[time];
+        CHECK_EQ(record.time, time);
+        CHECK_EQ(record.series, time % 3);
+        CHECK_EQ(record.value, value_at(time));
+    }
+    CHECK_EQ(collected.records[FLUSH_EVERY + 5].value, -55 * 16);
+
+    // Header of the new segment counts the boot
+    log.append(0, 0, 0);
+    log.flush();
+    collected = Collected {};
+    CHECK_EQ(log.read_segment(1, collect, &collected), ESP_OK);
+    CHECK_EQ(collected.count, 1);
+    CHECK_EQ(collected.boot, 1);
+    CHECK_EQ(log.read_segment(7, collect, &collected), ESP_ERR_NOT_FOUND);
+}
+
+// Power lost in the middle of a record: readers stop before it, the next
+// boot reports the bad tail and starts a new segment
+static void test_torn(void)
+{
+    remove_segments();
+    {
+        BinaryLog log(base_path);
+        log.open();
+        for (uint32_t time = 0; time < 10; time++) {
+            log.append(0, time, value_at(time));
+        }
+    }
+    char path[64];
+    segment_path(path, sizeof(path), 0);
+    FILE* file = fopen(path, "ab");
+    const uint8_t half[5] = { 1, 2, 3, 4, 5 };
+    fwrite(half, sizeof(half), 1, file);
+    fclose(file);
+
+    // A corrupted record ends the segment too
+    uint32_t valid = 0;
+    BinaryLog log(base_path);
+    CHECK_EQ(log.open(), ESP_OK);
+    CHECK_EQ(log.stats().torn_bytes, sizeof(half));
+    CHECK_EQ(log.last_segment(), 1);
+    CHECK_EQ(log.read_segment(0, nullptr, nullptr, &valid), ESP_OK);
+    CHECK_EQ(valid, sizeof(SegmentHeader) + 10 * sizeof(Record));
+
+    file = fopen(path, "r+b");
+    fseek(file, sizeof(SegmentHeader) + 4 * sizeof(Record), SEEK_SET);
+    fputc(0x5A, file);
+    fclose(file);
+    Collected collected {};
+    log.read_segment(0, collect, &collected, &valid);
+    CHECK_EQ(collected.count, 4);
+    CHECK_EQ(valid, sizeof(SegmentHeader) + 4 * sizeof(Record));
+}
+
+static uint32_t segment_files(void)
+{
+    uint32_t count = 0;
+    DIR* dir = opendir(base_path);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        count += strncmp(entry->d_name, "log", 3) == 0;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Full segments roll over, the oldest ones are deleted past SEGMENT_COUNT.
+// Batched writes cost about two pages per batch, a flush per record costs a
+// page per record.
+static void test_rotation(void)
+{
+    remove_segments();
+    const uint32_t total = (SEGMENT_COUNT + 2) * SEGMENT_RECORDS + FLUSH_EVERY;
+    uint32_t kept = 0;
+    double seconds = 0;
+    Stats stats;
+    {
+        BinaryLog log(base_path);
+        log.open();
+        const auto start = std::chrono::steady_clock::now();
+        for (uint32_t time = 0; time < total; time++) {
+            log.append(time % 8, time, value_at(time));
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats = log.stats();
+        kept = log.last_segment() - log.first_segment() + 1;
+        CHECK_EQ(log.last_segment(), SEGMENT_COUNT + 2);
+        CHECK_EQ(log.first_segment(), 3);
+        uint32_t valid = 0;
+        log.read_segment(log.first_segment(), nullptr, nullptr, &valid);
+        CHECK_EQ(valid, sizeof(SegmentHeader) + SEGMENT_RECORDS * sizeof(Record));
+        CHECK_EQ(log.read_segment(2, nullptr, nullptr), ESP_ERR_NOT_FOUND);
+    }
+    CHECK_EQ(stats.records, total);
+    CHECK_EQ(stats.dropped, 0);
+    CHECK_EQ(stats.segments, SEGMENT_COUNT);
+    CHECK_EQ(kept, SEGMENT_COUNT);
+    CHECK_EQ(segment_files(), SEGMENT_COUNT);
+    CHECK_EQ(stats.erases, stats.flash_bytes / FLASH_BLOCK_SIZE);
+    // Header shifts the batches off the page boundaries
+    CHECK(stats.amplification() > 100 && stats.amplification() <= 200);
+    printf("batched: %u records in %.3f s, %.0f records/s, amplification %u.%02u, %u erases\n",
+        stats.records, seconds, stats.records / seconds, stats.amplification() / 100,
+        stats.amplification() % 100, stats.erases);
+
+    // The same data flushed record by record
+    remove_segments();
+    BinaryLog log(base_path);
+    log.open();
+    const uint32_t count = SEGMENT_RECORDS;
+    for (uint32_t time = 0; time < count; time++) {
+        log.append(0, time, value_at(time));
+        log.flush();
+    }
+    const Stats& single = log.stats();
+    CHECK_EQ(single.flushes, count);
+    CHECK(single.amplification() > 2000);
+    // Many times the erases of the batched log for the same records
+    CHECK(single.erases > 8 * stats.erases * count / total);
+    printf("flush per record: amplification %u.%02u, %u erases per %u records, batched %u\n",
+        single.amplification() / 100, single.amplification() % 100, single.erases, count,
+        stats.erases * count / total);
+}
+
+// Producers never wait: the host queue stub is always full
+static void test_queue(void)
+{
+    const uint32_t drops = queue_drops();
+    CHECK(!record(0, 1, 2));
+    CHECK(!record(0, 2, 3));
+    CHECK_EQ(queue_drops(), drops + 2);
+}
+
+int main(void)
+{
+    if (mkdtemp(base_path) == nullptr) {
+        printf("Failed to create %s\n", base_path);
+        return 1;
+    }
+    test_batch();
+    test_torn();
+    test_rotation();
+    test_queue();
+    remove_segments();
+    rmdir(base_path);
+    return Test_NS::result("test_telemetry");
+}
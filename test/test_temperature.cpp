@@ -0,0 +1,242 @@
+#include "filters.h"
+#include "gpio.h"
+#include "pwm.h"
+#include "temperature.h"
+#include "test.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Q12.4 helpers, the integer formatter and the sample pipeline against the
+// float path they replaced
+using namespace Temp_NS;
+
+// Time stamp counter cycles, nanoseconds where there is none
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static void test_literals(void)
+{
+    char text[FORMAT_SIZE];
+    CHECK_EQ(format(text, sizeof(text), 0x0191), 5);
+    CHECK(strcmp(text, "25.06") == 0);
+    format(text, sizeof(text), 0);
+    CHECK(strcmp(text, "0.00") == 0);
+    format(text, sizeof(text), -1); // -0.0625
+    CHECK(strcmp(text, "-0.06") == 0);
+    format(text, sizeof(text), -0x01B8); // -27.5
+    CHECK(strcmp(text, "-27.50") == 0);
+    CHECK_EQ(format(text, sizeof(text), INT16_MIN), 8);
+    CHECK(strcmp(text, "-2048.00") == 0);
+    format(text, sizeof(text), INT16_MAX);
+    CHECK(strcmp(text, "2047.94") == 0);
+
+    // Too small buffer gives empty text
+    char small[5];
+    CHECK_EQ(format(small, sizeof(small), 0x0191), 0);
+    CHECK_EQ(small[0], '\0');
+
+    CHECK_EQ(from_degrees(-10), -160);
+    CHECK_EQ(floor_degrees(from_degrees(40) + 15), 40);
+    CHECK_EQ(floor_degrees(-8), -1); // -0.5 C
+}
+
+// Every Q12.4 value, rounded half up to hundredths
+static void test_all_values(void)
+{
+    char text[FORMAT_SIZE];
+    char expected[48];
+    for (int32_t value = INT16_MIN; value <= INT16_MAX; value++) {
+        const double degrees = value / 16.0;
+        const long hundredths = static_cast<long>(std::floor(std::fabs(degrees) * 100 + 0.5));
+        snprintf(expected, sizeof(expected), "%s%ld.%02ld", value < 0 ? "-" : "",
+            hundredths / 100, hundredths % 100);
+        format(text, sizeof(text), static_cast<q4_t>(value));
+        if (strcmp(text, expected) != 0) {
+            CHECK(strcmp(text, expected) == 0);
+            printf("%d: \"%s\", expected \"%s\"\n", value, text, expected);
+            break;
+        }
+    }
+}
+
+// Host numbers, on the ESP8266 the float path is soft-float on top
+static void benchmark(void)
+{
+    const int32_t rounds = 20;
+    char text[16];
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t n = 0; n < rounds; n++) {
+        for (int32_t value = INT16_MIN; value <= INT16_MAX; value++) {
+            sink = sink + format(text, sizeof(text), static_cast<q4_t>(value));
+        }
+    }
+    const double integer = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / rounds / 65536;
+
+    start = std::chrono::steady_clock::now();
+    for (int32_t n = 0; n < rounds; n++) {
+        for (int32_t value = INT16_MIN; value <= INT16_MAX; value++) {
+            const float degrees = value / 16.0f;
+            sink = sink + snprintf(text, sizeof(text), "%.2f", degrees);
+        }
+    }
+    const double floating = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - start).count() / rounds / 65536;
+    printf("Format: Q12.4 %.1f ns, float snprintf %.1f ns\n", integer, floating);
+}
+
+// ===================== Float path before Q12.4 ===============================
+// decode_temp() of a DS18B20 scratchpad, out of line like the one in gpio.cpp
+__attribute__((noinline)) static esp_err_t float_decode(const uint8_t (&data)[9], float& temperature)
+{
+    int16_t raw = (data[1] << 8) | data[0];
+    if (raw == POWER_ON_TEMPERATURE) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    uint8_t cfg = (data[4] & 0x60);
+    if (cfg == 0x00)
+        raw = raw & ~7;
+    else if (cfg == 0x20)
+        raw = raw & ~3;
+    else if (cfg == 0x40)
+        raw = raw & ~1;
+    temperature = raw / 16.0;
+    return ESP_OK;
+}
+
+// FanPWM::_curve_duty()
+static uint32_t float_duty(uint32_t max_duty, float temperature, uint32_t min_temp, uint32_t max_temp)
+{
+    if (temperature <= min_temp) {
+        return 0;
+    }
+    if (temperature >= max_temp) {
+        return max_duty;
+    }
+    return static_cast<uint32_t>(max_duty * (temperature - min_temp) / (max_temp - min_temp));
+}
+
+// Scratchpad to duty of one sensor sample: decode, median of 3 and the
+// linear duty. Each stage runs over the whole trace on its own, the best of
+// several rounds is taken. The host has a hardware FPU, the ESP8266 calls
+// soft-float routines for every float operation of the old path.
+static void test_pipeline(void)
+{
+    const size_t samples = 4096;
+    const uint32_t rounds = 50;
+    const uint32_t max_duty = 1024; // 25 kHz, 10 bit
+    volatile uint32_t min_temp = 30; // Read like the NVS values
+    volatile uint32_t max_temp = 45;
+    static uint8_t scratchpads[samples][9];
+    srand(14);
+    int16_t raw = from_degrees(35);
+    for (size_t i = 0; i < samples; i++) {
+        // Drive warming and cooling between 20 and 55 C, an 85 C spike now
+        // and then
+        raw = static_cast<int16_t>(raw + rand() % 9 - 4);
+        raw = raw < from_degrees(20) ? from_degrees(20) : raw > from_degrees(55) ? from_degrees(55) : raw;
+        const int16_t value = rand() % 200 ? raw : from_degrees(85) + 1;
+        scratchpads[i][0] = static_cast<uint8_t>(value & 0xFF);
+        scratchpads[i][1] = static_cast<uint8_t>(value >> 8);
+        scratchpads[i][4] = 0x7F; // 12 bit
+    }
+
+    static float float_temps[samples];
+    static float float_medians[samples];
+    static uint32_t float_duties[samples];
+    static q4_t temps[samples];
+    static q4_t medians[samples];
+    static uint32_t duties[samples];
+    uint64_t best[2][3];
+    for (auto& path : best) {
+        for (uint64_t& stage : path) {
+            stage = UINT64_MAX;
+        }
+    }
+    for (uint32_t round = 0; round < rounds; round++) {
+        uint64_t start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            float_decode(scratchpads[i], float_temps[i]);
+        }
+        uint64_t end = cycles();
+        best[0][0] = std::min(best[0][0], end - start);
+        Filter_NS::MedianFilter<3> float_median;
+        start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            float_medians[i] = float_median.push(float_temps[i]);
+        }
+        end = cycles();
+        best[0][1] = std::min(best[0][1], end - start);
+        start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            float_duties[i] = float_duty(max_duty, float_medians[i], min_temp, max_temp);
+        }
+        end = cycles();
+        best[0][2] = std::min(best[0][2], end - start);
+
+        start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            OneWire::decode_temp(0x28, scratchpads[i], temps[i]);
+        }
+        end = cycles();
+        best[1][0] = std::min(best[1][0], end - start);
+        Filter_NS::MedianFilter<3, q4_t> median;
+        start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            medians[i] = median.push(temps[i]);
+        }
+        end = cycles();
+        best[1][1] = std::min(best[1][1], end - start);
+        start = cycles();
+        for (size_t i = 0; i < samples; i++) {
+            duties[i] = Fan_NS::Duty::linear(max_duty, medians[i], min_temp, max_temp);
+        }
+        end = cycles();
+        best[1][2] = std::min(best[1][2], end - start);
+    }
+
+    // Same temperatures; duty is never below the old truncated scale factor
+    // and at most its remainder above
+    for (size_t i = 0; i < samples; i++) {
+        CHECK_EQ(float_temps[i] * 16, temps[i]);
+        if (i >= 2) {
+            CHECK_EQ(float_medians[i] * 16, medians[i]);
+            CHECK(duties[i] >= float_duties[i]);
+            CHECK(duties[i] - float_duties[i] <= max_duty % (max_temp - min_temp) + 1);
+        }
+    }
+
+    const char* const stages[] = { "decode", "median", "duty" };
+    uint64_t total[2] = {};
+    for (uint8_t stage = 0; stage < 3; stage++) {
+        printf("Pipeline %-6s: float %5.1f, Q12.4 %5.1f cycles per sample\n", stages[stage],
+            static_cast<double>(best[0][stage]) / samples, static_cast<double>(best[1][stage]) / samples);
+        total[0] += best[0][stage];
+        total[1] += best[1][stage];
+    }
+    printf("Pipeline total : float %5.1f, Q12.4 %5.1f cycles per sample\n",
+        static_cast<double>(total[0]) / samples, static_cast<double>(total[1]) / samples);
+}
+
+int main(void)
+{
+    test_literals();
+    test_all_values();
+    benchmark();
+    test_pipeline();
+    return Test_NS::result("temperature");
+}
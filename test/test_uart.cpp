@@ -0,0 +1,92 @@
+#include "gpio.h"
+#include "test.h"
+#include "uart_loopback.h"
+#include <cstring>
+
+// UART backend on the loopback stand-in: frames, echo decoding and the
+// DS18B20 API on top of them
+using OneWire::DS18B20;
+
+static void test_init(void)
+{
+    Loopback_NS::reset();
+    OneWire::SimBus line { 1 };
+    Loopback_NS::attach(&line);
+    DS18B20 bus { ONEWIRE_UART_PORT };
+    CHECK_EQ(Loopback_NS::swapped(), UART_NUM_0);
+    CHECK_EQ(Loopback_NS::baudrate(), UART_SLOT_BAUDRATE);
+    CHECK_EQ(bus.reset(), ESP_OK);
+    // Slots go back to the slot speed after the reset frame
+    CHECK_EQ(Loopback_NS::baudrate(), UART_SLOT_BAUDRATE);
+    CHECK_EQ(Loopback_NS::statistics().resets, 1);
+}
+
+static void test_reset_errors(void)
+{
+    Loopback_NS::reset();
+    DS18B20 unwired { ONEWIRE_UART_PORT };
+    CHECK_EQ(unwired.reset(), ESP_ERR_INVALID_RESPONSE); // No echo
+
+    Loopback_NS::reset();
+    OneWire::SimBus empty { 0 };
+    Loopback_NS::attach(&empty);
+    DS18B20 bus { ONEWIRE_UART_PORT };
+    CHECK_EQ(bus.reset(), ESP_ERR_TIMEOUT); // Nobody answered
+}
+
+static void test_devices(void)
+{
+    Loopback_NS::reset();
+    OneWire::SimBus line { 3 };
+    Loopback_NS::attach(&line);
+    DS18B20 bus { ONEWIRE_UART_PORT };
+
+    uint8_t addresses[SIM_MAX_DEVICES][8];
+    uint8_t count = 0;
+    CHECK_EQ(bus.search_rom(addresses, SIM_MAX_DEVICES, count), ESP_OK);
+    CHECK_EQ(count, 3);
+    for (uint8_t i = 0; i < count; i++) {
+        bool known = false;
+        for (uint8_t j = 0; j < line.count(); j++) {
+            known |= memcmp(addresses[i], line.device(j).rom, 8) == 0;
+        }
+        CHECK(known);
+        line.device(i).temperature = static_cast<int16_t>(-200 + 300 * i);
+    }
+
+    // Scratchpads are read in bytes of eight frames, every bit is echoed
+    Temp_NS::q4_t temperatures[SIM_MAX_DEVICES] = {};
+    esp_err_t results[SIM_MAX_DEVICES] = {};
+    uint8_t devices[SIM_MAX_DEVICES][8];
+    for (uint8_t i = 0; i < line.count(); i++) {
+        memcpy(devices[i], line.device(i).rom, 8);
+    }
+    CHECK_EQ(bus.get_temps(devices, line.count(), temperatures, results), ESP_OK);
+    for (uint8_t i = 0; i < line.count(); i++) {
+        CHECK_EQ(results[i], ESP_OK);
+        CHECK_EQ(temperatures[i], -200 + 300 * i);
+    }
+    CHECK_EQ(bus.get_crc_errors(), 0);
+
+    const Loopback_NS::Statistics& statistics = Loopback_NS::statistics();
+    CHECK_EQ(statistics.bad_frames, 0);
+    CHECK_EQ(statistics.slots, line.slots());
+    CHECK_EQ(statistics.resets, line.resets());
+
+    // MATCH ROM, READ SCRATCHPAD and 9 bytes: a byte is one write of eight
+    // frames, not eight writes
+    const Loopback_NS::Statistics before = statistics;
+    CHECK_EQ(bus.read_temp(devices[0], temperatures[0]), ESP_OK);
+    CHECK_EQ(statistics.slots - before.slots, (1 + 8 + 1 + 9) * 8);
+    CHECK_EQ(statistics.writes - before.writes, 1 + (1 + 8 + 1 + 9)); // Reset and bytes
+    printf("UART: %u resets, %u slots in %u writes\n", statistics.resets, statistics.slots,
+        statistics.writes);
+}
+
+int main(void)
+{
+    test_init();
+    test_reset_errors();
+    test_devices();
+    return Test_NS::result("uart");
+}
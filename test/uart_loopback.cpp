@@ -0,0 +1,125 @@
+#include "uart_loopback.h"
+#include "onewire_uart.h"
+#include "sdkconfig.h"
+#include <cstring>
+
+namespace Loopback_NS {
+
+static OneWire::SimBus* line = nullptr;
+static uart_port_t swapped_port = UART_NUM_MAX;
+static uint32_t line_baudrate = 0;
+static bool installed = false;
+static uint8_t rx[UART_FIFO_LEN * 2];
+static size_t rx_head = 0;
+static size_t rx_size = 0;
+static Statistics counters {};
+
+void attach(OneWire::SimBus* bus) { line = bus; }
+uart_port_t swapped(void) { return swapped_port; }
+uint32_t baudrate(void) { return line_baudrate; }
+Statistics& statistics(void) { return counters; }
+
+void reset(void)
+{
+    line = nullptr;
+    swapped_port = UART_NUM_MAX;
+    line_baudrate = 0;
+    installed = false;
+    rx_head = 0;
+    rx_size = 0;
+    memset(&counters, 0, sizeof(counters));
+}
+
+// Line level during one frame as RX sees it
+static uint8_t echo(uint8_t frame)
+{
+    if (line_baudrate == UART_RESET_BAUDRATE) {
+        if (frame != UART_RESET_FRAME) {
+            ++counters.bad_frames;
+            return frame;
+        }
+        ++counters.resets;
+        // Presence pulse holds the line low over the high data bits
+        return line->reset() == ESP_OK ? 0xE0 : frame;
+    }
+    if (line_baudrate != UART_SLOT_BAUDRATE
+        || (frame != UART_WRITE_1_FRAME && frame != UART_WRITE_0_FRAME)) {
+        ++counters.bad_frames;
+        return frame;
+    }
+    ++counters.slots;
+    const uint8_t level = line->touch_bit(frame == UART_WRITE_1_FRAME);
+    // Device answering 0 keeps the line low past the sample point
+    return frame == UART_WRITE_0_FRAME ? 0x00 : (level ? 0xFF : 0xF8);
+}
+
+} // namespace Loopback_NS
+
+using namespace Loopback_NS;
+
+esp_err_t uart_param_config(uart_port_t uart_num, uart_config_t* uart_conf)
+{
+    if (uart_num == CONFIG_CONSOLE_UART_NUM) {
+        return ESP_ERR_INVALID_STATE; // 1-Wire must not take the console
+    }
+    line_baudrate = uart_conf->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int, int,
+    QueueHandle_t*, int)
+{
+    if (uart_num != UART_NUM_0 || rx_buffer_size <= UART_FIFO_LEN) {
+        return ESP_ERR_INVALID_ARG; // UART1 of ESP8266 has no RX
+    }
+    installed = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_enable_swap(void)
+{
+    swapped_port = UART_NUM_0;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t, uint32_t baudrate)
+{
+    line_baudrate = baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t, TickType_t) { return ESP_OK; }
+
+esp_err_t uart_flush_input(uart_port_t)
+{
+    rx_head = 0;
+    rx_size = 0;
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t, const char* src, size_t size)
+{
+    if (!installed) {
+        return -1;
+    }
+    ++counters.writes;
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t frame = static_cast<uint8_t>(src[i]);
+        if (line == nullptr || rx_size == sizeof(rx)) {
+            continue; // Not wired or RX overflow, the echo is lost
+        }
+        rx[(rx_head + rx_size++) % sizeof(rx)] = echo(frame);
+    }
+    return static_cast<int>(size);
+}
+
+int uart_read_bytes(uart_port_t, uint8_t* buf, uint32_t length, TickType_t)
+{
+    uint32_t read = 0;
+    while (read < length && rx_size > 0) {
+        buf[read++] = rx[rx_head];
+        rx_head = (rx_head + 1) % sizeof(rx);
+        --rx_size;
+    }
+    return static_cast<int>(read);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "driver/uart.h"
+#include "onewire_sim.h"
+
+// Stand-in of UART0 with TX and RX joined to a simulated 1-Wire line. Every
+// transmitted frame comes back to RX as the line carried it: devices pulling
+// the line low clear the bits they overlap.
+namespace Loopback_NS {
+
+struct Statistics {
+    uint32_t resets; // 0xF0 frames at the reset baud rate
+    uint32_t slots; // Frames at the slot baud rate
+    uint32_t bad_frames; // Frames which are no 1-Wire signal
+    uint32_t writes; // uart_write_bytes calls
+};
+
+// Devices on the line, nullptr - RX is not wired, nothing comes back
+void attach(OneWire::SimBus* bus);
+// Port which took over the console pins, UART_NUM_MAX - none
+uart_port_t swapped(void);
+uint32_t baudrate(void);
+Statistics& statistics(void);
+void reset(void);
+
+} // namespace Loopback_NS